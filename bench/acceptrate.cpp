@@ -0,0 +1,138 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "bench.h"
+#include "eventloop.h"
+#include "tcpserver.h"
+
+// Connections per second a TcpServer accepts, with one listener on the
+// main loop and with 1, 2, 4 ... N SO_REUSEPORT acceptors on worker
+// loops. Client threads connect and reset (SO_LINGER 0, so no TIME_WAIT
+// piles up) as fast as they can; the server closes what it accepts.
+//
+// usage: acceptrate [max loops = 4] [client threads = 4] [duration ms = 1000] [port = 47140]
+
+static void connectLoop(uint16_t port, const std::atomic<bool> &isRunning)
+{
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    linger reset = {1, 0};
+
+    while (isRunning)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) break;
+
+        ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+        ::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+        ::close(fd);
+    }
+}
+
+// Runs the clients for duration ms while wait() keeps the server going
+template<typename Wait>
+static void measure(const std::string &name, long clientCount, int duration, uint16_t port,
+                    const std::atomic<uint64_t> &accepted, Wait wait)
+{
+    std::atomic<bool> isRunning = true;
+    std::vector<std::thread> clients;
+    for (long i=0; i<clientCount; ++i)
+        clients.emplace_back(connectLoop, port, std::cref(isRunning));
+
+    uint64_t acceptedStart = accepted;
+    double timeStart = Bench::seconds();
+    wait(duration);
+    double elapsed = Bench::seconds() - timeStart;
+    uint64_t count = accepted - acceptedStart;
+
+    isRunning = false;
+    for (std::thread &client : clients)
+        client.join();
+
+    Bench::printRate(name, static_cast<double>(count), elapsed, "connections");
+}
+
+int main(int argc, char *argv[])
+{
+    long maxLoops = Bench::argument(argc, argv, 1, 4L);
+    long clientCount = Bench::argument(argc, argv, 2, 4L);
+    int duration = static_cast<int>(Bench::argument(argc, argv, 3, 1000L));
+    uint16_t port = static_cast<uint16_t>(Bench::argument(argc, argv, 4, 47140L));
+
+    std::atomic<uint64_t> accepted = 0;
+    auto handler = [&accepted](int descr, uint32_t, uint16_t) {
+        ::close(descr);
+        ++accepted;
+    };
+
+    {
+        SA::EventLoop &loop = *SA::EventLoop::current();
+        SA::TcpServer server;
+        server.addConnectHandler(handler);
+        if (!server.listen(port))
+        {
+            std::cout << "listen failed on port " << port << std::endl;
+            return 1;
+        }
+
+        measure("single listener", clientCount, duration, port, accepted, [&loop](int duration) {
+            loop.runFor(duration);
+        });
+
+        server.close();
+    }
+
+    for (long count=1; count<=maxLoops; count*=2)
+    {
+        std::atomic<bool> isRunning = true;
+        std::atomic<long> started = 0;
+        std::vector<SA::EventLoop*> loops(static_cast<size_t>(count), nullptr);
+        std::vector<std::thread> workers;
+
+        for (long i=0; i<count; ++i)
+        {
+            workers.emplace_back([&, i]() {
+                SA::EventLoop *loop = SA::EventLoop::current();
+                loops[static_cast<size_t>(i)] = loop;
+                ++started;
+
+                while (isRunning)
+                    loop->processEvents(10);
+
+                // Acceptors close their descriptors on their own loop
+                loop->processEvents(0);
+            });
+        }
+
+        while (started < count)
+            std::this_thread::yield();
+
+        SA::TcpServer server;
+        if (!server.listen(port, loops, handler))
+        {
+            std::cout << "listen failed on port " << port << std::endl;
+            isRunning = false;
+            for (std::thread &worker : workers) worker.join();
+            return 1;
+        }
+
+        measure(std::to_string(count) + " acceptor loops", clientCount, duration, port, accepted, [](int duration) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(duration));
+        });
+
+        server.close();
+        isRunning = false;
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    return 0;
+}
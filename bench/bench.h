@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <sys/resource.h>
+#include "histogram.h"
+
+// Helpers shared by the benchmarks. Each benchmark is a plain executable
+// that takes its parameters as positional arguments and prints one line
+// per measurement.
+namespace Bench
+{
+    inline int64_t nanoseconds()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    inline double seconds()
+    {
+        return static_cast<double>(nanoseconds()) / 1e9;
+    }
+
+    // User plus system time of the process
+    inline double cpuSeconds()
+    {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+             + static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    }
+
+    // Positional argument index (1-based), fallback when it is missing
+    inline long argument(int argc, char *argv[], int index, long fallback)
+    {
+        return index < argc ? std::strtol(argv[index], nullptr, 10) : fallback;
+    }
+
+    inline std::string argument(int argc, char *argv[], int index, const char *fallback)
+    {
+        return index < argc ? argv[index] : fallback;
+    }
+
+    inline void printRate(const std::string &name, double count, double elapsed, const char *unit)
+    {
+        std::cout << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << count / elapsed << " " << unit << "/s"
+                  << std::setprecision(3) << "  (" << elapsed << " s)" << std::endl;
+    }
+
+    // Nanosecond samples, printed in microseconds
+    inline void printLatency(const std::string &name, const SA::Histogram &histogram)
+    {
+        std::cout << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(1)
+                  << " p50 " << static_cast<double>(histogram.percentile(50)) / 1e3
+                  << " us  p99 " << static_cast<double>(histogram.percentile(99)) / 1e3
+                  << " us  max " << static_cast<double>(histogram.max()) / 1e3
+                  << " us  (" << histogram.count() << " samples)" << std::endl;
+    }
+
+} // namespace Bench
@@ -0,0 +1,215 @@
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "bench.h"
+#include "eventloop.h"
+#include "tcpserver.h"
+#include "tcpsocket.h"
+
+// Requests per second of a TcpServer echoing small messages, once with
+// the io_uring backend (when built with SA_IO_URING and the kernel has
+// it) and once with epoll. Client threads keep one message in flight on
+// each connection with plain blocking sockets. The server side syscalls
+// (recv, send, sendmsg, epoll_wait, io_uring_enter) are counted by
+// wrapping the libc functions, the clients use read() and write().
+//
+// usage: echorate [connections = 64] [client threads = 2] [duration ms = 1000]
+//                 [message size = 64] [port = 47150]
+
+static std::atomic<uint64_t> syscalls = 0;
+
+template<typename Function>
+static Function next(const char *name)
+{
+    return reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+}
+
+extern "C" ssize_t recv(int fd, void *buffer, size_t size, int flags)
+{
+    static auto function = next<ssize_t (*)(int, void *, size_t, int)>("recv");
+    ++syscalls;
+    return function(fd, buffer, size, flags);
+}
+
+extern "C" ssize_t send(int fd, const void *buffer, size_t size, int flags)
+{
+    static auto function = next<ssize_t (*)(int, const void *, size_t, int)>("send");
+    ++syscalls;
+    return function(fd, buffer, size, flags);
+}
+
+extern "C" ssize_t sendmsg(int fd, const msghdr *message, int flags)
+{
+    static auto function = next<ssize_t (*)(int, const msghdr *, int)>("sendmsg");
+    ++syscalls;
+    return function(fd, message, flags);
+}
+
+extern "C" int epoll_wait(int epfd, epoll_event *events, int maxEvents, int timeout)
+{
+    static auto function = next<int (*)(int, epoll_event *, int, int)>("epoll_wait");
+    ++syscalls;
+    return function(epfd, events, maxEvents, timeout);
+}
+
+// The io_uring backend enters the kernel through syscall()
+extern "C" long syscall(long number, ...)
+{
+    static auto function = next<long (*)(long, ...)>("syscall");
+    if (number == __NR_io_uring_enter) ++syscalls;
+
+    va_list args;
+    va_start(args, number);
+    long a = va_arg(args, long), b = va_arg(args, long), c = va_arg(args, long);
+    long e = va_arg(args, long), f = va_arg(args, long), g = va_arg(args, long);
+    va_end(args);
+    return function(number, a, b, c, e, f, g);
+}
+
+static bool readAll(int fd, char *buffer, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t result = ::read(fd, buffer, size);
+        if (result <= 0) return false;
+        buffer += result;
+        size -= static_cast<size_t>(result);
+    }
+    return true;
+}
+
+static void clientLoop(uint16_t port, size_t connections, size_t size, const std::atomic<bool> &isRunning,
+                       std::atomic<uint64_t> &requests)
+{
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    std::vector<int> fds;
+    for (size_t i=0; i<connections; ++i)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        int noDelay = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            ::close(fd);
+            continue;
+        }
+        fds.push_back(fd);
+    }
+
+    std::vector<char> message(size, 'x');
+    while (isRunning)
+    {
+        for (int fd : fds)
+            if (::write(fd, message.data(), size) < 0) return;
+
+        for (int fd : fds)
+            if (!readAll(fd, message.data(), size)) return;
+
+        requests += fds.size();
+    }
+
+    for (int fd : fds)
+        ::close(fd);
+}
+
+// Returns the backend the server loop ended up with
+static std::string measure(const char *backend, long connections, long threads, int duration, size_t size, uint16_t port)
+{
+    setenv("SA_EVENTLOOP_BACKEND", backend, 1);
+
+    std::atomic<bool> isReady = false, isRunning = true, isServing = true;
+    std::string name;
+
+    std::thread serverThread([&]() {
+        SA::EventLoop *loop = SA::EventLoop::current();
+        SA::TcpServer server;
+
+        server.addConnectionHandler([](int, SA::TcpSocket &socket) {
+            socket.addReadHandler([&socket](std::span<const char> data) {
+                socket.send(std::vector<char>(data.begin(), data.end()));
+                return data.size();
+            });
+        });
+
+        name = loop->backend();
+        isReady = server.listen(port);
+        isServing = isReady.load();
+
+        while (isServing)
+            loop->processEvents(10);
+
+        server.close();
+    });
+
+    while (!isReady && isServing)
+        std::this_thread::yield();
+
+    std::atomic<uint64_t> requests = 0;
+    std::vector<std::thread> clients;
+    for (long i=0; i<threads; ++i)
+    {
+        size_t count = static_cast<size_t>(connections / threads + (i < connections % threads ? 1 : 0));
+        clients.emplace_back(clientLoop, port, count, size, std::cref(isRunning), std::ref(requests));
+    }
+
+    // Let the connections settle before counting
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    uint64_t requestsStart = requests, syscallsStart = syscalls;
+    double timeStart = Bench::seconds();
+    std::this_thread::sleep_for(std::chrono::milliseconds(duration));
+    double elapsed = Bench::seconds() - timeStart;
+    double count = static_cast<double>(requests - requestsStart);
+    double calls = static_cast<double>(syscalls - syscallsStart);
+
+    isRunning = false;
+    for (std::thread &client : clients)
+        client.join();
+
+    isServing = false;
+    serverThread.join();
+
+    if (isReady)
+    {
+        Bench::printRate(name, count, elapsed, "requests");
+        std::cout << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(2)
+                  << " server syscalls per request " << (count > 0 ? calls / count : 0) << std::endl;
+    }
+    else
+    {
+        std::cout << "listen failed on port " << port << std::endl;
+    }
+
+    return name;
+}
+
+int main(int argc, char *argv[])
+{
+    long connections = Bench::argument(argc, argv, 1, 64L);
+    long threads = Bench::argument(argc, argv, 2, 2L);
+    int duration = static_cast<int>(Bench::argument(argc, argv, 3, 1000L));
+    size_t size = static_cast<size_t>(Bench::argument(argc, argv, 4, 64L));
+    uint16_t port = static_cast<uint16_t>(Bench::argument(argc, argv, 5, 47150L));
+
+    std::string first = measure("io_uring", connections, threads, duration, size, port);
+    if (first == "epoll")
+        std::cout << "io_uring is not available, build with -DSA_IO_URING=ON" << std::endl;
+    else
+        measure("epoll", connections, threads, duration, size, static_cast<uint16_t>(port + 1));
+
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include <any>
+#include <atomic>
+#include <new>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "bench.h"
+#include "object.h"
+
+// Events per second through Object::event with SA::Event, against the
+// std::any payloads it replaced (pairs for positions, any_cast in the
+// listener). Every event goes to each listener, as WidgetLinux::sendEvent
+// does, and the stream is mostly mouse motion with some paint, button
+// and key events. Heap allocations during dispatch are counted too.
+//
+// usage: eventdispatch [events = 10000000] [listeners = 4]
+
+static std::atomic<uint64_t> allocations = 0;
+
+void *operator new(std::size_t size)
+{
+    ++allocations;
+    if (void *pointer = std::malloc(size ? size : 1)) return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept { std::free(pointer); }
+
+// The listener side of the old Widget::event
+class AnyListener
+{
+public:
+    virtual ~AnyListener() = default;
+
+    virtual void event(SA::EventTypes type, const std::any &value)
+    {
+        switch (type)
+        {
+        case SA::MouseMoveEvent:
+        {
+            auto pair = std::any_cast<std::pair<int32_t, int32_t> >(value);
+            sum += pair.first + pair.second;
+            break;
+        }
+        case SA::PaintEvent: sum += std::any_cast<bool>(value); break;
+        case SA::MouseButtonEvent: sum += std::any_cast<SA::MouseEvent>(value).pressed; break;
+        case SA::KeyboardEvent: sum += std::any_cast<SA::KeyEvent>(value).keycode; break;
+        default: break;
+        }
+    }
+
+    int64_t sum = 0;
+};
+
+class EventListener : public SA::Object
+{
+public:
+    void event(const SA::Event &event) override
+    {
+        switch (event.type)
+        {
+        case SA::MouseMoveEvent:
+        {
+            const SA::Point &point = std::get<SA::Point>(event.value);
+            sum += point.x + point.y;
+            break;
+        }
+        case SA::PaintEvent: sum += std::get<bool>(event.value); break;
+        case SA::MouseButtonEvent: sum += std::get<SA::MouseEvent>(event.value).pressed; break;
+        case SA::KeyboardEvent: sum += std::get<SA::KeyEvent>(event.value).keycode; break;
+        default: break;
+        }
+    }
+
+    int64_t sum = 0;
+};
+
+// Mostly motion, then one paint, button or key event every 16th
+template<typename Send>
+static void generate(long count, Send send)
+{
+    for (long i=0; i<count; ++i)
+    {
+        int32_t x = static_cast<int32_t>(i & 1023), y = static_cast<int32_t>((i >> 10) & 1023);
+        switch (i & 63)
+        {
+        case 15: send(SA::PaintEvent, 0, 0); break;
+        case 31: send(SA::MouseButtonEvent, 0, 0); break;
+        case 47: send(SA::KeyboardEvent, 0, 0); break;
+        default: send(SA::MouseMoveEvent, x, y); break;
+        }
+    }
+}
+
+template<typename Run>
+static void measure(const char *name, long events, Run run)
+{
+    uint64_t allocationsStart = allocations;
+    double timeStart = Bench::seconds();
+    int64_t sum = run();
+    double elapsed = Bench::seconds() - timeStart;
+
+    Bench::printRate(name, static_cast<double>(events), elapsed, "events");
+    std::cout << std::left << std::setw(32) << name << std::right
+              << " allocations " << allocations - allocationsStart << ", checksum " << sum << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    long events = Bench::argument(argc, argv, 1, 10000000L);
+    long listenerCount = Bench::argument(argc, argv, 2, 4L);
+
+    std::vector<std::unique_ptr<AnyListener>> anyListeners;
+    std::vector<std::unique_ptr<SA::Object>> eventListeners;
+    for (long i=0; i<listenerCount; ++i)
+    {
+        anyListeners.emplace_back(std::make_unique<AnyListener>());
+        eventListeners.emplace_back(std::make_unique<EventListener>());
+    }
+
+    measure("std::any", events, [&]() {
+        auto send = [&](SA::EventTypes type, const std::any &value) {
+            for (auto &listener : anyListeners) listener->event(type, value);
+        };
+
+        generate(events, [&](SA::EventTypes type, int32_t x, int32_t y) {
+            switch (type)
+            {
+            case SA::MouseMoveEvent: send(type, std::pair<int32_t, int32_t>(x, y)); break;
+            case SA::PaintEvent: send(type, true); break;
+            case SA::MouseButtonEvent: send(type, SA::MouseEvent(SA::ButtonLeft, true)); break;
+            default: send(type, SA::KeyEvent(SA::Key_Escape, SA::KeyModifiers(), true)); break;
+            }
+        });
+
+        int64_t sum = 0;
+        for (auto &listener : anyListeners) sum += listener->sum;
+        return sum;
+    });
+
+    measure("SA::Event", events, [&]() {
+        auto send = [&](SA::EventTypes type, const SA::EventValue &value) {
+            const SA::Event event(type, value);
+            for (auto &listener : eventListeners) listener->event(event);
+        };
+
+        generate(events, [&](SA::EventTypes type, int32_t x, int32_t y) {
+            switch (type)
+            {
+            case SA::MouseMoveEvent: send(type, SA::Point(x, y)); break;
+            case SA::PaintEvent: send(type, true); break;
+            case SA::MouseButtonEvent: send(type, SA::MouseEvent(SA::ButtonLeft, true)); break;
+            default: send(type, SA::KeyEvent(SA::Key_Escape, SA::KeyModifiers(), true)); break;
+            }
+        });
+
+        int64_t sum = 0;
+        for (auto &listener : eventListeners) sum += static_cast<EventListener&>(*listener).sum;
+        return sum;
+    });
+
+    return 0;
+}
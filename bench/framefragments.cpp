@@ -0,0 +1,174 @@
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "framecodec.h"
+
+// FrameCodec throughput when the stream arrives in fragments of 1, 7, 64,
+// 1024 and 16384 bytes, for every framing. The harness keeps a read buffer
+// the way TcpSocket does: fragments are appended, the codec sees what is
+// pending and what it did not consume stays for the next read. "copying"
+// is the usual hand-written alternative for u32 lengths: append to a
+// vector, copy each frame out and erase it from the front.
+//
+// usage: framefragments [frames = 500000] [max payload = 512]
+
+static const size_t FragmentSizes[] = {1, 7, 64, 1024, 16384};
+
+class ReadBuffer
+{
+public:
+    template<typename Decode>
+    void receive(std::span<const char> fragment, Decode decode)
+    {
+        if (buffer.size() < end + fragment.size())
+        {
+            std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+            if (buffer.size() < end + fragment.size())
+                buffer.resize((end + fragment.size()) * 2);
+        }
+
+        std::memcpy(buffer.data() + end, fragment.data(), fragment.size());
+        end += fragment.size();
+
+        begin += decode(std::span<const char>(buffer.data() + begin, end - begin));
+        if (begin == end) begin = end = 0;
+    }
+
+private:
+    std::vector<char> buffer;
+    size_t begin = 0;
+    size_t end = 0;
+};
+
+template<typename Decode>
+static void measure(const std::string &name, const std::vector<char> &stream, size_t frames, Decode &decode)
+{
+    for (size_t fragmentSize : FragmentSizes)
+    {
+        decode.reset();
+        double timeStart = Bench::seconds();
+
+        for (size_t offset=0; offset<stream.size(); offset+=fragmentSize)
+        {
+            size_t size = std::min(fragmentSize, stream.size() - offset);
+            decode(std::span<const char>(stream.data() + offset, size));
+        }
+
+        double elapsed = Bench::seconds() - timeStart;
+        uint64_t decoded = decode.reset();
+
+        std::string label = name + " / " + std::to_string(fragmentSize);
+        Bench::printRate(label, static_cast<double>(stream.size()) / 1e6, elapsed, "MB");
+        if (decoded != frames)
+            std::cout << label << ": decoded " << decoded << " of " << frames << " frames" << std::endl;
+    }
+}
+
+struct CodecDecoder
+{
+    SA::FrameCodec &codec;
+    ReadBuffer buffer;
+    uint64_t frames = 0;
+
+    void operator()(std::span<const char> fragment)
+    {
+        buffer.receive(fragment, [this](std::span<const char> data) { return codec.decode(data); });
+    }
+
+    uint64_t reset()
+    {
+        uint64_t count = frames;
+        frames = 0;
+        codec.reset();
+        buffer = ReadBuffer();
+        return count;
+    }
+};
+
+struct CopyingDecoder
+{
+    std::vector<char> pending;
+    uint64_t frames = 0;
+    uint64_t checksum = 0;
+
+    void operator()(std::span<const char> fragment)
+    {
+        pending.insert(pending.end(), fragment.begin(), fragment.end());
+
+        while (pending.size() >= 4)
+        {
+            const unsigned char *header = reinterpret_cast<const unsigned char *>(pending.data());
+            size_t size = (size_t(header[0]) << 24) | (size_t(header[1]) << 16) | (size_t(header[2]) << 8) | header[3];
+            if (pending.size() < 4 + size) break;
+
+            std::vector<char> frame(pending.begin() + 4, pending.begin() + 4 + static_cast<long>(size));
+            checksum += frame.size();
+            ++frames;
+            pending.erase(pending.begin(), pending.begin() + 4 + static_cast<long>(size));
+        }
+    }
+
+    uint64_t reset()
+    {
+        uint64_t count = frames;
+        frames = 0;
+        pending.clear();
+        return count;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    size_t frames = static_cast<size_t>(Bench::argument(argc, argv, 1, 500000L));
+    size_t maxPayload = static_cast<size_t>(Bench::argument(argc, argv, 2, 512L));
+
+    std::mt19937 random(1);
+    std::vector<size_t> sizes(frames);
+    for (size_t &size : sizes)
+        size = 16 + random() % (maxPayload - 15);
+
+    struct Case
+    {
+        const char *name;
+        SA::FrameCodec::Framing framing;
+    };
+
+    const Case cases[] = {
+        {"u32", SA::FrameCodec::LengthU32},
+        {"varint", SA::FrameCodec::LengthVarint},
+        {"delimiter", SA::FrameCodec::Delimiter},
+        {"fixed", SA::FrameCodec::FixedSize},
+    };
+
+    std::vector<char> u32Stream;
+
+    for (const Case &test : cases)
+    {
+        SA::FrameCodec codec;
+        if (test.framing == SA::FrameCodec::Delimiter) codec.setDelimiter("\r\n");
+        else if (test.framing == SA::FrameCodec::FixedSize) codec.setFixedSize(maxPayload);
+        else codec.setFraming(test.framing);
+
+        std::vector<char> stream;
+        for (size_t size : sizes)
+        {
+            std::vector<char> payload(test.framing == SA::FrameCodec::FixedSize ? maxPayload : size, 'x');
+            codec.encode(payload, stream);
+        }
+
+        if (test.framing == SA::FrameCodec::LengthU32) u32Stream = stream;
+
+        CodecDecoder decoder{codec, {}};
+        codec.addFrameHandler([&decoder](std::span<const char>) { ++decoder.frames; });
+        measure(std::string("FrameCodec ") + test.name, stream, frames, decoder);
+    }
+
+    CopyingDecoder copying;
+    measure("copying u32", u32Stream, frames, copying);
+
+    return 0;
+}
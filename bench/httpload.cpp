@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+#include "eventloop.h"
+#include "httpserver.h"
+
+// Load generator for HttpServer over loopback. One client thread drives
+// every connection with epoll, each keeps pipeline requests in flight and
+// sends the next batch once all responses of the last one are in. The
+// server runs on a loop thread with a small route and a static directory.
+// Without arguments it runs the scenarios below, with a path it runs that.
+//
+// usage: httpload [duration ms = 1000] [port = 47160] [path connections pipeline]
+
+struct Scenario
+{
+    std::string path;
+    int connections;
+    int pipeline;
+};
+
+struct Client
+{
+    int fd = -1;
+    std::string request;    // one batch of pipelined requests
+    size_t written = 0;
+    std::string input;
+    int pending = 0;        // responses of the batch still to come
+};
+
+// Removes complete responses from the front of input, -1 on garbage
+static int takeResponses(std::string &input)
+{
+    int count = 0;
+    size_t offset = 0;
+
+    while (true)
+    {
+        size_t headerEnd = input.find("\r\n\r\n", offset);
+        if (headerEnd == std::string::npos) break;
+
+        std::string_view head(input.data() + offset, headerEnd - offset);
+        if (head.substr(0, 9) != "HTTP/1.1 " || head.substr(9, 3) != "200") return -1;
+
+        size_t length = 0;
+        size_t field = head.find("Content-Length: ");
+        if (field != std::string_view::npos) length = std::strtoul(head.data() + field + 16, nullptr, 10);
+
+        size_t responseEnd = headerEnd + 4 + length;
+        if (responseEnd > input.size()) break;
+
+        offset = responseEnd;
+        ++count;
+    }
+
+    input.erase(0, offset);
+    return count;
+}
+
+static bool sendBatch(Client &client)
+{
+    while (client.written < client.request.size())
+    {
+        ssize_t result = ::send(client.fd, client.request.data() + client.written,
+                                client.request.size() - client.written, MSG_NOSIGNAL);
+        if (result < 0) return errno == EAGAIN;
+        client.written += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+static void run(const Scenario &scenario, int duration, uint16_t port)
+{
+    int epollFd = ::epoll_create1(0);
+    std::vector<Client> clients(static_cast<size_t>(scenario.connections));
+
+    std::string request = "GET " + scenario.path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (Client &client : clients)
+    {
+        client.fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        int noDelay = 1;
+        ::setsockopt(client.fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        if (::connect(client.fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            std::cout << "connect failed on port " << port << std::endl;
+            return;
+        }
+
+        ::fcntl(client.fd, F_SETFL, ::fcntl(client.fd, F_GETFL) | O_NONBLOCK);
+        for (int i=0; i<scenario.pipeline; ++i)
+            client.request += request;
+
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = &client;
+        ::epoll_ctl(epollFd, EPOLL_CTL_ADD, client.fd, &event);
+
+        client.pending = scenario.pipeline;
+        sendBatch(client);
+    }
+
+    uint64_t responses = 0;
+    bool isFailed = false;
+    char buffer[65536];
+    epoll_event events[64];
+
+    double timeStart = Bench::seconds();
+    double timeEnd = timeStart + duration / 1e3;
+
+    while (!isFailed && Bench::seconds() < timeEnd)
+    {
+        int count = ::epoll_wait(epollFd, events, 64, 10);
+        for (int i=0; i<count && !isFailed; ++i)
+        {
+            Client &client = *static_cast<Client *>(events[i].data.ptr);
+
+            ssize_t size;
+            while ((size = ::recv(client.fd, buffer, sizeof(buffer), 0)) > 0)
+                client.input.append(buffer, static_cast<size_t>(size));
+
+            if (size == 0) isFailed = true;
+
+            int complete = takeResponses(client.input);
+            if (complete < 0) isFailed = true;
+
+            responses += static_cast<uint64_t>(std::max(complete, 0));
+            client.pending -= complete;
+
+            if (client.pending == 0)
+            {
+                client.pending = scenario.pipeline;
+                client.written = 0;
+            }
+
+            // The rest of a batch larger than the socket buffer goes out here too
+            if (!sendBatch(client)) isFailed = true;
+        }
+    }
+
+    double elapsed = Bench::seconds() - timeStart;
+
+    for (Client &client : clients)
+        ::close(client.fd);
+    ::close(epollFd);
+
+    std::string name = scenario.path + " " + std::to_string(scenario.connections) + "x" + std::to_string(scenario.pipeline);
+    if (isFailed) std::cout << name << ": bad response or connection closed" << std::endl;
+    Bench::printRate(name, static_cast<double>(responses), elapsed, "requests");
+}
+
+int main(int argc, char *argv[])
+{
+    int duration = static_cast<int>(Bench::argument(argc, argv, 1, 1000L));
+    uint16_t port = static_cast<uint16_t>(Bench::argument(argc, argv, 2, 47160L));
+
+    std::vector<Scenario> scenarios = {
+        {"/hello", 1, 1},
+        {"/hello", 50, 1},
+        {"/hello", 50, 16},
+        {"/static/small.txt", 10, 1},
+        {"/static/large.bin", 10, 1},
+    };
+
+    if (argc > 3)
+        scenarios = {{argv[3], static_cast<int>(Bench::argument(argc, argv, 4, 50L)),
+                      static_cast<int>(Bench::argument(argc, argv, 5, 1L))}};
+
+    std::string directory = "/tmp/sa_httpload";
+    ::mkdir(directory.c_str(), 0755);
+    std::ofstream(directory + "/small.txt") << std::string(512, 's');
+    std::ofstream(directory + "/large.bin") << std::string(300 * 1024, 'l');
+
+    std::atomic<bool> isReady = false, isServing = true;
+    std::thread serverThread([&]() {
+        SA::EventLoop *loop = SA::EventLoop::current();
+        SA::HttpServer server;
+        server.addRoute("GET", "/hello", [](const SA::HttpRequest &, SA::HttpResponse &response) {
+            response.send("Hello, world!", "text/plain");
+        });
+        server.addStaticDirectory("/static", directory);
+
+        isReady = server.listen(port);
+        isServing = isReady.load();
+
+        while (isServing)
+            loop->processEvents(10);
+    });
+
+    while (!isReady && isServing)
+        std::this_thread::yield();
+
+    if (isReady)
+    {
+        for (const Scenario &scenario : scenarios)
+            run(scenario, duration, port);
+    }
+    else
+    {
+        std::cout << "listen failed on port " << port << std::endl;
+    }
+
+    isServing = false;
+    serverThread.join();
+
+    std::remove((directory + "/small.txt").c_str());
+    std::remove((directory + "/large.bin").c_str());
+    ::rmdir(directory.c_str());
+    return 0;
+}
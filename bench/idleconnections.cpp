@@ -0,0 +1,174 @@
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "bench.h"
+#include "eventloop.h"
+#include "tcpserver.h"
+#include "tcpsocket.h"
+
+// Syscalls and CPU of a server with many connected, mostly idle sockets.
+// A writer thread sends one byte to a random connection every interval
+// ms. The event loop waits for readiness; the old loop called recv() on
+// every socket each pass and slept 1 ms, emulated here with MSG_DONTWAIT
+// (the original blocked up to 10 us per socket on SO_RCVTIMEO).
+// recv() and epoll_wait() are counted by wrapping the libc functions.
+//
+// usage: idleconnections [connections = 10000] [duration ms = 2000] [interval ms = 1] [port = 47110]
+
+static std::atomic<uint64_t> recvCalls = 0;
+static std::atomic<uint64_t> waitCalls = 0;
+
+extern "C" ssize_t recv(int fd, void *buffer, size_t size, int flags)
+{
+    using Function = ssize_t (*)(int, void *, size_t, int);
+    static Function function = reinterpret_cast<Function>(dlsym(RTLD_NEXT, "recv"));
+    ++recvCalls;
+    return function(fd, buffer, size, flags);
+}
+
+extern "C" int epoll_wait(int epfd, epoll_event *events, int maxEvents, int timeout)
+{
+    using Function = int (*)(int, epoll_event *, int, int);
+    static Function function = reinterpret_cast<Function>(dlsym(RTLD_NEXT, "epoll_wait"));
+    ++waitCalls;
+    return function(epfd, events, maxEvents, timeout);
+}
+
+static int connectClient(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        if (fd > -1) ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+template<typename Run>
+static void measure(const char *name, const std::vector<int> &clients, int duration, int interval, Run run)
+{
+    std::atomic<bool> isRunning = true;
+    std::thread writer([&]() {
+        std::mt19937 random(1);
+        while (isRunning)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+            char byte = 1;
+            if (::write(clients[random() % clients.size()], &byte, 1) < 0) break;
+        }
+    });
+
+    recvCalls = 0;
+    waitCalls = 0;
+    double cpuStart = Bench::cpuSeconds();
+    uint64_t received = run();
+    double seconds = duration / 1e3;
+    double cpu = Bench::cpuSeconds() - cpuStart;
+
+    isRunning = false;
+    writer.join();
+
+    std::cout << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(0)
+              << " recv " << std::setw(10) << static_cast<double>(recvCalls) / seconds << "/s"
+              << "  epoll_wait " << std::setw(6) << static_cast<double>(waitCalls) / seconds << "/s"
+              << std::setprecision(2) << "  cpu " << cpu * 1e3 / seconds << " ms/s"
+              << "  bytes " << received << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t connections = static_cast<size_t>(Bench::argument(argc, argv, 1, 10000L));
+    int duration = static_cast<int>(Bench::argument(argc, argv, 2, 2000L));
+    int interval = static_cast<int>(Bench::argument(argc, argv, 3, 1L));
+    uint16_t port = static_cast<uint16_t>(Bench::argument(argc, argv, 4, 47110L));
+
+    // Both ends of every connection live in this process
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (connections * 2 + 64 > limit.rlim_cur)
+    {
+        connections = (limit.rlim_cur - 64) / 2;
+        std::cout << "descriptor limit " << limit.rlim_cur << ", using " << connections << " connections" << std::endl;
+    }
+
+    SA::EventLoop loop;
+    SA::TcpServer server;
+    uint64_t received = 0;
+
+    server.addConnectionHandler([&](int, SA::TcpSocket &socket) {
+        socket.addReadHandler([&](std::span<const char> data) {
+            received += data.size();
+            return data.size();
+        });
+    });
+
+    if (!server.listen(port))
+    {
+        std::cout << "listen failed on port " << port << std::endl;
+        return 1;
+    }
+
+    std::vector<int> clients;
+    while (clients.size() < connections)
+    {
+        int fd = connectClient(port);
+        if (fd < 0) break;
+        clients.push_back(fd);
+
+        // Accept as we go, the backlog is limited
+        if (clients.size() % 64 == 0) loop.processEvents(0);
+    }
+
+    while (server.connectionCount() < clients.size())
+        loop.processEvents(10);
+
+    std::cout << clients.size() << " connections, one byte every " << interval << " ms" << std::endl;
+
+    measure(loop.backend(), clients, duration, interval, [&]() {
+        received = 0;
+        loop.runFor(duration);
+        return received;
+    });
+
+    std::vector<int> descriptors;
+    server.forEachConnection([&](int, SA::TcpSocket &socket) { descriptors.push_back(socket.descriptor()); });
+
+    measure("recv-poll", clients, duration, interval, [&]() {
+        uint64_t bytes = 0;
+        char buffer[256];
+        int64_t timeEnd = Bench::nanoseconds() + duration * 1000000LL;
+        while (Bench::nanoseconds() < timeEnd)
+        {
+            for (int descr : descriptors)
+            {
+                ssize_t size = ::recv(descr, buffer, sizeof(buffer), MSG_DONTWAIT);
+                if (size > 0) bytes += static_cast<uint64_t>(size);
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return bytes;
+    });
+
+    for (int fd : clients)
+        ::close(fd);
+
+    return 0;
+}
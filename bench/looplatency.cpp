@@ -0,0 +1,87 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "eventloop.h"
+
+// Idle CPU use and event-to-handler latency of SA::EventLoop, against the
+// loop it replaced: poll every source, then sleep 1 ms.
+// A writer thread sends its clock through a pipe every interval ms, the
+// handler records how long the stamp waited to be read.
+//
+// usage: looplatency [duration ms = 2000] [interval ms = 5]
+
+static void drain(int fd, SA::Histogram &latency)
+{
+    int64_t stamps[64];
+    ssize_t size;
+    while ((size = ::read(fd, stamps, sizeof(stamps))) > 0)
+    {
+        int64_t now = Bench::nanoseconds();
+        for (ssize_t i=0; i<size / static_cast<ssize_t>(sizeof(int64_t)); ++i)
+            latency.record(static_cast<uint64_t>(now - stamps[i]));
+    }
+}
+
+template<typename Run>
+static void measure(const char *name, int duration, int interval, Run run)
+{
+    int fds[2];
+    if (::pipe2(fds, O_NONBLOCK) != 0) return;
+
+    // Idle: the pipe is watched but nothing arrives
+    double cpuStart = Bench::cpuSeconds();
+    SA::Histogram idle;
+    run(fds[0], duration, idle);
+    double cpu = Bench::cpuSeconds() - cpuStart;
+
+    std::cout << std::left << std::setw(32) << (std::string(name) + " idle cpu") << std::right << std::fixed
+              << std::setprecision(2) << std::setw(14) << cpu * 1e3 / (duration / 1e3) << " ms/s" << std::endl;
+
+    std::atomic<bool> isRunning = true;
+    std::thread writer([&]() {
+        while (isRunning)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+            int64_t stamp = Bench::nanoseconds();
+            if (::write(fds[1], &stamp, sizeof(stamp)) < 0) break;
+        }
+    });
+
+    SA::Histogram latency;
+    run(fds[0], duration, latency);
+
+    isRunning = false;
+    writer.join();
+    Bench::printLatency(std::string(name) + " latency", latency);
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+int main(int argc, char *argv[])
+{
+    int duration = static_cast<int>(Bench::argument(argc, argv, 1, 2000L));
+    int interval = static_cast<int>(Bench::argument(argc, argv, 2, 5L));
+
+    measure("sleep-poll", duration, interval, [](int fd, int duration, SA::Histogram &latency) {
+        int64_t timeEnd = Bench::nanoseconds() + duration * 1000000LL;
+        while (Bench::nanoseconds() < timeEnd)
+        {
+            drain(fd, latency);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    SA::EventLoop loop;
+    measure(loop.backend(), duration, interval, [&loop](int fd, int duration, SA::Histogram &latency) {
+        loop.addDescriptorListener(fd, [fd, &latency](int){ drain(fd, latency); });
+        loop.runFor(duration);
+        loop.removeDescriptorListener(fd);
+    });
+
+    return 0;
+}
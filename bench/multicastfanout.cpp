@@ -0,0 +1,89 @@
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+
+#include "bench.h"
+#include "eventloop.h"
+#include "udpsocket.h"
+
+// Multicast fan-out on one host: a sender thread sends small datagrams
+// to a group with sendBatch(), 1, 2, 4 ... N subscribers on one loop
+// receive them in batch mode. One send reaches every subscriber, the
+// total is what all of them received together.
+//
+// usage: multicastfanout [max subscribers = 32] [duration ms = 1000] [datagram size = 64]
+//                        [group = 239.255.0.1] [interface = 127.0.0.1] [port = 47130]
+
+static const size_t BatchSize = 64;
+
+int main(int argc, char *argv[])
+{
+    size_t maxSubscribers = static_cast<size_t>(Bench::argument(argc, argv, 1, 32L));
+    int duration = static_cast<int>(Bench::argument(argc, argv, 2, 1000L));
+    size_t size = static_cast<size_t>(Bench::argument(argc, argv, 3, 64L));
+    std::string group = Bench::argument(argc, argv, 4, "239.255.0.1");
+    std::string localInterface = Bench::argument(argc, argv, 5, "127.0.0.1");
+    uint16_t port = static_cast<uint16_t>(Bench::argument(argc, argv, 6, 47130L));
+
+    SA::EventLoop &loop = *SA::EventLoop::current();
+    std::vector<char> payload(size, 'x');
+    uint32_t groupAddress = ntohl(inet_addr(group.c_str()));
+
+    for (size_t count=1; count<=maxSubscribers; count*=2)
+    {
+        uint64_t received = 0;
+        std::vector<std::unique_ptr<SA::UdpSocket>> subscribers;
+
+        for (size_t i=0; i<count; ++i)
+        {
+            auto socket = std::make_unique<SA::UdpSocket>();
+            socket->setReuseAddress(true);
+            socket->setBatchSize(BatchSize, size);
+            socket->addBatchReadHandler([&](std::span<const SA::UdpSocket::Datagram> batch) {
+                received += batch.size();
+            });
+
+            if (!socket->bind(port) || !socket->joinGroup(group, localInterface))
+            {
+                std::cout << "cannot join " << group << " on " << localInterface << std::endl;
+                return 1;
+            }
+
+            subscribers.push_back(std::move(socket));
+        }
+
+        std::atomic<bool> isRunning = true;
+        std::atomic<uint64_t> sent = 0;
+        std::thread sender([&]() {
+            SA::UdpSocket socket;
+            socket.setMulticastInterface(localInterface);
+            socket.setMulticastLoopback(true);
+
+            std::vector<SA::UdpSocket::Datagram> batch(BatchSize);
+            for (SA::UdpSocket::Datagram &datagram : batch)
+            {
+                datagram.data = std::span<const char>(payload.data(), payload.size());
+                datagram.host = groupAddress;
+                datagram.port = port;
+            }
+
+            while (isRunning)
+                sent += socket.sendBatch(batch);
+        });
+
+        double timeStart = Bench::seconds();
+        loop.runFor(duration);
+        double elapsed = Bench::seconds() - timeStart;
+
+        isRunning = false;
+        sender.join();
+
+        std::string name = std::to_string(count) + " subscribers";
+        Bench::printRate(name + " sent", static_cast<double>(sent), elapsed, "datagrams");
+        Bench::printRate(name + " received", static_cast<double>(received), elapsed, "datagrams");
+    }
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "eventloop.h"
+
+// Throughput of EventLoop::post() with 1, 2, 4 ... N producer threads
+// feeding one loop, and how long a post waits before its handler runs.
+//
+// usage: postthroughput [max producers = 8] [posts per producer = 250000]
+
+int main(int argc, char *argv[])
+{
+    long maxProducers = Bench::argument(argc, argv, 1, 8L);
+    long posts = Bench::argument(argc, argv, 2, 250000L);
+
+    SA::EventLoop loop;
+
+    for (long producers=1; producers<=maxProducers; producers*=2)
+    {
+        long total = producers * posts;
+        long handled = 0;
+        SA::Histogram latency;
+
+        double timeStart = Bench::seconds();
+
+        std::vector<std::thread> threads;
+        for (long i=0; i<producers; ++i)
+        {
+            threads.emplace_back([&]() {
+                for (long n=0; n<posts; ++n)
+                {
+                    // Sample every 64th post, reading the clock is not free
+                    int64_t stamp = (n & 63) ? 0 : Bench::nanoseconds();
+                    loop.post([&, stamp]() {
+                        if (stamp) latency.record(static_cast<uint64_t>(Bench::nanoseconds() - stamp));
+                        ++handled;
+                    });
+                }
+            });
+        }
+
+        while (handled < total)
+            loop.processEvents(100);
+        double elapsed = Bench::seconds() - timeStart;
+
+        for (std::thread &thread : threads)
+            thread.join();
+
+        std::string name = std::to_string(producers) + " producers";
+        Bench::printRate(name, static_cast<double>(total), elapsed, "posts");
+        Bench::printLatency(name + " wait", latency);
+    }
+
+    return 0;
+}
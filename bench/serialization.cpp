@@ -0,0 +1,203 @@
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "serialization.h"
+
+// Encoding and decoding 1M small records with SA::Writer/SA::Reader,
+// against hand-written memcpy of fixed-width fields and binary writes
+// through std::stringstream. Prints time per direction and encoded size.
+//
+// usage: serialization [records = 1000000]
+
+struct Record
+{
+    uint32_t id = 0;
+    int64_t timestamp = 0;
+    double price = 0;
+    std::string symbol;
+    std::vector<int32_t> values;
+
+    template<typename Stream>
+    void serialize(Stream &stream) { stream(id, timestamp, price, symbol, values); }
+
+    bool operator==(const Record &) const = default;
+};
+
+static void writeSized(std::vector<char> &out, const void *data, size_t size)
+{
+    size_t offset = out.size();
+    out.resize(offset + size);
+    std::memcpy(out.data() + offset, data, size);
+}
+
+static void memcpyEncode(const std::vector<Record> &records, std::vector<char> &out)
+{
+    for (const Record &record : records)
+    {
+        uint32_t symbolSize = static_cast<uint32_t>(record.symbol.size());
+        uint32_t valueCount = static_cast<uint32_t>(record.values.size());
+
+        size_t offset = out.size();
+        out.resize(offset + sizeof(uint32_t) + sizeof(int64_t) + sizeof(double) + 2 * sizeof(uint32_t));
+        char *position = out.data() + offset;
+        std::memcpy(position, &record.id, sizeof(record.id)); position += sizeof(record.id);
+        std::memcpy(position, &record.timestamp, sizeof(record.timestamp)); position += sizeof(record.timestamp);
+        std::memcpy(position, &record.price, sizeof(record.price)); position += sizeof(record.price);
+        std::memcpy(position, &symbolSize, sizeof(symbolSize)); position += sizeof(symbolSize);
+        std::memcpy(position, &valueCount, sizeof(valueCount));
+
+        writeSized(out, record.symbol.data(), symbolSize);
+        writeSized(out, record.values.data(), valueCount * sizeof(int32_t));
+    }
+}
+
+static bool memcpyDecode(std::span<const char> data, std::vector<Record> &records)
+{
+    size_t position = 0;
+    auto take = [&](void *value, size_t size) {
+        if (data.size() - position < size) return false;
+        std::memcpy(value, data.data() + position, size);
+        position += size;
+        return true;
+    };
+
+    while (position < data.size())
+    {
+        Record &record = records.emplace_back();
+        uint32_t symbolSize = 0, valueCount = 0;
+        if (!take(&record.id, sizeof(record.id)) || !take(&record.timestamp, sizeof(record.timestamp)) ||
+            !take(&record.price, sizeof(record.price)) || !take(&symbolSize, sizeof(symbolSize)) ||
+            !take(&valueCount, sizeof(valueCount)))
+            return false;
+
+        if (data.size() - position < symbolSize) return false;
+        record.symbol.assign(data.data() + position, symbolSize);
+        position += symbolSize;
+
+        record.values.resize(valueCount);
+        if (!take(record.values.data(), valueCount * sizeof(int32_t))) return false;
+    }
+
+    return true;
+}
+
+static void streamEncode(const std::vector<Record> &records, std::stringstream &stream)
+{
+    for (const Record &record : records)
+    {
+        uint32_t symbolSize = static_cast<uint32_t>(record.symbol.size());
+        uint32_t valueCount = static_cast<uint32_t>(record.values.size());
+        stream.write(reinterpret_cast<const char *>(&record.id), sizeof(record.id));
+        stream.write(reinterpret_cast<const char *>(&record.timestamp), sizeof(record.timestamp));
+        stream.write(reinterpret_cast<const char *>(&record.price), sizeof(record.price));
+        stream.write(reinterpret_cast<const char *>(&symbolSize), sizeof(symbolSize));
+        stream.write(reinterpret_cast<const char *>(&valueCount), sizeof(valueCount));
+        stream.write(record.symbol.data(), symbolSize);
+        stream.write(reinterpret_cast<const char *>(record.values.data()), valueCount * sizeof(int32_t));
+    }
+}
+
+static bool streamDecode(std::stringstream &stream, size_t count, std::vector<Record> &records)
+{
+    for (size_t i=0; i<count; ++i)
+    {
+        Record &record = records.emplace_back();
+        uint32_t symbolSize = 0, valueCount = 0;
+        stream.read(reinterpret_cast<char *>(&record.id), sizeof(record.id));
+        stream.read(reinterpret_cast<char *>(&record.timestamp), sizeof(record.timestamp));
+        stream.read(reinterpret_cast<char *>(&record.price), sizeof(record.price));
+        stream.read(reinterpret_cast<char *>(&symbolSize), sizeof(symbolSize));
+        stream.read(reinterpret_cast<char *>(&valueCount), sizeof(valueCount));
+        if (!stream) return false;
+
+        record.symbol.resize(symbolSize);
+        stream.read(record.symbol.data(), symbolSize);
+        record.values.resize(valueCount);
+        stream.read(reinterpret_cast<char *>(record.values.data()), valueCount * sizeof(int32_t));
+    }
+
+    return static_cast<bool>(stream);
+}
+
+static void print(const char *name, double encode, double decode, size_t size, bool isValid)
+{
+    std::cout << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(1)
+              << " encode " << std::setw(7) << encode * 1e3 << " ms  decode " << std::setw(7) << decode * 1e3
+              << " ms  size " << std::setw(6) << static_cast<double>(size) / 1e6 << " MB"
+              << (isValid ? "" : "  MISMATCH") << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t count = static_cast<size_t>(Bench::argument(argc, argv, 1, 1000000L));
+
+    // Small ids and values, as most payloads have
+    std::mt19937 random(1);
+    std::vector<Record> records(count);
+    for (Record &record : records)
+    {
+        record.id = random() % 100000;
+        record.timestamp = 1700000000000 + static_cast<int64_t>(random() % 1000000);
+        record.price = static_cast<double>(random() % 100000) / 100.0;
+        record.symbol = "SYM" + std::to_string(random() % 1000);
+        record.values.resize(random() % 8);
+        for (int32_t &value : record.values)
+            value = static_cast<int32_t>(random() % 2000) - 1000;
+    }
+
+    {
+        std::vector<char> buffer;
+        double timeStart = Bench::seconds();
+        SA::Writer writer(buffer);
+        for (const Record &record : records)
+            writer.write(record);
+        double encode = Bench::seconds() - timeStart;
+
+        std::vector<Record> decoded;
+        decoded.reserve(count);
+        timeStart = Bench::seconds();
+        SA::Reader reader(buffer);
+        while (!reader.atEnd() && reader.isValid())
+            reader.read(decoded.emplace_back());
+        double decode = Bench::seconds() - timeStart;
+
+        print("Writer/Reader", encode, decode, buffer.size(), reader.isValid() && decoded == records);
+    }
+
+    {
+        std::vector<char> buffer;
+        double timeStart = Bench::seconds();
+        memcpyEncode(records, buffer);
+        double encode = Bench::seconds() - timeStart;
+
+        std::vector<Record> decoded;
+        decoded.reserve(count);
+        timeStart = Bench::seconds();
+        bool isValid = memcpyDecode(buffer, decoded);
+        double decode = Bench::seconds() - timeStart;
+
+        print("memcpy", encode, decode, buffer.size(), isValid && decoded == records);
+    }
+
+    {
+        std::stringstream stream;
+        double timeStart = Bench::seconds();
+        streamEncode(records, stream);
+        double encode = Bench::seconds() - timeStart;
+        size_t size = stream.str().size();
+
+        std::vector<Record> decoded;
+        decoded.reserve(count);
+        timeStart = Bench::seconds();
+        bool isValid = streamDecode(stream, count, decoded);
+        double decode = Bench::seconds() - timeStart;
+
+        print("stringstream", encode, decode, size, isValid && decoded == records);
+    }
+
+    return 0;
+}
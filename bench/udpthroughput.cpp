@@ -0,0 +1,101 @@
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "eventloop.h"
+#include "udpsocket.h"
+
+// Loopback UDP throughput: a sender thread blasts datagrams of one size
+// at a bound UdpSocket, which counts what it receives in each mode.
+// Plain, mmsg-batched, GSO (UDP_SEGMENT) send and GSO with GRO receive.
+//
+// usage: udpthroughput [duration ms = 1000] [datagram size = 1200] [port = 47120]
+
+static const uint32_t Loopback = 0x7F000001;
+static const size_t BatchSize = 64;
+
+struct Mode
+{
+    const char *name;
+    size_t receiveBatch;    // 0 reads one datagram per syscall
+    bool receiveOffload;
+    std::function<void (SA::UdpSocket &socket, size_t size, uint16_t port)> send;
+};
+
+static void measure(const Mode &mode, int duration, size_t size, uint16_t port)
+{
+    SA::EventLoop &loop = *SA::EventLoop::current();
+    SA::UdpSocket receiver;
+    receiver.setReceiveOffload(mode.receiveOffload);
+    if (mode.receiveBatch > 0)
+        receiver.setBatchSize(mode.receiveBatch, mode.receiveOffload ? 65536 : size);
+
+    uint64_t datagrams = 0, bytes = 0;
+    receiver.addReadHandler([&](std::span<const char> data) {
+        ++datagrams;
+        bytes += data.size();
+    });
+
+    if (!receiver.bind(Loopback, port))
+    {
+        std::cout << mode.name << ": bind failed on port " << port << std::endl;
+        return;
+    }
+
+    std::atomic<bool> isRunning = true;
+    std::thread sender([&]() {
+        SA::UdpSocket socket;
+        while (isRunning)
+            mode.send(socket, size, port);
+    });
+
+    double timeStart = Bench::seconds();
+    loop.runFor(duration);
+    double elapsed = Bench::seconds() - timeStart;
+
+    isRunning = false;
+    sender.join();
+
+    Bench::printRate(mode.name, static_cast<double>(datagrams), elapsed, "datagrams");
+    Bench::printRate(mode.name, static_cast<double>(bytes) / 1e6, elapsed, "MB");
+}
+
+int main(int argc, char *argv[])
+{
+    int duration = static_cast<int>(Bench::argument(argc, argv, 1, 1000L));
+    size_t size = static_cast<size_t>(Bench::argument(argc, argv, 2, 1200L));
+    uint16_t port = static_cast<uint16_t>(Bench::argument(argc, argv, 3, 47120L));
+
+    std::vector<char> payload(size, 'x');
+    std::vector<char> bulk(size * BatchSize, 'x');
+
+    std::vector<Mode> modes = {
+        {"send / read", 0, false, [&](SA::UdpSocket &socket, size_t, uint16_t port) {
+            socket.send(payload, Loopback, port);
+        }},
+        {"sendBatch / batch read", BatchSize, false, [&](SA::UdpSocket &socket, size_t size, uint16_t port) {
+            static thread_local std::vector<SA::UdpSocket::Datagram> batch;
+            batch.assign(BatchSize, SA::UdpSocket::Datagram());
+            for (SA::UdpSocket::Datagram &datagram : batch)
+            {
+                datagram.data = std::span<const char>(payload.data(), size);
+                datagram.host = Loopback;
+                datagram.port = port;
+            }
+            socket.sendBatch(batch);
+        }},
+        {"sendSegmented / batch read", BatchSize, false, [&](SA::UdpSocket &socket, size_t size, uint16_t port) {
+            socket.sendSegmented(bulk, static_cast<uint16_t>(size), Loopback, port);
+        }},
+        {"sendSegmented / GRO read", BatchSize, true, [&](SA::UdpSocket &socket, size_t size, uint16_t port) {
+            socket.sendSegmented(bulk, static_cast<uint16_t>(size), Loopback, port);
+        }},
+    };
+
+    for (const Mode &mode : modes)
+        measure(mode, duration, size, port);
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+
+#include "bench.h"
+#include "eventloop.h"
+#include "httpserver.h"
+#include "websocket.h"
+
+// WebSocket broadcast to many local clients. The server runs on a loop
+// thread, the clients on the main loop. Each round the server sends one
+// message to every connection, either as one frame encoded once and
+// shared (WebSocket::encode) or encoded per connection, and the round
+// ends when every client has it.
+//
+// usage: wsfanout [clients = 1000] [port = 47170]
+
+struct Round
+{
+    size_t size;
+    int count;
+};
+
+int main(int argc, char *argv[])
+{
+    size_t clientCount = static_cast<size_t>(Bench::argument(argc, argv, 1, 1000L));
+    uint16_t port = static_cast<uint16_t>(Bench::argument(argc, argv, 2, 47170L));
+
+    // Both ends of every connection live in this process
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (clientCount * 2 + 64 > limit.rlim_cur)
+    {
+        clientCount = (limit.rlim_cur - 64) / 2;
+        std::cout << "descriptor limit " << limit.rlim_cur << ", using " << clientCount << " clients" << std::endl;
+    }
+
+    std::atomic<SA::EventLoop*> serverLoop = nullptr;
+    std::atomic<bool> isServing = true;
+    std::atomic<size_t> serverCount = 0;
+    std::vector<SA::WebSocket*> connections;   // server loop only
+
+    std::thread serverThread([&]() {
+        SA::EventLoop *loop = SA::EventLoop::current();
+        SA::HttpServer server;
+        server.addWebSocketRoute("/feed", [&](SA::WebSocket &socket) {
+            SA::WebSocket *pointer = &socket;
+            connections.push_back(pointer);
+            ++serverCount;
+            socket.addCloseHandler([&, pointer](uint16_t) {
+                std::erase(connections, pointer);
+                --serverCount;
+            });
+        });
+
+        if (server.listen(port)) serverLoop = loop;
+        else isServing = false;
+
+        while (isServing)
+            loop->processEvents(10);
+    });
+
+    while (!serverLoop && isServing)
+        std::this_thread::yield();
+
+    if (!serverLoop)
+    {
+        std::cout << "listen failed on port " << port << std::endl;
+        serverThread.join();
+        return 1;
+    }
+
+    SA::EventLoop &loop = *SA::EventLoop::current();
+    uint64_t received = 0;
+    size_t openCount = 0;
+    std::vector<std::unique_ptr<SA::WebSocket>> clients;
+
+    for (size_t i=0; i<clientCount; ++i)
+    {
+        auto client = std::make_unique<SA::WebSocket>();
+        client->addOpenHandler([&]() { ++openCount; });
+        client->addMessageHandler([&](SA::WebSocket::MessageType, std::span<const char>) { ++received; });
+        client->connect("127.0.0.1", port, "/feed");
+        clients.push_back(std::move(client));
+
+        // Let the server accept as we go, the backlog is limited
+        if (i % 64 == 63) loop.processEvents(1);
+    }
+
+    double timeConnect = Bench::seconds();
+    while ((openCount < clientCount || serverCount < clientCount) && Bench::seconds() - timeConnect < 30)
+        loop.processEvents(10);
+
+    std::cout << openCount << " clients open" << std::endl;
+
+    const Round rounds[] = {{1024, 300}, {64 * 1024, 50}};
+
+    for (const Round &round : rounds)
+    {
+        for (bool isShared : {true, false})
+        {
+            std::vector<char> payload(round.size, 'x');
+            SA::Histogram latency;
+            received = 0;
+
+            double timeStart = Bench::seconds();
+            for (int i=0; i<round.count; ++i)
+            {
+                int64_t roundStart = Bench::nanoseconds();
+                serverLoop.load()->post([&connections, &payload, isShared]() {
+                    if (isShared)
+                    {
+                        auto frame = SA::WebSocket::encode(SA::WebSocket::Binary, payload);
+                        for (SA::WebSocket *socket : connections) socket->send(frame);
+                    }
+                    else
+                    {
+                        for (SA::WebSocket *socket : connections) socket->send(SA::WebSocket::Binary, payload);
+                    }
+                });
+
+                uint64_t target = static_cast<uint64_t>(i + 1) * openCount;
+                while (received < target)
+                    loop.processEvents(10);
+
+                latency.record(static_cast<uint64_t>(Bench::nanoseconds() - roundStart));
+            }
+            double elapsed = Bench::seconds() - timeStart;
+
+            std::string name = std::to_string(round.size / 1024) + " KiB " + (isShared ? "shared" : "per connection");
+            Bench::printRate(name, static_cast<double>(received), elapsed, "messages");
+            Bench::printLatency(name + " round", latency);
+        }
+    }
+
+    clients.clear();
+    double timeClose = Bench::seconds();
+    while (serverCount > 0 && Bench::seconds() - timeClose < 30)
+        loop.processEvents(10);
+
+    isServing = false;
+    serverThread.join();
+    return 0;
+}
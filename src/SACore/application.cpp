@@ -1,36 +1,24 @@
-#include <algorithm>
-#include <iostream>
-#include <thread>
-#include <chrono>
-#include <ctime>
-#include <list>
-#include <map>
+#include <memory>
+#include <mutex>
 
 #include "application.h"
+#include "threadpool.h"
 
 namespace SA {
 
-    struct TimerStruct
+    // Calls reset when the thread that holds it exits
+    struct ThreadExitGuard
     {
-        SA::Object *object;
-        int interval;
-        bool removed = false;
-        std::chrono::time_point<std::chrono::steady_clock> timeEnd;
-
-        TimerStruct(SA::Object *_object, int _interval,
-                    std::chrono::time_point<std::chrono::steady_clock> _timeEnd):
-            object(_object), interval(_interval), timeEnd(_timeEnd){}
+        std::function<void ()> reset;
+        ~ThreadExitGuard() { if (reset) reset(); }
     };
 
     struct Application::ApplicationPrivate
     {
-        int exitCode = 0;
-        bool quitFlag = false;
-        bool isRunning = false;
+        SA::EventLoop *loop = nullptr;
 
-        std::map<int, std::function<void ()> > mainLoopHandlers;
-        std::vector<SA::Object*> mainLoopListeners;
-        std::map<int, TimerStruct> timers;
+        std::once_flag threadPoolFlag;
+        std::unique_ptr<SA::ThreadPool> threadPool;
     };
 
     Application &Application::instance()
@@ -41,136 +29,138 @@ namespace SA {
 
     int Application::exec()
     {
-        if (d->isRunning) return 0;
-        d->isRunning = true;
+        return d->loop->exec();
+    }
 
-        while(1)
-        {
-            timesStep();
+    void Application::quit(int exitCode)
+    {
+        d->loop->quit(exitCode);
+    }
 
-            for(SA::Object *object: d->mainLoopListeners)
-                object->mainLoopEvent();
+    void Application::processEvents(int maxTime)
+    {
+        d->loop->processEvents(maxTime);
+    }
 
-            for (const auto &it: d->mainLoopHandlers)
-                it.second();
+    void Application::runFor(int duration)
+    {
+        d->loop->runFor(duration);
+    }
 
-            if (d->quitFlag) break;
+    void Application::setClock(Clock *clock)
+    {
+        d->loop->setClock(clock);
+    }
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        }
+    EventLoop &Application::mainLoop()
+    {
+        return *d->loop;
+    }
 
-        return d->exitCode;
+    void Application::post(const std::function<void ()> &handler)
+    {
+        d->loop->post(handler);
     }
 
-    void Application::quit(int exitCode)
+    void Application::postDelayed(const std::function<void ()> &handler, int delay)
     {
-        d->exitCode = exitCode;
-        d->quitFlag = true;
-        d->isRunning = false;
+        d->loop->postDelayed(handler, delay);
     }
 
     void Application::addMainLoopListener(Object *object)
     {
-        d->mainLoopListeners.push_back(object);
+        d->loop->addMainLoopListener(object);
     }
 
     void Application::removeMainLoopListener(Object *object)
     {
-        auto it = find(d->mainLoopListeners.begin(), d->mainLoopListeners.end(), object);
-        if (it != d->mainLoopListeners.end())
-            d->mainLoopListeners.erase(it);
+        d->loop->removeMainLoopListener(object);
     }
 
     int Application::addMainLoopListener(const std::function<void ()> &handler)
     {
-        int id = static_cast<int>(d->mainLoopHandlers.size());
-        for (auto const& it : d->mainLoopHandlers) if (it.first != ++id) break;
-        d->mainLoopHandlers.insert({id, handler});
-
-        return id;
+        return d->loop->addMainLoopListener(handler);
     }
 
     void Application::removeMainLoopListener(int id)
     {
-        auto it = d->mainLoopHandlers.find(id);
-        if (it != d->mainLoopHandlers.end())
-            d->mainLoopHandlers.erase(it);
+        d->loop->removeMainLoopListener(id);
     }
 
-    int Application::startTimer(Object *object, int interval)
+    bool Application::addDescriptorListener(int descr, const std::function<void (int)> &handler, int events)
     {
-        if (!object) return -1;
-        int newId = 1;
-
-        for (const auto &timer : d->timers)
-            if (timer.first == newId) ++newId;
+        return d->loop->addDescriptorListener(descr, handler, events);
+    }
 
-        std::chrono::time_point<std::chrono::steady_clock> timeEnd;
-        timeEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(interval);
+    bool Application::setDescriptorEvents(int descr, int events)
+    {
+        return d->loop->setDescriptorEvents(descr, events);
+    }
 
-        d->timers.insert({newId, TimerStruct(object, interval, timeEnd)});
-        return newId;
+    void Application::removeDescriptorListener(int descr)
+    {
+        d->loop->removeDescriptorListener(descr);
     }
 
-    bool Application::killTimer(int id)
+    int Application::startTimer(Object *object, int interval)
     {
-        auto it = d->timers.find(id);
+        return d->loop->startTimer(object, interval);
+    }
 
-        if (it == d->timers.end())
-            return false;
+    int Application::singleShot(int delay, const std::function<void ()> &handler)
+    {
+        return d->loop->singleShot(delay, handler);
+    }
 
-        it->second.removed = true;
-        return true;
+    bool Application::killTimer(int id)
+    {
+        return d->loop->killTimer(id);
     }
 
     bool Application::killTimers(Object *object)
     {
-        for (auto it = d->timers.begin(); it != d->timers.end(); ++it)
-        {
-            if (it->second.object == object)
-            {
-                d->timers.erase(it);
-                return true;
-            }
-        }
-
-        return false;
+        return d->loop->killTimers(object);
     }
 
-    Application::Application(): d(new ApplicationPrivate)
+    void Application::setStatsEnabled(bool state)
     {
+        d->loop->setStatsEnabled(state);
     }
 
-    Application::~Application()
+    bool Application::isStatsEnabled()
     {
-        delete d;
+        return d->loop->isStatsEnabled();
     }
 
-    void Application::timesStep()
+    void Application::dumpStats(std::ostream &output)
     {
-        if (d->timers.size() == 0) return;
+        d->loop->dumpStats(output);
+    }
 
-        auto &&now = std::chrono::steady_clock::now();
-        std::map<int, TimerStruct>::iterator it, prev;
-        prev = d->timers.end();
+    void Application::setStatsSnapshotHandler(int interval, const std::function<void (LoopStats &)> &handler)
+    {
+        d->loop->setStatsSnapshotHandler(interval, handler);
+    }
 
-        for (it=d->timers.begin(); it!=d->timers.end(); ++it)
-        {
-            if (prev != d->timers.end())
-                if (prev->second.removed)
-                    d->timers.erase(prev);
+    ThreadPool &Application::threadPool()
+    {
+        std::call_once(d->threadPoolFlag, [this]{ d->threadPool = std::make_unique<SA::ThreadPool>(); });
+        return *d->threadPool;
+    }
 
-            if (it->second.timeEnd <= now)
-            {
-                it->second.timeEnd = now + std::chrono::milliseconds(it->second.interval);
-                it->second.object->timerEvent(it->first);
-            }
+    Application::Application(): d(new ApplicationPrivate)
+    {
+        d->loop = EventLoop::current();
 
-            prev = it;
-        }
+        // The instance itself is never destroyed. The pool is joined when the
+        // main thread exits, before its loop goes (thread_local objects are
+        // destroyed in reverse order), so results still have a loop to go to.
+        static thread_local ThreadExitGuard guard;
+        guard.reset = [this]() { d->threadPool.reset(); };
+    }
 
-        if (prev != d->timers.end())
-            if (prev->second.removed)
-                d->timers.erase(prev);
+    Application::~Application()
+    {
+        delete d;
     }
 }
@@ -3,10 +3,16 @@
 #include <cstddef>
 #include <string>
 #include <functional>
+#include <iosfwd>
 #include "object.h"
+#include "eventloop.h"
 
 namespace SA
 {
+    class ThreadPool;
+
+    // Process-wide entry point. Loop calls are forwarded to the event loop
+    // of the thread that first created the Application (the main loop).
     class Application
     {
     public:
@@ -14,23 +20,46 @@ namespace SA
         int exec();
         void quit(int exitCode = 0);
 
+        void processEvents(int maxTime = 0);
+        void runFor(int duration);
+        void setClock(SA::Clock *clock);
+
+        SA::EventLoop &mainLoop();
+
+        // Thread-safe, the handler runs on the main loop
+        void post(const std::function<void ()> &handler);
+        void postDelayed(const std::function<void ()> &handler, int delay);
+
         void addMainLoopListener(SA::Object *object);
         void removeMainLoopListener(SA::Object *object);
 
         int addMainLoopListener(const std::function<void ()> &handler);
         void removeMainLoopListener(int id);
 
+        bool addDescriptorListener(int descr, const std::function<void (int events)> &handler,
+                                   int events = SA::DescriptorRead);
+        bool setDescriptorEvents(int descr, int events);
+        void removeDescriptorListener(int descr);
+
         int startTimer(SA::Object *object, int interval);
+        int singleShot(int delay, const std::function<void ()> &handler);
         bool killTimer(int id);
         bool killTimers(SA::Object *object);
 
+        void setStatsEnabled(bool state);
+        bool isStatsEnabled();
+        void dumpStats(std::ostream &output);
+        void setStatsSnapshotHandler(int interval, const std::function<void (SA::LoopStats &)> &handler);
+
+        // Created on first use, the workers are joined when the thread that
+        // created the Application exits. Tasks still queued then do run.
+        SA::ThreadPool &threadPool();
+
     protected:
         Application();
         virtual ~Application();
 
     private:
-        void timesStep();
-
         Application(const Application &in) = delete;
         Application(Application &&in) = delete;
         Application& operator=(const Application &in) = delete;
@@ -43,4 +72,3 @@ namespace SA
     }; // class Application
 
 } // namespace SA
-
@@ -0,0 +1,53 @@
+#include <tuple>
+
+#include "clock.h"
+
+namespace SA
+{
+    Clock::~Clock()
+    {
+    }
+
+    bool Clock::skipTo(const TimePoint &time)
+    {
+        std::ignore = time;
+        return false;
+    }
+
+    Clock &Clock::steady()
+    {
+        static SteadyClock clock;
+        return clock;
+    }
+
+    Clock::TimePoint SteadyClock::now()
+    {
+        return std::chrono::steady_clock::now();
+    }
+
+    VirtualClock::VirtualClock(const TimePoint &start) :
+        ticks(start.time_since_epoch().count())
+    {
+    }
+
+    Clock::TimePoint VirtualClock::now()
+    {
+        return TimePoint(TimePoint::duration(ticks.load(std::memory_order_acquire)));
+    }
+
+    bool VirtualClock::skipTo(const TimePoint &time)
+    {
+        TimePoint::rep target = time.time_since_epoch().count();
+        TimePoint::rep current = ticks.load(std::memory_order_relaxed);
+
+        // Never goes back
+        while (current < target && !ticks.compare_exchange_weak(current, target, std::memory_order_acq_rel));
+        return true;
+    }
+
+    void VirtualClock::advance(const std::chrono::nanoseconds &duration)
+    {
+        if (duration.count() <= 0) return;
+        ticks.fetch_add(std::chrono::duration_cast<TimePoint::duration>(duration).count(), std::memory_order_acq_rel);
+    }
+}
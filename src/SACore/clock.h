@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+namespace SA
+{
+    // Time source of an event loop, now() may be called from any thread
+    class Clock
+    {
+    public:
+        using TimePoint = std::chrono::steady_clock::time_point;
+
+        virtual ~Clock();
+
+        virtual TimePoint now() = 0;
+
+        // Jumps forward to time if the clock is simulated, the loop uses this
+        // instead of sleeping. Real clocks return false.
+        virtual bool skipTo(const TimePoint &time);
+
+        static Clock &steady();
+
+    }; // class Clock
+
+    class SteadyClock : public Clock
+    {
+    public:
+        TimePoint now() override;
+
+    }; // class SteadyClock
+
+    // Manually driven clock for tests and load simulations: timers fire in
+    // virtual time, runFor() and processEvents() skip the idle gaps.
+    class VirtualClock : public Clock
+    {
+    public:
+        explicit VirtualClock(const TimePoint &start = std::chrono::steady_clock::now());
+
+        TimePoint now() override;
+        bool skipTo(const TimePoint &time) override;
+
+        void advance(const std::chrono::nanoseconds &duration);
+
+    private:
+        std::atomic<TimePoint::rep> ticks;
+
+    }; // class VirtualClock
+
+} // namespace SA
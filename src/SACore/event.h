@@ -0,0 +1,24 @@
+#pragma once
+
+#include <variant>
+#include "global.h"
+#include "structs.h"
+
+namespace SA
+{
+    // The alternative follows from the type: bool for hover, focus and paint,
+    // int32_t for wheel, Point for mouse move and move, Size for resize.
+    using EventValue = std::variant<std::monostate, bool, int32_t,
+                                    SA::Point, SA::Size, SA::KeyEvent, SA::MouseEvent>;
+
+    // Passed by reference through the listeners, no allocation or RTTI
+    struct Event
+    {
+        EventTypes type;
+        EventValue value;
+
+        Event(EventTypes type_, const EventValue &value_ = {}) :
+            type(type_), value(value_){}
+    };
+
+} // namespace SA
@@ -0,0 +1,802 @@
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <tuple>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#endif //__linux__
+
+#include "eventloop.h"
+#include "timerqueue.h"
+#include "mpscqueue.h"
+#include "handlerlist.h"
+
+#ifdef SA_IO_URING
+#include "iouring.h"
+
+static const unsigned UringEntries = 256;
+static const uint16_t ReceiveBufferGroup = 0;
+static const unsigned ReceiveBufferCount = 128;
+static const unsigned ReceiveBufferSize = 16 * 1024;
+#endif //SA_IO_URING
+
+static const int MaxEpollEvents = 64;
+static const int MaxPostedPerIteration = 1024;
+static const int PollingInterval = 1;
+
+namespace SA {
+
+    struct DescriptorStruct
+    {
+        int descr;
+        int events;
+        bool removed = false;
+        uint32_t sequence = 0;
+        std::function<void (int)> handler;
+
+        DescriptorStruct(int _descr, int _events, const std::function<void (int)> &_handler):
+            descr(_descr), events(_events), handler(_handler){}
+    };
+
+#ifdef SA_IO_URING
+    struct ReceiverStruct
+    {
+        int descr;
+        bool removed = false;
+        uint32_t sequence = 0;
+        std::function<void (std::span<const char>, int)> handler;
+    };
+
+    // Completions are matched to listeners by descriptor and sequence, so
+    // late ones for a removed or re-armed listener are recognised as stale
+    enum UringKind : uint64_t { UringPoll = 1, UringReceive = 2, UringCancel = 3 };
+
+    static uint64_t uringData(UringKind kind, uint32_t sequence, int descr)
+    {
+        return (static_cast<uint64_t>(kind) << 56) | (static_cast<uint64_t>(sequence & 0xFFFFFF) << 32) |
+               static_cast<uint32_t>(descr);
+    }
+#endif //SA_IO_URING
+
+    struct PostedStruct
+    {
+        std::function<void ()> handler;
+        int delay = 0;
+        SA::Clock::TimePoint time;
+    };
+
+    struct EventLoop::EventLoopPrivate
+    {
+        std::atomic<int> exitCode {0};
+        std::atomic<bool> quitFlag {false};
+        std::atomic<bool> isRunning {false};
+
+        SA::HandlerList<void ()> mainLoopHandlers;
+        std::vector<SA::Object*> mainLoopListeners;
+        size_t polledListeners = 0; // as of the last pass, new ones count until then
+        SA::TimerQueue timers;
+
+        int epollFd = -1;
+        std::unordered_map<int, std::unique_ptr<DescriptorStruct> > descriptors;
+        std::vector<std::unique_ptr<DescriptorStruct> > removedDescriptors;
+
+        int eventFd = -1;
+        std::atomic<bool> wakeupPending {false};
+        SA::MpscQueue<PostedStruct> posted;
+
+        // Never destroyed while the loop lives, callbacks hold its histograms
+        bool statsEnabled = false;
+        SA::LoopStats stats;
+        std::chrono::steady_clock::time_point timeWakeup;
+
+        SA::Clock *clock = &SA::Clock::steady();
+        int snapshotTimerId = -1;
+        int snapshotInterval = 0;
+        std::function<void (SA::LoopStats &)> snapshotHandler;
+
+        void dispatch(DescriptorStruct *descriptor, int events);
+
+#ifdef SA_IO_URING
+        std::unique_ptr<SA::IoUring> uring;
+        uint32_t sequence = 0;
+        std::unordered_map<int, std::unique_ptr<ReceiverStruct> > receivers;
+        std::vector<std::unique_ptr<ReceiverStruct> > removedReceivers;
+
+        void armPoll(DescriptorStruct *descriptor);
+        void armReceive(ReceiverStruct *receiver);
+        void cancel(uint64_t userData);
+        void processCompletion(uint64_t userData, int32_t result, uint32_t flags);
+#endif //SA_IO_URING
+    };
+
+    static uint64_t elapsed(const std::chrono::steady_clock::time_point &timeStart)
+    {
+        auto duration = std::chrono::steady_clock::now() - timeStart;
+        return static_cast<uint64_t>(std::chrono::nanoseconds(duration).count());
+    }
+
+#ifdef __linux__
+    static uint32_t toEpollEvents(int events)
+    {
+        uint32_t result = 0;
+        if (events & DescriptorRead) result |= EPOLLIN | EPOLLRDHUP;
+        if (events & DescriptorWrite) result |= EPOLLOUT;
+        if (events & DescriptorEdge) result |= EPOLLET;
+        return result;
+    }
+
+    static int fromEpollEvents(uint32_t events)
+    {
+        int result = 0;
+        if (events & (EPOLLIN | EPOLLPRI)) result |= DescriptorRead;
+        if (events & EPOLLOUT) result |= DescriptorWrite;
+        if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) result |= DescriptorError;
+        return result;
+    }
+#endif //__linux__
+
+    void EventLoop::EventLoopPrivate::dispatch(DescriptorStruct *descriptor, int events)
+    {
+        if (statsEnabled)
+        {
+            SA::Histogram &histogram = stats.descriptor(descriptor->descr);
+            auto timeHandler = std::chrono::steady_clock::now();
+            descriptor->handler(events);
+            histogram.record(elapsed(timeHandler));
+        }
+        else
+        {
+            descriptor->handler(events);
+        }
+    }
+
+#ifdef SA_IO_URING
+    void EventLoop::EventLoopPrivate::armPoll(DescriptorStruct *descriptor)
+    {
+        io_uring_sqe *sqe = uring->nextSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = descriptor->descr;
+        sqe->poll32_events = toEpollEvents(descriptor->events);
+        sqe->user_data = uringData(UringPoll, descriptor->sequence, descriptor->descr);
+
+        // Edge-triggered polls stay armed, level-triggered ones are one-shot
+        // and re-armed after each call, which reports a state that persists
+        if (descriptor->events & DescriptorEdge)
+            sqe->len = IORING_POLL_ADD_MULTI;
+    }
+
+    void EventLoop::EventLoopPrivate::armReceive(ReceiverStruct *receiver)
+    {
+        io_uring_sqe *sqe = uring->nextSqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = receiver->descr;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = ReceiveBufferGroup;
+        sqe->user_data = uringData(UringReceive, receiver->sequence, receiver->descr);
+    }
+
+    void EventLoop::EventLoopPrivate::cancel(uint64_t userData)
+    {
+        io_uring_sqe *sqe = uring->nextSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = userData;
+        sqe->user_data = uringData(UringCancel, 0, -1);
+    }
+
+    void EventLoop::EventLoopPrivate::processCompletion(uint64_t userData, int32_t result, uint32_t flags)
+    {
+        UringKind kind = static_cast<UringKind>(userData >> 56);
+        uint32_t dataSequence = static_cast<uint32_t>(userData >> 32) & 0xFFFFFF;
+        int descr = static_cast<int>(static_cast<uint32_t>(userData));
+        bool isArmed = (flags & IORING_CQE_F_MORE) != 0;
+
+        if (kind == UringPoll)
+        {
+            auto it = descriptors.find(descr);
+            if (it == descriptors.end() || (it->second->sequence & 0xFFFFFF) != dataSequence) return;
+
+            DescriptorStruct *descriptor = it->second.get();
+            if (result == -ECANCELED) return;
+
+            dispatch(descriptor, result < 0 ? DescriptorError : fromEpollEvents(static_cast<uint32_t>(result)));
+
+            // Removed or re-armed by the handler, or failed for good
+            if (descriptor->removed || (descriptor->sequence & 0xFFFFFF) != dataSequence || result < 0) return;
+            if (!isArmed) armPoll(descriptor);
+        }
+        else if (kind == UringReceive)
+        {
+            bool hasBuffer = (flags & IORING_CQE_F_BUFFER) != 0;
+            uint16_t bufferId = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+
+            auto it = receivers.find(descr);
+            ReceiverStruct *receiver = nullptr;
+            if (it != receivers.end() && (it->second->sequence & 0xFFFFFF) == dataSequence)
+                receiver = it->second.get();
+
+            // ENOBUFS only means the buffers ran out, it is re-armed below
+            if (receiver && result != -ENOBUFS && result != -ECANCELED)
+            {
+                std::span<const char> data;
+                if (result > 0 && hasBuffer) data = std::span<const char>(uring->buffer(bufferId), static_cast<size_t>(result));
+
+                if (statsEnabled)
+                {
+                    SA::Histogram &histogram = stats.descriptor(descr);
+                    auto timeHandler = std::chrono::steady_clock::now();
+                    receiver->handler(data, result);
+                    histogram.record(elapsed(timeHandler));
+                }
+                else
+                {
+                    receiver->handler(data, result);
+                }
+            }
+
+            if (hasBuffer) uring->recycleBuffer(bufferId);
+
+            if (!receiver || receiver->removed || (receiver->sequence & 0xFFFFFF) != dataSequence) return;
+            if (!isArmed && (result > 0 || result == -ENOBUFS)) armReceive(receiver);
+        }
+    }
+#endif //SA_IO_URING
+
+    static thread_local EventLoop *CURRENT_LOOP = nullptr;
+    static thread_local std::unique_ptr<EventLoop> THREAD_LOOP;
+
+    EventLoop *EventLoop::current()
+    {
+        if (!CURRENT_LOOP)
+            THREAD_LOOP = std::make_unique<EventLoop>();
+
+        return CURRENT_LOOP;
+    }
+
+    int EventLoop::exec()
+    {
+        if (d->isRunning) return 0;
+        d->isRunning = true;
+        d->timeWakeup = std::chrono::steady_clock::now();
+
+        while(1)
+        {
+            processIteration();
+
+            // Taken when it stops the loop, so it can run again later
+            if (d->quitFlag.exchange(false)) break;
+
+            int timeout = nextTimeout();
+            if (skipIdleTime(timeout, -1)) timeout = 0;
+            waitEvents(timeout);
+        }
+
+        d->isRunning = false;
+        return d->exitCode;
+    }
+
+    void EventLoop::processEvents(int maxTime)
+    {
+        if (maxTime < 0) maxTime = 0;
+
+        int timeout = nextTimeout();
+        if (timeout < 0 || timeout > maxTime) timeout = maxTime;
+        if (skipIdleTime(timeout, maxTime)) timeout = 0;
+
+        waitEvents(timeout);
+        processIteration();
+    }
+
+    void EventLoop::runFor(int duration)
+    {
+        Clock::TimePoint timeEnd = d->clock->now() + std::chrono::milliseconds(duration);
+
+        while (!d->quitFlag.exchange(false))
+        {
+            auto now = d->clock->now();
+            if (now >= timeEnd) break;
+
+            auto remaining = std::chrono::ceil<std::chrono::milliseconds>(timeEnd - now);
+            processEvents(static_cast<int>(remaining.count()));
+        }
+    }
+
+    void EventLoop::setClock(Clock *clock)
+    {
+        d->clock = clock ? clock : &Clock::steady();
+    }
+
+    Clock &EventLoop::clock()
+    {
+        return *d->clock;
+    }
+
+    void EventLoop::quit(int exitCode)
+    {
+        d->exitCode = exitCode;
+        d->quitFlag = true;
+        d->isRunning = false;
+        wakeup();
+    }
+
+    void EventLoop::post(const std::function<void ()> &handler)
+    {
+        postDelayed(handler, 0);
+    }
+
+    void EventLoop::postDelayed(const std::function<void ()> &handler, int delay)
+    {
+        if (!handler) return;
+
+        PostedStruct posted;
+        posted.handler = handler;
+        posted.delay = delay;
+        if (delay > 0) posted.time = d->clock->now();
+
+        d->posted.push(std::move(posted));
+        wakeup();
+    }
+
+    void EventLoop::addMainLoopListener(Object *object)
+    {
+        d->mainLoopListeners.push_back(object);
+        ++d->polledListeners;
+    }
+
+    void EventLoop::removeMainLoopListener(Object *object)
+    {
+        auto it = find(d->mainLoopListeners.begin(), d->mainLoopListeners.end(), object);
+        if (it != d->mainLoopListeners.end())
+            d->mainLoopListeners.erase(it);
+
+        d->stats.removeListener(object);
+    }
+
+    int EventLoop::addMainLoopListener(const std::function<void ()> &handler)
+    {
+        return d->mainLoopHandlers.add(handler);
+    }
+
+    void EventLoop::removeMainLoopListener(int id)
+    {
+        d->mainLoopHandlers.remove(id);
+        d->stats.removeHandler(id);
+    }
+
+    bool EventLoop::addDescriptorListener(int descr, const std::function<void (int)> &handler, int events)
+    {
+        if (descr < 0 || !handler) return false;
+        if (d->descriptors.find(descr) != d->descriptors.end()) return false;
+
+#ifdef __linux__
+        auto descriptor = std::make_unique<DescriptorStruct>(descr, events, handler);
+
+#ifdef SA_IO_URING
+        if (d->uring)
+        {
+            descriptor->sequence = ++d->sequence;
+            d->armPoll(descriptor.get());
+            d->descriptors.insert({descr, std::move(descriptor)});
+            return true;
+        }
+#endif //SA_IO_URING
+
+        epoll_event event = {};
+        event.events = toEpollEvents(events);
+        event.data.ptr = descriptor.get();
+
+        if (epoll_ctl(d->epollFd, EPOLL_CTL_ADD, descr, &event) < 0)
+            return false;
+
+        d->descriptors.insert({descr, std::move(descriptor)});
+        return true;
+#else
+        return false;
+#endif //__linux__
+    }
+
+    bool EventLoop::setDescriptorEvents(int descr, int events)
+    {
+        auto it = d->descriptors.find(descr);
+        if (it == d->descriptors.end()) return false;
+        if (it->second->events == events) return true;
+
+#ifdef SA_IO_URING
+        if (d->uring)
+        {
+            DescriptorStruct *descriptor = it->second.get();
+            d->cancel(uringData(UringPoll, descriptor->sequence, descr));
+            descriptor->sequence = ++d->sequence;
+            descriptor->events = events;
+            d->armPoll(descriptor);
+            return true;
+        }
+#endif //SA_IO_URING
+
+#ifdef __linux__
+        epoll_event event = {};
+        event.events = toEpollEvents(events);
+        event.data.ptr = it->second.get();
+
+        if (epoll_ctl(d->epollFd, EPOLL_CTL_MOD, descr, &event) < 0)
+            return false;
+#endif //__linux__
+
+        it->second->events = events;
+        return true;
+    }
+
+    void EventLoop::removeDescriptorListener(int descr)
+    {
+        auto it = d->descriptors.find(descr);
+        if (it == d->descriptors.end()) return;
+
+#ifdef SA_IO_URING
+        // The poll holds the file open, so it has to go even after close()
+        if (d->uring)
+            d->cancel(uringData(UringPoll, it->second->sequence, descr));
+#endif //SA_IO_URING
+
+#ifdef __linux__
+        if (d->epollFd > -1)
+            epoll_ctl(d->epollFd, EPOLL_CTL_DEL, descr, nullptr);
+#endif //__linux__
+
+        // The handler may be running right now, so release it after dispatch
+        it->second->removed = true;
+        d->removedDescriptors.push_back(std::move(it->second));
+        d->descriptors.erase(it);
+        d->stats.removeDescriptor(descr);
+    }
+
+    const char *EventLoop::backend()
+    {
+#ifdef SA_IO_URING
+        if (d->uring) return "io_uring";
+#endif //SA_IO_URING
+
+#ifdef __linux__
+        return "epoll";
+#else
+        return "sleep";
+#endif //__linux__
+    }
+
+    bool EventLoop::addReceiveListener(int descr, const std::function<void (std::span<const char>, int)> &handler)
+    {
+#ifdef SA_IO_URING
+        if (!d->uring || descr < 0 || !handler) return false;
+        if (d->receivers.find(descr) != d->receivers.end()) return false;
+
+        // Allocated on first use, loops without sockets don't pay for them
+        if (!d->uring->hasBuffers() &&
+            !d->uring->setupBuffers(ReceiveBufferGroup, ReceiveBufferCount, ReceiveBufferSize))
+            return false;
+
+        auto receiver = std::make_unique<ReceiverStruct>();
+        receiver->descr = descr;
+        receiver->sequence = ++d->sequence;
+        receiver->handler = handler;
+
+        d->armReceive(receiver.get());
+        d->receivers.insert({descr, std::move(receiver)});
+        return true;
+#else
+        (void)descr; (void)handler;
+        return false;
+#endif //SA_IO_URING
+    }
+
+    void EventLoop::removeReceiveListener(int descr)
+    {
+#ifdef SA_IO_URING
+        auto it = d->receivers.find(descr);
+        if (it == d->receivers.end()) return;
+
+        d->cancel(uringData(UringReceive, it->second->sequence, descr));
+
+        it->second->removed = true;
+        d->removedReceivers.push_back(std::move(it->second));
+        d->receivers.erase(it);
+        d->stats.removeDescriptor(descr);
+#else
+        (void)descr;
+#endif //SA_IO_URING
+    }
+
+    int EventLoop::startTimer(Object *object, int interval)
+    {
+        return d->timers.start(object, interval, d->clock->now());
+    }
+
+    int EventLoop::singleShot(int delay, const std::function<void ()> &handler)
+    {
+        return d->timers.startSingleShot(handler, delay, d->clock->now());
+    }
+
+    bool EventLoop::killTimer(int id)
+    {
+        return d->timers.kill(id);
+    }
+
+    bool EventLoop::killTimers(Object *object)
+    {
+        d->stats.removeTimer(object);
+        return d->timers.kill(object);
+    }
+
+    void EventLoop::setStatsEnabled(bool state)
+    {
+        if (state && !d->statsEnabled)
+            d->timeWakeup = std::chrono::steady_clock::now();
+
+        d->statsEnabled = state;
+        d->timers.setStats(state ? &d->stats : nullptr);
+    }
+
+    bool EventLoop::isStatsEnabled()
+    {
+        return d->statsEnabled;
+    }
+
+    LoopStats &EventLoop::stats()
+    {
+        return d->stats;
+    }
+
+    void EventLoop::dumpStats(std::ostream &output)
+    {
+        d->stats.dump(output);
+    }
+
+    void EventLoop::setStatsSnapshotHandler(int interval, const std::function<void (LoopStats &)> &handler)
+    {
+        if (d->snapshotTimerId > -1)
+            d->timers.kill(d->snapshotTimerId);
+
+        d->snapshotTimerId = -1;
+        d->snapshotInterval = interval;
+        d->snapshotHandler = handler;
+
+        if (interval > 0 && handler)
+            scheduleSnapshot();
+    }
+
+    void EventLoop::scheduleSnapshot()
+    {
+        d->snapshotTimerId = singleShot(d->snapshotInterval, [this]() {
+            d->snapshotTimerId = -1;
+
+            // Copy, the handler may replace itself
+            std::function<void (LoopStats &)> handler = d->snapshotHandler;
+            handler(d->stats);
+
+            if (d->snapshotTimerId < 0 && d->snapshotHandler)
+                scheduleSnapshot();
+        });
+    }
+
+    EventLoop::EventLoop(): d(new EventLoopPrivate)
+    {
+        if (!CURRENT_LOOP)
+            CURRENT_LOOP = this;
+
+#ifdef SA_IO_URING
+        const char *backend = std::getenv("SA_EVENTLOOP_BACKEND");
+        if (!backend || std::strcmp(backend, "epoll") != 0)
+        {
+            auto uring = std::make_unique<SA::IoUring>();
+            if (uring->init(UringEntries))
+                d->uring = std::move(uring);
+        }
+#endif //SA_IO_URING
+
+#ifdef __linux__
+#ifdef SA_IO_URING
+        if (!d->uring)
+#endif //SA_IO_URING
+            d->epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+        d->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        addDescriptorListener(d->eventFd, [this](int) {
+            uint64_t value;
+            while (::read(d->eventFd, &value, sizeof(value)) > 0);
+        });
+#endif //__linux__
+    }
+
+    EventLoop::~EventLoop()
+    {
+        if (CURRENT_LOOP == this)
+            CURRENT_LOOP = nullptr;
+
+#ifdef SA_IO_URING
+        d->uring.reset();
+#endif //SA_IO_URING
+
+#ifdef __linux__
+        if (d->eventFd > -1)
+            ::close(d->eventFd);
+
+        if (d->epollFd > -1)
+            ::close(d->epollFd);
+#endif //__linux__
+
+        delete d;
+    }
+
+    void EventLoop::processIteration()
+    {
+        bool statsEnabled = d->statsEnabled;
+
+        processPosted();
+        timesStep();
+
+        size_t polledListeners = 0;
+
+        if (statsEnabled)
+        {
+            for(SA::Object *object: d->mainLoopListeners)
+            {
+                SA::Histogram &histogram = d->stats.listener(object);
+                auto timeListener = std::chrono::steady_clock::now();
+                object->mainLoopEvent();
+                histogram.record(elapsed(timeListener));
+                polledListeners += object->isMainLoopPolled();
+            }
+
+            d->mainLoopHandlers.forEach([this](int id, const std::function<void ()> &handler) {
+                SA::Histogram &histogram = d->stats.handler(id);
+                auto timeHandler = std::chrono::steady_clock::now();
+                handler();
+                histogram.record(elapsed(timeHandler));
+            });
+        }
+        else
+        {
+            for(SA::Object *object: d->mainLoopListeners)
+            {
+                object->mainLoopEvent();
+                polledListeners += object->isMainLoopPolled();
+            }
+
+            d->mainLoopHandlers();
+        }
+
+        d->polledListeners = polledListeners;
+    }
+
+    void EventLoop::timesStep()
+    {
+        if (d->timers.isEmpty()) return;
+        d->timers.process(d->clock->now());
+    }
+
+    bool EventLoop::skipIdleTime(int timeout, int maxTime)
+    {
+        // Only a simulated clock can move, and only when nothing is waiting
+        if (timeout == 0 || !d->posted.isEmpty()) return false;
+
+        Clock::TimePoint timeEnd = d->timers.nextDeadline();
+        if (maxTime >= 0)
+            timeEnd = std::min(timeEnd, d->clock->now() + std::chrono::milliseconds(maxTime));
+
+        if (timeEnd == Clock::TimePoint::max()) return false;
+        return d->clock->skipTo(timeEnd);
+    }
+
+    void EventLoop::wakeup()
+    {
+        // Only the first producer since the last drain pays for the syscall
+        if (d->wakeupPending.exchange(true, std::memory_order_acq_rel)) return;
+
+#ifdef __linux__
+        if (d->eventFd > -1)
+        {
+            uint64_t value = 1;
+            std::ignore = ::write(d->eventFd, &value, sizeof(value));
+        }
+#endif //__linux__
+    }
+
+    void EventLoop::processPosted()
+    {
+        d->wakeupPending.exchange(false, std::memory_order_acq_rel);
+
+        PostedStruct posted;
+        for (int i=0; i<MaxPostedPerIteration && d->posted.pop(posted); ++i)
+        {
+            if (posted.delay > 0)
+                d->timers.startSingleShot(posted.handler, posted.delay, posted.time);
+            else
+                posted.handler();
+        }
+    }
+
+    int EventLoop::nextTimeout()
+    {
+        if (!d->posted.isEmpty())
+            return 0;
+
+        // Plain main loop handlers and overridden Object::mainLoopEvent()
+        // are polled, so keep the old cadence for them
+        if (!d->mainLoopHandlers.isEmpty() || d->polledListeners > 0)
+            return PollingInterval;
+
+        auto timeEnd = d->timers.nextDeadline();
+        if (timeEnd == SA::TimerQueue::TimePoint::max())
+            return -1;
+
+        auto &&now = d->clock->now();
+        if (timeEnd <= now)
+            return 0;
+
+        auto timeout = std::chrono::ceil<std::chrono::milliseconds>(timeEnd - now);
+        return static_cast<int>(timeout.count());
+    }
+
+    void EventLoop::waitEvents(int timeout)
+    {
+        if (d->statsEnabled)
+            d->stats.loopLag().record(elapsed(d->timeWakeup));
+
+        d->stats.releaseRemoved();
+
+#ifdef __linux__
+#ifdef SA_IO_URING
+        if (d->uring)
+        {
+            // One syscall submits the queued polls and cancels and waits
+            d->uring->submit(timeout);
+            if (d->statsEnabled) d->timeWakeup = std::chrono::steady_clock::now();
+
+            d->uring->forEachCompletion([this](uint64_t userData, int32_t result, uint32_t flags) {
+                d->processCompletion(userData, result, flags);
+            });
+
+            d->removedDescriptors.clear();
+            d->removedReceivers.clear();
+            return;
+        }
+#endif //SA_IO_URING
+
+        if (d->epollFd < 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(PollingInterval));
+            if (d->statsEnabled) d->timeWakeup = std::chrono::steady_clock::now();
+            return;
+        }
+
+        epoll_event events[MaxEpollEvents];
+        int count = epoll_wait(d->epollFd, events, MaxEpollEvents, timeout);
+        if (d->statsEnabled) d->timeWakeup = std::chrono::steady_clock::now();
+
+        for (int i=0; i<count; ++i)
+        {
+            DescriptorStruct *descriptor = static_cast<DescriptorStruct*>(events[i].data.ptr);
+            if (descriptor->removed) continue;
+
+            d->dispatch(descriptor, fromEpollEvents(events[i].events));
+        }
+
+        d->removedDescriptors.clear();
+#else
+        if (timeout != 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(PollingInterval));
+        if (d->statsEnabled) d->timeWakeup = std::chrono::steady_clock::now();
+#endif //__linux__
+    }
+}
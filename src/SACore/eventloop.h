@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iosfwd>
+#include <span>
+#include "object.h"
+#include "loopstats.h"
+#include "clock.h"
+
+namespace SA
+{
+    // One loop per thread. Objects, sockets and timers belong to the loop
+    // of the thread that created them, and are only touched from it.
+    class EventLoop
+    {
+    public:
+        EventLoop();
+        virtual ~EventLoop();
+
+        // The first loop created in the calling thread, created on demand
+        static EventLoop *current();
+
+        // quit() ends exec() or runFor(), whichever runs next if none does.
+        // The loop can be run again after that.
+        int exec();
+        void quit(int exitCode = 0);
+
+        // Run the loop without blocking forever: processEvents() waits at most
+        // maxTime ms for events, runFor() keeps going until the clock has
+        // moved by duration ms. With a VirtualClock both skip idle time.
+        void processEvents(int maxTime = 0);
+        void runFor(int duration);
+
+        // Not owned, nullptr restores the steady clock. Set it before
+        // starting timers, running deadlines are not converted.
+        void setClock(SA::Clock *clock);
+        SA::Clock &clock();
+
+        // Thread-safe, the handler runs on this loop
+        void post(const std::function<void ()> &handler);
+        void postDelayed(const std::function<void ()> &handler, int delay);
+
+        void addMainLoopListener(SA::Object *object);
+        void removeMainLoopListener(SA::Object *object);
+
+        int addMainLoopListener(const std::function<void ()> &handler);
+        void removeMainLoopListener(int id);
+
+        // With SA::DescriptorEdge the handler is only called when the state
+        // changes, so it has to read or write until EAGAIN
+        bool addDescriptorListener(int descr, const std::function<void (int events)> &handler,
+                                   int events = SA::DescriptorRead);
+        bool setDescriptorEvents(int descr, int events);
+        void removeDescriptorListener(int descr);
+
+        // "io_uring" when built with SA_IO_URING and the kernel has it
+        // (SA_EVENTLOOP_BACKEND=epoll turns it off), "epoll" otherwise,
+        // "sleep" where the loop only polls timers and posted calls
+        const char *backend();
+
+        // io_uring only, false otherwise: the kernel reads into buffers of
+        // the loop without a syscall per read. The handler gets the bytes,
+        // or an empty view with 0 at end of stream or -errno on failure.
+        // The view is only valid during the call. Everything else, accept
+        // and send included, goes through descriptor listeners.
+        bool addReceiveListener(int descr, const std::function<void (std::span<const char> data, int result)> &handler);
+        void removeReceiveListener(int descr);
+
+        int startTimer(SA::Object *object, int interval);
+        int singleShot(int delay, const std::function<void ()> &handler);
+        bool killTimer(int id);
+        bool killTimers(SA::Object *object);
+
+        // Instrumentation is off by default and costs a branch per callback then
+        void setStatsEnabled(bool state);
+        bool isStatsEnabled();
+        SA::LoopStats &stats();
+        void dumpStats(std::ostream &output);
+
+        // Calls the handler with the stats every interval ms, nullptr stops it
+        void setStatsSnapshotHandler(int interval, const std::function<void (SA::LoopStats &)> &handler);
+
+    private:
+        void processIteration();
+        void timesStep();
+        bool skipIdleTime(int timeout, int maxTime);
+        void processPosted();
+        void wakeup();
+        int nextTimeout();
+        void waitEvents(int timeout);
+        void scheduleSnapshot();
+
+        EventLoop(const EventLoop &in) = delete;
+        EventLoop(EventLoop &&in) = delete;
+        EventLoop& operator=(const EventLoop &in) = delete;
+
+        struct EventLoopPrivate;
+        EventLoopPrivate * const d;
+
+    }; // class EventLoop
+
+} // namespace SA
@@ -19,6 +19,14 @@ namespace SA
         ResizeEvent
     };
 
+    enum DescriptorEvents
+    {
+        DescriptorRead = 0x01,
+        DescriptorWrite = 0x02,
+        DescriptorError = 0x04,
+        DescriptorEdge = 0x08
+    };
+
     enum MouseButton
     {
         ButtonLeft,
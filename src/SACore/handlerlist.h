@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace SA
+{
+    template<typename Signature>
+    class HandlerList;
+
+    // Callback registry with generational ids: (generation << 20) | index.
+    // Slots are contiguous and reused through a free list, so add and remove
+    // are O(1) and a stale id never removes a newer handler.
+    // Handlers may add or remove handlers while being called: removed ones
+    // are skipped at once, added ones are called from the next dispatch.
+    // Header-only, so SANetwork can use it without linking SACore.
+    template<typename Result, typename... Args>
+    class HandlerList<Result (Args...)>
+    {
+    public:
+        using Handler = std::function<Result (Args...)>;
+
+        HandlerList() = default;
+        HandlerList(const HandlerList &) = delete;
+        HandlerList& operator=(const HandlerList &) = delete;
+
+        int add(const Handler &handler)
+        {
+            if (!handler) return -1;
+
+            uint32_t index;
+            Slot *slot;
+
+            if (dispatchDepth == 0 && !freeIndexes.empty())
+            {
+                index = freeIndexes.back();
+                freeIndexes.pop_back();
+                slot = &slots[index];
+                slot->generation = nextGeneration(slot->generation);
+            }
+            else
+            {
+                // Growing slots while dispatching would move running handlers
+                index = static_cast<uint32_t>(slots.size() + pending.size());
+                if (index > IndexMask) return -1;
+
+                std::vector<Slot> &target = dispatchDepth == 0 ? slots : pending;
+                target.emplace_back();
+                slot = &target.back();
+                slot->generation = 1;
+            }
+
+            slot->handler = handler;
+            slot->active = true;
+            ++count;
+
+            return static_cast<int>((slot->generation << IndexBits) | index);
+        }
+
+        bool remove(int id)
+        {
+            Slot *slot = find(id);
+            if (!slot) return false;
+
+            uint32_t index = static_cast<uint32_t>(id) & IndexMask;
+            slot->active = false;
+            --count;
+
+            if (dispatchDepth > 0)
+            {
+                // The handler may be the one running right now
+                removedIndexes.push_back(index);
+            }
+            else
+            {
+                slot->handler = nullptr;
+                freeIndexes.push_back(index);
+            }
+
+            return true;
+        }
+
+        bool contains(int id) const
+        {
+            return const_cast<HandlerList*>(this)->find(id) != nullptr;
+        }
+
+        void clear()
+        {
+            for (size_t i=0; i<slots.size() + pending.size(); ++i)
+            {
+                Slot &slot = i < slots.size() ? slots[i] : pending[i - slots.size()];
+                if (slot.active) remove(static_cast<int>((slot.generation << IndexBits) | i));
+            }
+        }
+
+        bool isEmpty() const
+        {
+            return count == 0;
+        }
+
+        size_t size() const
+        {
+            return count;
+        }
+
+        // Calls every handler, return values are dropped
+        void operator()(Args... args)
+        {
+            forEach([&](int, const Handler &handler) { handler(args...); });
+        }
+
+        // Calls func(id, handler) for every handler
+        template<typename Func>
+        void forEach(Func &&func)
+        {
+            DispatchGuard guard(this);
+
+            size_t size = slots.size();
+            for (size_t i=0; i<size; ++i)
+            {
+                const Slot &slot = slots[i];
+                if (slot.active)
+                    func(static_cast<int>((slot.generation << IndexBits) | i), slot.handler);
+            }
+        }
+
+    private:
+        static const uint32_t IndexBits = 20;
+        static const uint32_t IndexMask = (1u << IndexBits) - 1;
+        static const uint32_t GenerationMask = (1u << (31 - IndexBits)) - 1;
+
+        struct Slot
+        {
+            Handler handler;
+            uint32_t generation = 0;
+            bool active = false;
+        };
+
+        struct DispatchGuard
+        {
+            HandlerList *list;
+            explicit DispatchGuard(HandlerList *list_) : list(list_) { ++list->dispatchDepth; }
+            ~DispatchGuard() { if (--list->dispatchDepth == 0) list->flush(); }
+        };
+
+        static uint32_t nextGeneration(uint32_t generation)
+        {
+            generation = (generation + 1) & GenerationMask;
+            return generation ? generation : 1;
+        }
+
+        Slot *find(int id)
+        {
+            if (id < 0) return nullptr;
+
+            uint32_t index = static_cast<uint32_t>(id) & IndexMask;
+            uint32_t generation = static_cast<uint32_t>(id) >> IndexBits;
+
+            Slot *slot = nullptr;
+            if (index < slots.size()) slot = &slots[index];
+            else if (index - slots.size() < pending.size()) slot = &pending[index - slots.size()];
+
+            if (!slot || !slot->active || slot->generation != generation) return nullptr;
+            return slot;
+        }
+
+        void flush()
+        {
+            for (Slot &slot : pending)
+                slots.push_back(std::move(slot));
+            pending.clear();
+
+            for (uint32_t index : removedIndexes)
+            {
+                slots[index].handler = nullptr;
+                freeIndexes.push_back(index);
+            }
+            removedIndexes.clear();
+        }
+
+        std::vector<Slot> slots;
+        std::vector<Slot> pending;
+        std::vector<uint32_t> freeIndexes;
+        std::vector<uint32_t> removedIndexes;
+        size_t count = 0;
+        int dispatchDepth = 0;
+
+    }; // class HandlerList
+
+} // namespace SA
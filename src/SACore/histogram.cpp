@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+#include "histogram.h"
+
+namespace SA
+{
+    Histogram::Histogram()
+    {
+        reset();
+    }
+
+    void Histogram::record(uint64_t value)
+    {
+        buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t current = minValue.load(std::memory_order_relaxed);
+        while (value < current && !minValue.compare_exchange_weak(current, value, std::memory_order_relaxed));
+
+        current = maxValue.load(std::memory_order_relaxed);
+        while (value > current && !maxValue.compare_exchange_weak(current, value, std::memory_order_relaxed));
+    }
+
+    void Histogram::reset()
+    {
+        for (auto &bucket : buckets)
+            bucket.store(0, std::memory_order_relaxed);
+
+        total.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        minValue.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+        maxValue.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t Histogram::count() const
+    {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Histogram::min() const
+    {
+        return count() ? minValue.load(std::memory_order_relaxed) : 0;
+    }
+
+    uint64_t Histogram::max() const
+    {
+        return maxValue.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Histogram::mean() const
+    {
+        uint64_t n = count();
+        return n ? sum.load(std::memory_order_relaxed) / n : 0;
+    }
+
+    uint64_t Histogram::percentile(double percent) const
+    {
+        uint64_t n = count();
+        if (n == 0) return 0;
+
+        uint64_t rank = static_cast<uint64_t>(percent / 100.0 * n + 0.5);
+        if (rank < 1) rank = 1;
+
+        uint64_t seen = 0;
+        for (int i=0; i<BucketCount; ++i)
+        {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+                return std::min(bucketValue(i), max());
+        }
+
+        return max();
+    }
+
+    int Histogram::bucketIndex(uint64_t value)
+    {
+        const uint64_t linear = 1ull << (SubBucketBits + 1);
+        if (value < linear) return static_cast<int>(value);
+
+        int exponent = std::bit_width(value) - 1;
+        if (exponent > MaxExponent) return BucketCount - 1;
+
+        int shift = exponent - SubBucketBits;
+        int sub = static_cast<int>((value >> shift) & ((1 << SubBucketBits) - 1));
+        return ((shift + 1) << SubBucketBits) + sub;
+    }
+
+    uint64_t Histogram::bucketValue(int index)
+    {
+        // Upper bound of the bucket
+        const int linear = 1 << (SubBucketBits + 1);
+        if (index < linear) return static_cast<uint64_t>(index);
+
+        int shift = (index >> SubBucketBits) - 1;
+        uint64_t sub = static_cast<uint64_t>(index & ((1 << SubBucketBits) - 1));
+        return (((1ull << SubBucketBits) + sub + 1) << shift) - 1;
+    }
+}
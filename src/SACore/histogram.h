@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace SA
+{
+    // Log-linear (HDR-style) histogram: exact below 8, then four sub-buckets
+    // per power of two, so every bucket is within ~25% of the true value.
+    // Counters are relaxed atomics, so any thread may record or read.
+    class Histogram
+    {
+    public:
+        Histogram();
+
+        void record(uint64_t value);
+        void reset();
+
+        uint64_t count() const;
+        uint64_t min() const;
+        uint64_t max() const;
+        uint64_t mean() const;
+        uint64_t percentile(double percent) const;
+
+    private:
+        static const int SubBucketBits = 2;
+        static const int MaxExponent = 40;
+        static const int BucketCount = (MaxExponent - SubBucketBits + 1) << SubBucketBits;
+
+        static int bucketIndex(uint64_t value);
+        static uint64_t bucketValue(int index);
+
+        Histogram(const Histogram &) = delete;
+        Histogram& operator=(const Histogram &) = delete;
+
+        std::atomic<uint64_t> buckets[BucketCount];
+        std::atomic<uint64_t> total;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> minValue;
+        std::atomic<uint64_t> maxValue;
+
+    }; // class Histogram
+
+} // namespace SA
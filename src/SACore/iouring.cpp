@@ -0,0 +1,183 @@
+#ifdef __linux__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "iouring.h"
+
+namespace SA
+{
+    IoUring::IoUring()
+    {
+    }
+
+    IoUring::~IoUring()
+    {
+        // Closing the ring cancels whatever is still in flight
+        if (ringFd > -1)
+            ::close(ringFd);
+
+        if (sqes)
+            ::munmap(sqes, sqesSize);
+
+        if (cqRing && cqRing != sqRing)
+            ::munmap(cqRing, cqRingSize);
+
+        if (sqRing)
+            ::munmap(sqRing, sqRingSize);
+    }
+
+    bool IoUring::init(unsigned entries)
+    {
+        io_uring_params params = {};
+        params.flags = IORING_SETUP_CLAMP;
+
+        ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (ringFd < 0) return false;
+
+        // Timed waits, no dropped completions
+        unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+        if ((params.features & required) != required) return false;
+
+        // Multishot recv came in 6.0 together with SEND_ZC, which the probe can see
+        const unsigned ProbeOps = 256;
+        std::unique_ptr<char[]> probeData(new char[sizeof(io_uring_probe) + ProbeOps * sizeof(io_uring_probe_op)]());
+        io_uring_probe *probe = reinterpret_cast<io_uring_probe*>(probeData.get());
+
+        if (::syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, ProbeOps) < 0 ||
+            probe->last_op < IORING_OP_SEND_ZC ||
+            !(probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED))
+            return false;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+        sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED)
+        {
+            sqRing = nullptr;
+            return false;
+        }
+        cqRing = sqRing;
+
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqesMemory = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqesMemory == MAP_FAILED) return false;
+        sqes = static_cast<io_uring_sqe*>(sqesMemory);
+
+        char *sq = static_cast<char*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqEntries = params.sq_entries;
+        sqeTail = *sqTail;
+
+        char *cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        return true;
+    }
+
+    io_uring_sqe *IoUring::nextSqe()
+    {
+        if (sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+            submit(0);
+
+        unsigned index = sqeTail & sqMask;
+        io_uring_sqe *sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        ++sqeTail;
+
+        return sqe;
+    }
+
+    void IoUring::submit(int timeout)
+    {
+        unsigned toSubmit = sqeTail - *sqTail;
+        if (toSubmit == 0 && timeout == 0) return;
+
+        __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+
+        if (timeout == 0)
+        {
+            enter(toSubmit, 0, 0, nullptr, 0);
+            return;
+        }
+
+        __kernel_timespec time = {};
+        io_uring_getevents_arg arg = {};
+
+        if (timeout > 0)
+        {
+            time.tv_sec = timeout / 1000;
+            time.tv_nsec = static_cast<long long>(timeout % 1000) * 1000000;
+            arg.ts = reinterpret_cast<uint64_t>(&time);
+        }
+
+        // Nothing to wait for when completions are already there
+        unsigned minComplete = (*cqHead == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) ? 1 : 0;
+        enter(toSubmit, minComplete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+
+    int IoUring::enter(unsigned toSubmit, unsigned minComplete, unsigned flags, void *arg, size_t argSize)
+    {
+        // ETIME and EINTR only end the wait, the caller reaps either way
+        return static_cast<int>(::syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, arg, argSize));
+    }
+
+    bool IoUring::setupBuffers(uint16_t group, unsigned count, unsigned size)
+    {
+        if (!bufferData.empty() || count == 0 || count > 65536) return false;
+
+        bufferData.assign(static_cast<size_t>(count) * size, 0);
+        bufferGroup = group;
+        bufferSize = size;
+
+        io_uring_sqe *sqe = nextSqe();
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = static_cast<int>(count);
+        sqe->addr = reinterpret_cast<uint64_t>(bufferData.data());
+        sqe->len = size;
+        sqe->buf_group = group;
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+
+        return true;
+    }
+
+    bool IoUring::hasBuffers()
+    {
+        return !bufferData.empty();
+    }
+
+    char *IoUring::buffer(uint16_t id)
+    {
+        return bufferData.data() + static_cast<size_t>(id) * bufferSize;
+    }
+
+    void IoUring::recycleBuffer(uint16_t id)
+    {
+        // Goes back with the next submit, no completion unless it fails
+        io_uring_sqe *sqe = nextSqe();
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = 1;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer(id));
+        sqe->len = bufferSize;
+        sqe->buf_group = bufferGroup;
+        sqe->off = id;
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    }
+}
+
+#endif //__linux__
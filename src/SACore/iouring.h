@@ -0,0 +1,101 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <linux/io_uring.h>
+
+namespace SA
+{
+    // Minimal io_uring on the raw syscalls, for the EventLoop backend.
+    // Used from the thread of the loop that owns it only.
+    //
+    // The loop submits polls (POLL_ADD, multishot for edge listeners) and
+    // multishot RECV into provided buffers for TcpSocket, nothing else.
+    // Accept, send and UDP receive stay on readiness plus the plain calls:
+    // multishot accept writes every peer address into one sockaddr, so each
+    // connection would still need getpeername(); the write queue's sendmsg()
+    // almost always completes inline, and an SQE would have to keep the
+    // queued chunks alive past close; UdpSocket already batches with
+    // recvmmsg() and GRO.
+    class IoUring
+    {
+    public:
+        IoUring();
+        ~IoUring();
+
+        // False when the kernel is older than 6.0 or io_uring is disabled
+        bool init(unsigned entries);
+
+        // Queued until the next submit(), submits by itself when full
+        io_uring_sqe *nextSqe();
+
+        // Submits the queue and waits up to timeout ms (-1 forever) for a completion
+        void submit(int timeout);
+
+        // Calls func(userData, result, flags) for every completion
+        template<typename Func>
+        void forEachCompletion(Func &&func)
+        {
+            unsigned head = *cqHead;
+            unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+
+            while (head != tail)
+            {
+                io_uring_cqe cqe = cqes[head & cqMask];
+
+                // Released before the call, so func may submit and reap again
+                __atomic_store_n(cqHead, ++head, __ATOMIC_RELEASE);
+                func(cqe.user_data, cqe.res, cqe.flags);
+
+                head = *cqHead;
+                tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            }
+        }
+
+        // Provided buffers for IOSQE_BUFFER_SELECT, handed to the kernel with
+        // IORING_OP_PROVIDE_BUFFERS. Registered buffer rings would save the
+        // SQE per recycle, but are not reliable on every kernel that has them.
+        bool setupBuffers(uint16_t group, unsigned count, unsigned size);
+        bool hasBuffers();
+        char *buffer(uint16_t id);
+        void recycleBuffer(uint16_t id);
+
+    private:
+        int enter(unsigned toSubmit, unsigned minComplete, unsigned flags, void *arg, size_t argSize);
+
+        IoUring(const IoUring &) = delete;
+        IoUring& operator=(const IoUring &) = delete;
+
+        int ringFd = -1;
+
+        void *sqRing = nullptr;
+        size_t sqRingSize = 0;
+        void *cqRing = nullptr;
+        size_t cqRingSize = 0;
+        io_uring_sqe *sqes = nullptr;
+        size_t sqesSize = 0;
+
+        unsigned *sqHead = nullptr;
+        unsigned *sqTail = nullptr;
+        unsigned *sqArray = nullptr;
+        unsigned sqMask = 0;
+        unsigned sqEntries = 0;
+        unsigned sqeTail = 0;
+
+        unsigned *cqHead = nullptr;
+        unsigned *cqTail = nullptr;
+        unsigned cqMask = 0;
+        io_uring_cqe *cqes = nullptr;
+
+        std::vector<char> bufferData;
+        uint16_t bufferGroup = 0;
+        unsigned bufferSize = 0;
+
+    }; // class IoUring
+
+} // namespace SA
+
+#endif //__linux__
@@ -0,0 +1,179 @@
+#include <cstdlib>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <typeinfo>
+
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif //__GNUG__
+
+#include "loopstats.h"
+#include "object.h"
+
+namespace SA
+{
+    static std::string typeName(const Object *object)
+    {
+        const char *name = typeid(*object).name();
+
+#ifdef __GNUG__
+        int status = 0;
+        char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+        if (status == 0 && demangled)
+        {
+            std::string result(demangled);
+            std::free(demangled);
+            return result;
+        }
+#endif //__GNUG__
+
+        return name;
+    }
+
+    static std::string objectName(const Object * const &object)
+    {
+        // Only called on first lookup, while the object is still alive
+        std::ostringstream stream;
+        if (object) stream << typeName(object) << " " << static_cast<const void*>(object);
+        else stream << "singleShot";
+        return stream.str();
+    }
+
+    static std::string handlerName(const int &id)
+    {
+        return "handler " + std::to_string(id);
+    }
+
+    static std::string descriptorName(const int &descr)
+    {
+        return "descriptor " + std::to_string(descr);
+    }
+
+    static void dumpHistogram(std::ostream &output, const std::string &name, const Histogram &histogram)
+    {
+        output << "  " << std::left << std::setw(40) << name << std::right
+               << " count " << std::setw(9) << histogram.count()
+               << " min " << std::setw(9) << histogram.min()
+               << " mean " << std::setw(9) << histogram.mean()
+               << " p50 " << std::setw(9) << histogram.percentile(50)
+               << " p99 " << std::setw(9) << histogram.percentile(99)
+               << " p99.9 " << std::setw(9) << histogram.percentile(99.9)
+               << " max " << std::setw(9) << histogram.max() << "\n";
+    }
+
+    LoopStats::LoopStats()
+    {
+    }
+
+    LoopStats::~LoopStats()
+    {
+    }
+
+    Histogram &LoopStats::loopLag()
+    {
+        return lag;
+    }
+
+    Histogram &LoopStats::timerSkew()
+    {
+        return skew;
+    }
+
+    template<typename Key>
+    Histogram &LoopStats::entry(std::unordered_map<Key, Entry> &table, const Key &key, std::string (*name)(const Key &))
+    {
+        auto it = table.find(key);
+        if (it == table.end())
+            it = table.insert({key, Entry{name(key), std::make_unique<Histogram>()}}).first;
+
+        return *it->second.histogram;
+    }
+
+    template<typename Key>
+    void LoopStats::remove(std::unordered_map<Key, Entry> &table, const Key &key)
+    {
+        auto it = table.find(key);
+        if (it == table.end()) return;
+
+        removed.push_back(std::move(it->second.histogram));
+        table.erase(it);
+    }
+
+    Histogram &LoopStats::listener(Object *object)
+    {
+        return entry<const Object*>(listeners, object, objectName);
+    }
+
+    Histogram &LoopStats::handler(int id)
+    {
+        return entry(handlers, id, handlerName);
+    }
+
+    Histogram &LoopStats::descriptor(int descr)
+    {
+        return entry(descriptors, descr, descriptorName);
+    }
+
+    Histogram &LoopStats::timer(Object *object)
+    {
+        return entry<const Object*>(timers, object, objectName);
+    }
+
+    void LoopStats::removeListener(Object *object)
+    {
+        remove<const Object*>(listeners, object);
+    }
+
+    void LoopStats::removeHandler(int id)
+    {
+        remove(handlers, id);
+    }
+
+    void LoopStats::removeDescriptor(int descr)
+    {
+        remove(descriptors, descr);
+    }
+
+    void LoopStats::removeTimer(Object *object)
+    {
+        remove<const Object*>(timers, object);
+    }
+
+    void LoopStats::releaseRemoved()
+    {
+        removed.clear();
+    }
+
+    void LoopStats::dump(std::ostream &output)
+    {
+        output << "Event loop stats (ns):\n";
+        dumpHistogram(output, "loop lag", lag);
+        dumpHistogram(output, "timer skew", skew);
+
+        auto dumpTable = [&output](const char *title, const auto &table) {
+            if (table.empty()) return;
+
+            output << title << ":\n";
+            for (const auto &it : table)
+                dumpHistogram(output, it.second.name, *it.second.histogram);
+        };
+
+        dumpTable("Listeners", listeners);
+        dumpTable("Handlers", handlers);
+        dumpTable("Descriptors", descriptors);
+        dumpTable("Timers", timers);
+        output.flush();
+    }
+
+    void LoopStats::reset()
+    {
+        lag.reset();
+        skew.reset();
+        for (auto *table : {&listeners, &timers})
+            for (auto &it : *table) it.second.histogram->reset();
+
+        for (auto *table : {&handlers, &descriptors})
+            for (auto &it : *table) it.second.histogram->reset();
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "histogram.h"
+
+namespace SA
+{
+    class Object;
+
+    // Event loop instrumentation, all durations are in nanoseconds.
+    // Recording happens on the loop thread; dump() and the per-callback
+    // tables must be read from it too (post() a handler to get there).
+    class LoopStats
+    {
+    public:
+        LoopStats();
+        ~LoopStats();
+
+        // Time between waking up and waiting again, i.e. how long the
+        // loop could not react to new events.
+        SA::Histogram &loopLag();
+
+        // How late timers fire compared to their deadline
+        SA::Histogram &timerSkew();
+
+        // Callback durations, looked up before the callback runs since it
+        // may destroy its object. Single-shot timers share the nullptr entry.
+        SA::Histogram &listener(SA::Object *object);
+        SA::Histogram &handler(int id);
+        SA::Histogram &descriptor(int descr);
+        SA::Histogram &timer(SA::Object *object);
+
+        // Entries go with what they measure, a reused address or descriptor
+        // starts over. A callback may remove its own entry before it is
+        // recorded, so the loop releases them between iterations.
+        void removeListener(SA::Object *object);
+        void removeHandler(int id);
+        void removeDescriptor(int descr);
+        void removeTimer(SA::Object *object);
+        void releaseRemoved();
+
+        void dump(std::ostream &output);
+
+        // Clears the counters, references handed out stay valid
+        void reset();
+
+    private:
+        struct Entry
+        {
+            std::string name;
+            std::unique_ptr<SA::Histogram> histogram;
+        };
+
+        template<typename Key>
+        SA::Histogram &entry(std::unordered_map<Key, Entry> &table, const Key &key, std::string (*name)(const Key &));
+
+        template<typename Key>
+        void remove(std::unordered_map<Key, Entry> &table, const Key &key);
+
+        LoopStats(const LoopStats &) = delete;
+        LoopStats& operator=(const LoopStats &) = delete;
+
+        SA::Histogram lag;
+        SA::Histogram skew;
+
+        std::unordered_map<const SA::Object*, Entry> listeners;
+        std::unordered_map<int, Entry> handlers;
+        std::unordered_map<int, Entry> descriptors;
+        std::unordered_map<const SA::Object*, Entry> timers;
+        std::vector<std::unique_ptr<SA::Histogram> > removed;
+
+    }; // class LoopStats
+
+} // namespace SA
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace SA
+{
+    // Lock-free multi-producer single-consumer queue (D. Vyukov's intrusive
+    // node queue). push() may be called from any thread, pop() only from the
+    // consumer thread.
+    template <typename T>
+    class MpscQueue
+    {
+    public:
+        MpscQueue() : head(new Node), tail(head.load(std::memory_order_relaxed)) {}
+
+        ~MpscQueue()
+        {
+            T value;
+            while (pop(value));
+            delete tail;
+        }
+
+        void push(T value)
+        {
+            Node *node = new Node;
+            node->value = std::move(value);
+
+            Node *prev = head.exchange(node, std::memory_order_acq_rel);
+            prev->next.store(node, std::memory_order_release);
+        }
+
+        bool pop(T &value)
+        {
+            Node *next = tail->next.load(std::memory_order_acquire);
+            if (!next) return false;
+
+            value = std::move(next->value);
+            delete tail;
+            tail = next;
+            return true;
+        }
+
+        bool isEmpty() const
+        {
+            return tail->next.load(std::memory_order_acquire) == nullptr;
+        }
+
+    private:
+        struct Node
+        {
+            std::atomic<Node*> next {nullptr};
+            T value;
+        };
+
+        MpscQueue(const MpscQueue &) = delete;
+        MpscQueue& operator=(const MpscQueue &) = delete;
+
+        std::atomic<Node*> head;
+        Node *tail;
+
+    }; // class MpscQueue
+
+} // namespace SA
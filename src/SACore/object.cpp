@@ -1,35 +1,44 @@
 #include <tuple>
 
-#include "application.h"
+#include "eventloop.h"
 #include "object.h"
 
 namespace SA
 {
     struct Object::ObjectPrivate
     {
+        SA::EventLoop *loop = nullptr;
+        bool isMainLoopPolled = true;
     };
 
     Object::Object() :
         d(new ObjectPrivate)
     {
-        SA::Application::instance().addMainLoopListener(this);
+        d->loop = EventLoop::current();
+        d->loop->addMainLoopListener(this);
     }
 
     Object::~Object()
     {
-        Application::instance().killTimers(this);
-        Application::instance().removeMainLoopListener(this);
+        d->loop->killTimers(this);
+        d->loop->removeMainLoopListener(this);
         delete d;
     }
 
+    EventLoop *Object::eventLoop()
+    {
+        return d->loop;
+    }
+
     void Object::mainLoopEvent()
     {
+        // Not overridden, nothing to poll for
+        d->isMainLoopPolled = false;
     }
 
-    void Object::event(EventTypes type, const std::any &value)
+    void Object::event(const Event &event)
     {
-        std::ignore = type;
-        std::ignore = value;
+        std::ignore = event;
     }
 
     void Object::timerEvent(int id)
@@ -39,11 +48,21 @@ namespace SA
 
     int Object::startTimer(int interval)
     {
-        return Application::instance().startTimer(this, interval);
+        return d->loop->startTimer(this, interval);
     }
 
     bool Object::killTimer(int id)
     {
-        return Application::instance().killTimer(id);
+        return d->loop->killTimer(id);
+    }
+
+    bool Object::isMainLoopPolled()
+    {
+        return d->isMainLoopPolled;
+    }
+
+    void Object::setMainLoopPolled(bool state)
+    {
+        d->isMainLoopPolled = state;
     }
 }
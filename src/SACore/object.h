@@ -1,22 +1,36 @@
 #pragma once
 
-#include <any>
 #include "global.h"
+#include "event.h"
 
 namespace SA
 {
+    class EventLoop;
+
     class Object
     {
     public:
         Object();
         virtual ~Object();
+
+        SA::EventLoop *eventLoop();
+
+        // Called on every pass of the loop. An override is polled: the loop
+        // wakes up at least every 1 ms while such an object exists. The
+        // default one is not, it only runs when the loop wakes for events.
         virtual void mainLoopEvent();
-        virtual void event(SA::EventTypes type, const std::any &value);
+        virtual void event(const SA::Event &event);
         virtual void timerEvent(int id);
 
         int startTimer(int interval);
         bool killTimer(int id);
 
+        bool isMainLoopPolled();
+
+    protected:
+        // For overrides that are woken otherwise, e.g. by a descriptor
+        void setMainLoopPolled(bool state);
+
     private:
         struct ObjectPrivate;
         ObjectPrivate * const d;
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace SA
+{
+    // Object table with generational ids: (generation << 20) | index, as in
+    // HandlerList. Objects are built in place in fixed chunks of slots, so
+    // they never move, need not be movable, and memory is allocated once per
+    // chunk rather than per object. Freed slots are reused first.
+    // Header-only, so SANetwork can use it without linking SACore.
+    template<typename T>
+    class SlotMap
+    {
+    public:
+        SlotMap() = default;
+        SlotMap(const SlotMap &) = delete;
+        SlotMap& operator=(const SlotMap &) = delete;
+
+        ~SlotMap()
+        {
+            clear();
+        }
+
+        // Returns the id, or -1 once every index is taken
+        template<typename... Args>
+        int emplace(Args &&...args)
+        {
+            uint32_t index;
+
+            if (!freeIndexes.empty())
+            {
+                index = freeIndexes.back();
+                freeIndexes.pop_back();
+            }
+            else
+            {
+                if (capacity > IndexMask) return -1;
+
+                index = capacity++;
+                if (index / ChunkSize == chunks.size())
+                    chunks.emplace_back(new Slot[ChunkSize]);
+            }
+
+            Slot &slot = slotAt(index);
+            ::new (static_cast<void*>(slot.storage)) T(std::forward<Args>(args)...);
+            slot.generation = nextGeneration(slot.generation);
+            slot.active = true;
+            ++count;
+
+            return static_cast<int>((slot.generation << IndexBits) | index);
+        }
+
+        bool remove(int id)
+        {
+            T *object = find(id);
+            if (!object) return false;
+
+            uint32_t index = static_cast<uint32_t>(id) & IndexMask;
+            Slot &slot = slotAt(index);
+
+            // Inactive first, so the destructor can't reach itself by id
+            slot.active = false;
+            --count;
+            object->~T();
+            freeIndexes.push_back(index);
+
+            return true;
+        }
+
+        T *find(int id)
+        {
+            if (id < 0) return nullptr;
+
+            uint32_t index = static_cast<uint32_t>(id) & IndexMask;
+            uint32_t generation = static_cast<uint32_t>(id) >> IndexBits;
+            if (index >= capacity) return nullptr;
+
+            Slot &slot = slotAt(index);
+            if (!slot.active || slot.generation != generation) return nullptr;
+
+            return slot.object();
+        }
+
+        bool contains(int id) const
+        {
+            return const_cast<SlotMap*>(this)->find(id) != nullptr;
+        }
+
+        void clear()
+        {
+            for (uint32_t index=0; index<capacity; ++index)
+            {
+                Slot &slot = slotAt(index);
+                if (slot.active) remove(static_cast<int>((slot.generation << IndexBits) | index));
+            }
+        }
+
+        bool isEmpty() const
+        {
+            return count == 0;
+        }
+
+        size_t size() const
+        {
+            return count;
+        }
+
+        // Calls func(id, object) for every object, func may remove any of them
+        template<typename Func>
+        void forEach(Func &&func)
+        {
+            for (uint32_t index=0; index<capacity; ++index)
+            {
+                Slot &slot = slotAt(index);
+                if (slot.active)
+                    func(static_cast<int>((slot.generation << IndexBits) | index), *slot.object());
+            }
+        }
+
+    private:
+        static const uint32_t IndexBits = 20;
+        static const uint32_t IndexMask = (1u << IndexBits) - 1;
+        static const uint32_t GenerationMask = (1u << (31 - IndexBits)) - 1;
+        static const uint32_t ChunkSize = 256;
+
+        struct Slot
+        {
+            alignas(T) unsigned char storage[sizeof(T)];
+            uint32_t generation = 0;
+            bool active = false;
+
+            T *object() { return std::launder(reinterpret_cast<T*>(storage)); }
+        };
+
+        static uint32_t nextGeneration(uint32_t generation)
+        {
+            generation = (generation + 1) & GenerationMask;
+            return generation ? generation : 1;
+        }
+
+        Slot &slotAt(uint32_t index)
+        {
+            return chunks[index / ChunkSize][index % ChunkSize];
+        }
+
+        std::vector<std::unique_ptr<Slot[]> > chunks;
+        std::vector<uint32_t> freeIndexes;
+        uint32_t capacity = 0;
+        size_t count = 0;
+
+    }; // class SlotMap
+
+} // namespace SA
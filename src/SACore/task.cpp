@@ -0,0 +1,72 @@
+#include <new>
+#include <vector>
+#include <iostream>
+
+#include "task.h"
+#include "eventloop.h"
+
+static const size_t FrameGranularity = 64;
+static const size_t FrameSizeClasses = 64;
+static const size_t MaxFreeFrames = 256;
+
+namespace SA
+{
+    struct FrameFreeLists
+    {
+        std::vector<void*> lists[FrameSizeClasses];
+
+        ~FrameFreeLists()
+        {
+            for (auto &list : lists)
+                for (void *ptr : list)
+                    ::operator delete(ptr);
+        }
+    };
+
+    static thread_local FrameFreeLists FRAME_FREE_LISTS;
+
+    void *FramePool::allocate(size_t size)
+    {
+        size_t index = (size + FrameGranularity - 1) / FrameGranularity;
+        if (index >= FrameSizeClasses) return ::operator new(size);
+
+        std::vector<void*> &list = FRAME_FREE_LISTS.lists[index];
+        if (list.empty()) return ::operator new(index * FrameGranularity);
+
+        void *ptr = list.back();
+        list.pop_back();
+        return ptr;
+    }
+
+    void FramePool::deallocate(void *ptr, size_t size)
+    {
+        size_t index = (size + FrameGranularity - 1) / FrameGranularity;
+        if (index >= FrameSizeClasses) return ::operator delete(ptr);
+
+        std::vector<void*> &list = FRAME_FREE_LISTS.lists[index];
+        if (list.size() >= MaxFreeFrames) return ::operator delete(ptr);
+
+        list.push_back(ptr);
+    }
+
+    void TaskPromiseBase::reportError(std::exception_ptr error)
+    {
+        try
+        {
+            std::rethrow_exception(error);
+        }
+        catch (const std::exception &exception)
+        {
+            std::cout << "Task: unhandled exception: " << exception.what() << std::endl;
+        }
+        catch (...)
+        {
+            std::cout << "Task: unhandled exception" << std::endl;
+        }
+    }
+
+    void SleepAwaiter::await_suspend(std::coroutine_handle<> handle)
+    {
+        EventLoop::current()->singleShot(interval, [handle]{ handle.resume(); });
+    }
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace SA
+{
+    // Size-class free lists for coroutine frames, so linear request/response
+    // code does not hit the global allocator on every call.
+    class FramePool
+    {
+    public:
+        static void *allocate(size_t size);
+        static void deallocate(void *ptr, size_t size);
+    };
+
+    struct TaskPromiseBase
+    {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr error;
+        bool detached = false;
+
+        static void *operator new(size_t size) { return FramePool::allocate(size); }
+        static void operator delete(void *ptr, size_t size) { FramePool::deallocate(ptr, size); }
+
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+
+            template <typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+            {
+                TaskPromiseBase &promise = handle.promise();
+                std::coroutine_handle<> continuation = promise.continuation;
+
+                if (promise.detached)
+                {
+                    handle.destroy();
+                    return std::noop_coroutine();
+                }
+
+                return continuation ? continuation : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        // Nobody awaits a detached task, its error is logged and dropped so
+        // it does not unwind through the loop that resumed it
+        void unhandled_exception()
+        {
+            error = std::current_exception();
+            if (detached) reportError(error);
+        }
+
+        static void reportError(std::exception_ptr error);
+    };
+
+    template <typename T>
+    struct TaskPromise : TaskPromiseBase
+    {
+        std::optional<T> value;
+
+        template <typename U>
+        void return_value(U &&result) { value.emplace(std::forward<U>(result)); }
+    };
+
+    template <>
+    struct TaskPromise<void> : TaskPromiseBase
+    {
+        void return_void() {}
+    };
+
+    // Eagerly started coroutine driven by the main loop. A Task can be
+    // co_awaited by another coroutine, or simply dropped: the frame then
+    // destroys itself when the coroutine finishes.
+    template <typename T = void>
+    class Task
+    {
+    public:
+        struct promise_type : TaskPromise<T>
+        {
+            Task get_return_object()
+            { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        };
+
+        Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+        Task& operator=(Task &&other) noexcept
+        {
+            if (&other != this)
+            {
+                release();
+                handle = std::exchange(other.handle, nullptr);
+            }
+            return *this;
+        }
+
+        ~Task() { release(); }
+
+        bool isDone() const { return !handle || handle.done(); }
+
+        bool await_ready() const noexcept { return isDone(); }
+
+        void await_suspend(std::coroutine_handle<> awaiting) noexcept
+        { handle.promise().continuation = awaiting; }
+
+        T await_resume()
+        {
+            promise_type &promise = handle.promise();
+            if (promise.error) std::rethrow_exception(promise.error);
+            if constexpr (!std::is_void_v<T>) return std::move(*promise.value);
+        }
+
+    private:
+        explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+        void release()
+        {
+            if (!handle) return;
+
+            if (handle.done()) handle.destroy();
+            else handle.promise().detached = true;
+
+            handle = nullptr;
+        }
+
+        Task(const Task &) = delete;
+        Task& operator=(const Task &) = delete;
+
+        std::coroutine_handle<promise_type> handle;
+
+    }; // class Task
+
+    struct SleepAwaiter
+    {
+        int interval = 0;
+
+        bool await_ready() const noexcept { return interval <= 0; }
+        void await_suspend(std::coroutine_handle<> handle);
+        void await_resume() const noexcept {}
+    };
+
+    inline SleepAwaiter sleep(int interval) { return SleepAwaiter{interval}; }
+
+} // namespace SA
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "threadpool.h"
+#include "eventloop.h"
+
+namespace SA
+{
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void ()> > tasks;
+    };
+
+    struct ThreadPool::ThreadPoolPrivate
+    {
+        SA::EventLoop *loop = nullptr;
+        std::vector<std::unique_ptr<WorkerQueue> > queues;
+        std::vector<std::thread> threads;
+
+        std::atomic<bool> stopFlag {false};
+        std::atomic<size_t> pending {0};
+        std::atomic<size_t> sleeping {0};
+        std::atomic<size_t> nextQueue {0};
+
+        std::mutex sleepMutex;
+        std::condition_variable sleepCondition;
+    };
+
+    static thread_local const void *CURRENT_POOL = nullptr;
+    static thread_local size_t CURRENT_WORKER = 0;
+
+    ThreadPool::ThreadPool(size_t threadCount) :
+        d(new ThreadPoolPrivate)
+    {
+        d->loop = currentLoop();
+        if (!d->loop)
+            d->loop = EventLoop::current();
+
+        if (threadCount == 0)
+            threadCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+        for (size_t i=0; i<threadCount; ++i)
+            d->queues.push_back(std::make_unique<WorkerQueue>());
+
+        for (size_t i=0; i<threadCount; ++i)
+            d->threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(d->sleepMutex);
+            d->stopFlag = true;
+        }
+
+        d->sleepCondition.notify_all();
+
+        for (std::thread &thread : d->threads)
+            thread.join();
+
+        delete d;
+    }
+
+    size_t ThreadPool::threadCount()
+    {
+        return d->threads.size();
+    }
+
+    void ThreadPool::execute(const std::function<void ()> &task)
+    {
+        if (!task) return;
+
+        // Workers push to their own deque, everyone else spreads round-robin
+        size_t index = (CURRENT_POOL == d) ? CURRENT_WORKER :
+                       d->nextQueue.fetch_add(1, std::memory_order_relaxed) % d->queues.size();
+
+        WorkerQueue &queue = *d->queues[index];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(task);
+        }
+
+        d->pending.fetch_add(1);
+
+        if (d->sleeping.load() > 0)
+        {
+            std::lock_guard<std::mutex> lock(d->sleepMutex);
+            d->sleepCondition.notify_one();
+        }
+    }
+
+    EventLoop *ThreadPool::currentLoop()
+    {
+        if (CURRENT_POOL) return nullptr;
+        return EventLoop::current();
+    }
+
+    void ThreadPool::postToLoop(EventLoop *loop, const std::function<void ()> &handler)
+    {
+        loop->post(handler);
+    }
+
+    void ThreadPool::reportError(std::exception_ptr error)
+    {
+        try
+        {
+            std::rethrow_exception(error);
+        }
+        catch (const std::exception &exception)
+        {
+            std::cout << "ThreadPool: unhandled exception: " << exception.what() << std::endl;
+        }
+        catch (...)
+        {
+            std::cout << "ThreadPool: unhandled exception" << std::endl;
+        }
+    }
+
+    EventLoop *ThreadPool::ownerLoop()
+    {
+        return d->loop;
+    }
+
+    void ThreadPool::workerLoop(size_t index)
+    {
+        CURRENT_POOL = d;
+        CURRENT_WORKER = index;
+
+        std::function<void ()> task;
+
+        while (true)
+        {
+            if (takeTask(index, task))
+            {
+                task();
+                task = nullptr;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(d->sleepMutex);
+            if (d->stopFlag) break;
+
+            d->sleeping.fetch_add(1);
+            d->sleepCondition.wait(lock, [this]{ return d->pending.load() > 0 || d->stopFlag; });
+            d->sleeping.fetch_sub(1);
+        }
+
+        CURRENT_POOL = nullptr;
+    }
+
+    bool ThreadPool::takeTask(size_t index, std::function<void ()> &task)
+    {
+        // Own deque from the back (cache-warm LIFO), others from the front
+        {
+            WorkerQueue &queue = *d->queues[index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+
+            if (!queue.tasks.empty())
+            {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+                d->pending.fetch_sub(1);
+                return true;
+            }
+        }
+
+        for (size_t i=1; i<d->queues.size(); ++i)
+        {
+            WorkerQueue &queue = *d->queues[(index + i) % d->queues.size()];
+            std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+
+            if (lock.owns_lock() && !queue.tasks.empty())
+            {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                d->pending.fetch_sub(1);
+                return true;
+            }
+        }
+
+        return false;
+    }
+}
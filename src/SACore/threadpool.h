@@ -0,0 +1,202 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace SA
+{
+    class EventLoop;
+    template <typename T> class Future;
+
+    class ThreadPool
+    {
+    public:
+        explicit ThreadPool(size_t threadCount = 0);
+        virtual ~ThreadPool();
+
+        size_t threadCount();
+
+        void execute(const std::function<void ()> &task);
+
+        template <typename Func>
+        SA::Future<std::invoke_result_t<Func> > submit(Func func);
+
+        // The loop of the calling thread, nullptr on worker threads
+        static SA::EventLoop *currentLoop();
+        static void postToLoop(SA::EventLoop *loop, const std::function<void ()> &handler);
+        static void reportError(std::exception_ptr error);
+
+    private:
+        SA::EventLoop *ownerLoop();
+        void workerLoop(size_t index);
+        bool takeTask(size_t index, std::function<void ()> &task);
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool(ThreadPool &&) = delete;
+        ThreadPool& operator=(const ThreadPool &) = delete;
+        ThreadPool& operator=(ThreadPool &&) = delete;
+
+        struct ThreadPoolPrivate;
+        ThreadPoolPrivate * const d;
+
+    }; // class ThreadPool
+
+    template <typename T>
+    struct FutureHandler { using type = std::function<void (T)>; };
+
+    template <>
+    struct FutureHandler<void> { using type = std::function<void ()>; };
+
+    template <typename T>
+    struct FutureState
+    {
+        using Storage = std::conditional_t<std::is_void_v<T>, bool, std::optional<T> >;
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool ready = false;
+        Storage value {};
+        std::exception_ptr error;
+        std::function<void ()> continuation;
+        SA::EventLoop *loop = nullptr;
+
+        template <typename ...Args>
+        void setValue(Args &&...args)
+        {
+            std::function<void ()> handler;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if constexpr (std::is_void_v<T>) value = true;
+                else value.emplace(std::forward<Args>(args)...);
+                ready = true;
+                handler.swap(continuation);
+            }
+
+            condition.notify_all();
+            if (handler) ThreadPool::postToLoop(loop, handler);
+        }
+
+        void setError(std::exception_ptr exception)
+        {
+            std::function<void ()> handler;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                error = exception;
+                ready = true;
+                handler.swap(continuation);
+            }
+
+            condition.notify_all();
+            if (handler) ThreadPool::postToLoop(loop, handler);
+        }
+    };
+
+    // Result of ThreadPool::submit(). The continuation passed to then() is
+    // invoked on the event loop of the thread that called then(), or of the
+    // thread that created the pool if that was a worker, never on a worker
+    // thread. Without an error handler exceptions are logged and dropped.
+    template <typename T>
+    class Future
+    {
+    public:
+        using Handler = typename FutureHandler<T>::type;
+
+        Future() = default;
+
+        bool isValid() const { return static_cast<bool>(d); }
+
+        bool isReady() const
+        {
+            if (!d) return false;
+            std::lock_guard<std::mutex> lock(d->mutex);
+            return d->ready;
+        }
+
+        void wait() const
+        {
+            if (!d) return;
+            std::unique_lock<std::mutex> lock(d->mutex);
+            d->condition.wait(lock, [this]{ return d->ready; });
+        }
+
+        T get()
+        {
+            wait();
+            if (d->error) std::rethrow_exception(d->error);
+            if constexpr (!std::is_void_v<T>) return std::move(*d->value);
+        }
+
+        void then(const Handler &handler,
+                  const std::function<void (std::exception_ptr)> &errorHandler = nullptr)
+        {
+            if (!d) return;
+
+            std::shared_ptr<FutureState<T> > state = d;
+            std::function<void ()> continuation = [state, handler, errorHandler]() {
+                if (state->error)
+                {
+                    if (errorHandler) errorHandler(state->error);
+                    else ThreadPool::reportError(state->error);
+                }
+                else if (handler)
+                {
+                    if constexpr (std::is_void_v<T>) handler();
+                    else handler(std::move(*state->value));
+                }
+            };
+
+            // Workers have no loop that runs, keep the one of the pool
+            SA::EventLoop *loop = ThreadPool::currentLoop();
+            {
+                std::lock_guard<std::mutex> lock(d->mutex);
+                if (loop) d->loop = loop;
+                else loop = d->loop;
+
+                if (!d->ready)
+                {
+                    d->continuation = std::move(continuation);
+                    return;
+                }
+            }
+
+            ThreadPool::postToLoop(loop, continuation);
+        }
+
+    private:
+        friend class ThreadPool;
+        std::shared_ptr<FutureState<T> > d;
+
+    }; // class Future
+
+    template <typename Func>
+    SA::Future<std::invoke_result_t<Func> > ThreadPool::submit(Func func)
+    {
+        using Result = std::invoke_result_t<Func>;
+
+        SA::Future<Result> future;
+        future.d = std::make_shared<FutureState<Result> >();
+        future.d->loop = ownerLoop();
+
+        std::shared_ptr<FutureState<Result> > state = future.d;
+        execute([state, func]() mutable {
+            try
+            {
+                if constexpr (std::is_void_v<Result>) { func(); state->setValue(); }
+                else state->setValue(func());
+            }
+            catch (...)
+            {
+                state->setError(std::current_exception());
+            }
+        });
+
+        return future;
+    }
+
+} // namespace SA
@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "timerqueue.h"
+#include "object.h"
+#include "loopstats.h"
+
+namespace SA
+{
+    struct TimerStruct
+    {
+        SA::Object *object = nullptr;
+        int interval = 0;
+        uint64_t sequence = 0;
+        bool active = false;
+        std::function<void ()> handler;
+    };
+
+    struct TimerEntry
+    {
+        TimerQueue::TimePoint timeEnd;
+        uint64_t sequence;
+        int id;
+
+        bool operator>(const TimerEntry &other) const
+        { return timeEnd > other.timeEnd; }
+    };
+
+    struct TimerQueue::TimerQueuePrivate
+    {
+        uint64_t sequence = 0;
+        size_t activeCount = 0;
+        SA::LoopStats *stats = nullptr;
+
+        // Timer id is an index + 1, killed ids are reused through freeIds
+        std::vector<TimerStruct> timers;
+        std::vector<int> freeIds;
+
+        // Min-heap by deadline, killed timers are dropped lazily when popped
+        std::vector<TimerEntry> heap;
+        std::vector<TimerEntry> expired;
+
+        std::unordered_map<SA::Object*, std::vector<int> > objectTimers;
+    };
+
+    TimerQueue::TimerQueue() :
+        d(new TimerQueuePrivate)
+    {
+    }
+
+    TimerQueue::~TimerQueue()
+    {
+        delete d;
+    }
+
+    int TimerQueue::start(Object *object, int interval, const TimePoint &now)
+    {
+        if (!object) return -1;
+
+        int id = insert(interval, now);
+        d->timers[id - 1].object = object;
+        d->objectTimers[object].push_back(id);
+
+        return id;
+    }
+
+    int TimerQueue::startSingleShot(const std::function<void ()> &handler, int delay, const TimePoint &now)
+    {
+        if (!handler) return -1;
+
+        int id = insert(delay, now);
+        d->timers[id - 1].handler = handler;
+
+        return id;
+    }
+
+    int TimerQueue::insert(int interval, const TimePoint &now)
+    {
+        if (interval < 0) interval = 0;
+
+        int id;
+        if (d->freeIds.empty())
+        {
+            d->timers.emplace_back();
+            id = static_cast<int>(d->timers.size());
+        }
+        else
+        {
+            id = d->freeIds.back();
+            d->freeIds.pop_back();
+        }
+
+        TimerStruct &timer = d->timers[id - 1];
+        timer.interval = interval;
+        timer.sequence = ++d->sequence;
+        timer.active = true;
+        ++d->activeCount;
+
+        d->heap.push_back({now + std::chrono::milliseconds(interval), timer.sequence, id});
+        std::push_heap(d->heap.begin(), d->heap.end(), std::greater<TimerEntry>());
+
+        return id;
+    }
+
+    bool TimerQueue::kill(int id)
+    {
+        if (id < 1 || id > static_cast<int>(d->timers.size())) return false;
+
+        TimerStruct &timer = d->timers[id - 1];
+        if (!timer.active) return false;
+
+        auto it = d->objectTimers.find(timer.object);
+        if (it != d->objectTimers.end())
+        {
+            std::vector<int> &ids = it->second;
+            auto idIt = std::find(ids.begin(), ids.end(), id);
+            if (idIt != ids.end())
+            {
+                *idIt = ids.back();
+                ids.pop_back();
+            }
+
+            if (ids.empty())
+                d->objectTimers.erase(it);
+        }
+
+        timer.active = false;
+        timer.object = nullptr;
+        timer.handler = nullptr;
+        --d->activeCount;
+        d->freeIds.push_back(id);
+
+        if (d->heap.size() > 2 * d->activeCount + 64)
+            compact();
+
+        return true;
+    }
+
+    bool TimerQueue::kill(Object *object)
+    {
+        auto it = d->objectTimers.find(object);
+        if (it == d->objectTimers.end()) return false;
+
+        for (int id : it->second)
+        {
+            TimerStruct &timer = d->timers[id - 1];
+            timer.active = false;
+            timer.object = nullptr;
+            --d->activeCount;
+            d->freeIds.push_back(id);
+        }
+
+        d->objectTimers.erase(it);
+
+        if (d->heap.size() > 2 * d->activeCount + 64)
+            compact();
+
+        return true;
+    }
+
+    void TimerQueue::setStats(LoopStats *stats)
+    {
+        d->stats = stats;
+    }
+
+    bool TimerQueue::isEmpty()
+    {
+        return d->activeCount == 0;
+    }
+
+    TimerQueue::TimePoint TimerQueue::nextDeadline()
+    {
+        while (!d->heap.empty())
+        {
+            const TimerEntry &top = d->heap.front();
+            const TimerStruct &timer = d->timers[top.id - 1];
+
+            if (timer.active && timer.sequence == top.sequence)
+                return top.timeEnd;
+
+            std::pop_heap(d->heap.begin(), d->heap.end(), std::greater<TimerEntry>());
+            d->heap.pop_back();
+        }
+
+        return TimePoint::max();
+    }
+
+    void TimerQueue::process(const TimePoint &now)
+    {
+        // Collect everything that is due first, so zero-interval timers
+        // rescheduled below fire once per pass instead of spinning here.
+        d->expired.clear();
+
+        while (!d->heap.empty() && d->heap.front().timeEnd <= now)
+        {
+            std::pop_heap(d->heap.begin(), d->heap.end(), std::greater<TimerEntry>());
+            d->expired.push_back(d->heap.back());
+            d->heap.pop_back();
+        }
+
+        if (d->expired.empty()) return;
+
+        std::vector<TimerEntry> expired;
+        expired.swap(d->expired);
+
+        // Deadlines follow the loop clock, callback timing the real one
+        std::chrono::steady_clock::time_point timeProcess;
+        if (d->stats) timeProcess = std::chrono::steady_clock::now();
+
+        for (const TimerEntry &entry : expired)
+        {
+            // Earlier callbacks may have killed or restarted this timer
+            TimerStruct &timer = d->timers[entry.id - 1];
+            if (!timer.active || timer.sequence != entry.sequence) continue;
+
+            SA::Object *object = timer.object;
+            SA::Histogram *histogram = nullptr;
+            std::chrono::steady_clock::time_point timeStart;
+
+            if (d->stats)
+            {
+                histogram = &d->stats->timer(object);
+                timeStart = std::chrono::steady_clock::now();
+                auto skew = (now - entry.timeEnd) + (timeStart - timeProcess);
+                d->stats->timerSkew().record(static_cast<uint64_t>(std::chrono::nanoseconds(skew).count()));
+            }
+
+            if (timer.handler)
+            {
+                std::function<void ()> handler = std::move(timer.handler);
+                kill(entry.id);
+                handler();
+            }
+            else
+            {
+                d->heap.push_back({now + std::chrono::milliseconds(timer.interval), timer.sequence, entry.id});
+                std::push_heap(d->heap.begin(), d->heap.end(), std::greater<TimerEntry>());
+
+                object->timerEvent(entry.id);
+            }
+
+            if (histogram)
+            {
+                auto duration = std::chrono::steady_clock::now() - timeStart;
+                histogram->record(static_cast<uint64_t>(std::chrono::nanoseconds(duration).count()));
+            }
+        }
+
+        expired.clear();
+        if (d->expired.empty())
+            d->expired.swap(expired);
+    }
+
+    void TimerQueue::compact()
+    {
+        auto it = std::remove_if(d->heap.begin(), d->heap.end(), [this](const TimerEntry &entry) {
+            const TimerStruct &timer = d->timers[entry.id - 1];
+            return !timer.active || timer.sequence != entry.sequence;
+        });
+
+        d->heap.erase(it, d->heap.end());
+        std::make_heap(d->heap.begin(), d->heap.end(), std::greater<TimerEntry>());
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+
+namespace SA
+{
+    class Object;
+    class LoopStats;
+
+    class TimerQueue
+    {
+    public:
+        using TimePoint = std::chrono::steady_clock::time_point;
+
+        TimerQueue();
+        ~TimerQueue();
+
+        int start(SA::Object *object, int interval, const TimePoint &now);
+        int startSingleShot(const std::function<void ()> &handler, int delay, const TimePoint &now);
+        bool kill(int id);
+        bool kill(SA::Object *object);
+
+        // Time every callback into stats, nullptr turns it off
+        void setStats(SA::LoopStats *stats);
+
+        bool isEmpty();
+        TimePoint nextDeadline();
+        void process(const TimePoint &now);
+
+    private:
+        int insert(int interval, const TimePoint &now);
+        void compact();
+
+        TimerQueue(const TimerQueue &) = delete;
+        TimerQueue& operator=(const TimerQueue &) = delete;
+
+        struct TimerQueuePrivate;
+        TimerQueuePrivate * const d;
+
+    }; // class TimerQueue
+
+} // namespace SA
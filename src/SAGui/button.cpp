@@ -1,8 +1,8 @@
 #include <iostream>
 #include <algorithm>
-#include <map>
 
 #include "button.h"
+#include "handlerlist.h"
 #include "utility.h"
 
 namespace SA
@@ -20,9 +20,9 @@ namespace SA
         Color textColors[AllStates];
         Color backgrounds[AllStates];
 
-        std::map<int, std::function<void (bool)> > hoverHandlers;
-        std::map<int, std::function<void (bool)> > pressHandlers;
-        std::map<int, std::function<void (bool)> > checkHandlers;
+        SA::HandlerList<void (bool)> hoverHandlers;
+        SA::HandlerList<void (bool)> pressHandlers;
+        SA::HandlerList<void (bool)> checkHandlers;
     };
 
     Button::Button(Widget *parent) : Button("Button", parent)
@@ -113,47 +113,32 @@ namespace SA
 
     int Button::addHoverHandler(const std::function<void (bool)> &func)
     {
-        int id = static_cast<int>(d->hoverHandlers.size());
-        for (auto const& it : d->hoverHandlers) if (it.first != ++id) break;
-        d->hoverHandlers.insert({id, func});
-        return id;
+        return d->hoverHandlers.add(func);
     }
 
     void Button::removeHoverHandler(int id)
     {
-        auto it = d->hoverHandlers.find(id);
-        if (it != d->hoverHandlers.end())
-            d->hoverHandlers.erase(it);
+        d->hoverHandlers.remove(id);
     }
 
     int Button::addPressHandler(const std::function<void(bool)> &func)
     {
-        int id = static_cast<int>(d->pressHandlers.size());
-        for (auto const& it : d->pressHandlers) if (it.first != ++id) break;
-        d->pressHandlers.insert({id, func});
-        return id;
+        return d->pressHandlers.add(func);
     }
 
     void Button::removePressHandler(int id)
     {
-        auto it = d->pressHandlers.find(id);
-        if (it != d->pressHandlers.end())
-            d->pressHandlers.erase(it);
+        d->pressHandlers.remove(id);
     }
 
     int Button::addCheckHandler(const std::function<void (bool)> &func)
     {
-        int id = static_cast<int>(d->checkHandlers.size());
-        for (auto const& it : d->checkHandlers) if (it.first != ++id) break;
-        d->checkHandlers.insert({id, func});
-        return id;
+        return d->checkHandlers.add(func);
     }
 
     void Button::removeCheckHandler(int id)
     {
-        auto it = d->checkHandlers.find(id);
-        if (it != d->checkHandlers.end())
-            d->checkHandlers.erase(it);
+        d->checkHandlers.remove(id);
     }
 
     void Button::paintEvent()
@@ -176,7 +161,7 @@ namespace SA
         d->styleState = d->checked ? CheckedState :
                                      state ? HoveredState : EnableState;
         update();
-        for (const auto &it: d->hoverHandlers) it.second(state);
+        d->hoverHandlers(state);
     }
 
     void Button::mouseButtonEvent(const MouseEvent &event)
@@ -202,11 +187,11 @@ namespace SA
 
         update();
 
-        for (const auto &it: d->pressHandlers) it.second(event.pressed);
+        d->pressHandlers(event.pressed);
 
         if (d->checkable)
-        { if(event.pressed) for (const auto &it: d->checkHandlers) it.second(d->checked); }
-        else for (const auto &it: d->checkHandlers) it.second(d->checked);
+        { if(event.pressed) d->checkHandlers(d->checked); }
+        else d->checkHandlers(d->checked);
     }
 
     void Button::calcTextColors(const Color &color)
@@ -1,4 +1,5 @@
 #include "checkbox.h"
+#include "handlerlist.h"
 #include "utility.h"
 
 namespace SA
@@ -28,9 +29,9 @@ namespace SA
         Alignment textAlignH = SA::AlignLeft;
         Alignment textAlignV = SA::AlignVCenter;
 
-        std::map<int, std::function<void (bool)> > hoverHandlers;
-        std::map<int, std::function<void (bool)> > pressHandlers;
-        std::map<int, std::function<void (bool)> > checkHandlers;
+        SA::HandlerList<void (bool)> hoverHandlers;
+        SA::HandlerList<void (bool)> pressHandlers;
+        SA::HandlerList<void (bool)> checkHandlers;
     };
 
     CheckBox::CheckBox(Widget *parent) : Widget(parent),
@@ -177,47 +178,32 @@ namespace SA
 
     int CheckBox::addHoverHandler(const std::function<void (bool)> &func)
     {
-        int id = static_cast<int>(d->hoverHandlers.size());
-        for (auto const& it : d->hoverHandlers) if (it.first != ++id) break;
-        d->hoverHandlers.insert({id, func});
-        return id;
+        return d->hoverHandlers.add(func);
     }
 
     void CheckBox::removeHoverHandler(int id)
     {
-        auto it = d->hoverHandlers.find(id);
-        if (it != d->hoverHandlers.end())
-            d->hoverHandlers.erase(it);
+        d->hoverHandlers.remove(id);
     }
 
     int CheckBox::addPressHandler(const std::function<void(bool)> &func)
     {
-        int id = static_cast<int>(d->pressHandlers.size());
-        for (auto const& it : d->pressHandlers) if (it.first != ++id) break;
-        d->pressHandlers.insert({id, func});
-        return id;
+        return d->pressHandlers.add(func);
     }
 
     void CheckBox::removePressHandler(int id)
     {
-        auto it = d->pressHandlers.find(id);
-        if (it != d->pressHandlers.end())
-            d->pressHandlers.erase(it);
+        d->pressHandlers.remove(id);
     }
 
     int CheckBox::addCheckHandler(const std::function<void (bool)> &func)
     {
-        int id = static_cast<int>(d->checkHandlers.size());
-        for (auto const& it : d->checkHandlers) if (it.first != ++id) break;
-        d->checkHandlers.insert({id, func});
-        return id;
+        return d->checkHandlers.add(func);
     }
 
     void CheckBox::removeCheckHandler(int id)
     {
-        auto it = d->checkHandlers.find(id);
-        if (it != d->checkHandlers.end())
-            d->checkHandlers.erase(it);
+        d->checkHandlers.remove(id);
     }
 
     void CheckBox::paintEvent()
@@ -234,7 +220,7 @@ namespace SA
         d->styleState = d->checked ? CheckedState :
                                      state ? HoveredState : EnableState;
         update();
-        for (const auto &it: d->hoverHandlers) it.second(state);
+        d->hoverHandlers(state);
     }
 
     void CheckBox::mouseButtonEvent(const MouseEvent &event)
@@ -249,14 +235,12 @@ namespace SA
             d->checked = !d->checked;
             d->styleState = d->checked ? CheckedState : HoveredState;
 
-            for (const auto &it: d->checkHandlers)
-                it.second(d->checked);
+            d->checkHandlers(d->checked);
         }
 
         update();
 
-        for (const auto &it: d->pressHandlers)
-            it.second(event.pressed);
+        d->pressHandlers(event.pressed);
     }
 
     void CheckBox::resizeEvent(const SA::Size &size)
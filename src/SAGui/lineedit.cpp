@@ -3,6 +3,7 @@
 #include <stack>
 
 #include "lineedit.h"
+#include "handlerlist.h"
 #include "clipboard.h"
 #include "utility.h"
 
@@ -43,8 +44,8 @@ namespace SA
         Color selectionColor = {140, 140, 140};
 
         // Events listeners
-        std::map<int, std::function<void (bool)> > hoverHandlers;
-        std::map<int, std::function<void ()> > returnHandlers;
+        SA::HandlerList<void (bool)> hoverHandlers;
+        SA::HandlerList<void ()> returnHandlers;
     };
 
     LineEdit::LineEdit(Widget *parent) : Widget(parent),
@@ -225,32 +226,22 @@ namespace SA
 
     int LineEdit::addHoverHandler(const std::function<void (bool)> &func)
     {
-        int id = static_cast<int>(d->hoverHandlers.size());
-        for (auto const& it : d->hoverHandlers) if (it.first != ++id) break;
-        d->hoverHandlers.insert({id, func});
-        return id;
+        return d->hoverHandlers.add(func);
     }
 
     void LineEdit::removeHoverHandler(int id)
     {
-        auto it = d->hoverHandlers.find(id);
-        if (it != d->hoverHandlers.end())
-            d->hoverHandlers.erase(it);
+        d->hoverHandlers.remove(id);
     }
 
     int LineEdit::addReturnHandler(const std::function<void ()> &func)
     {
-        int id = static_cast<int>(d->returnHandlers.size());
-        for (auto const& it : d->returnHandlers) if (it.first != ++id) break;
-        d->returnHandlers.insert({id, func});
-        return id;
+        return d->returnHandlers.add(func);
     }
 
     void LineEdit::removeReturnHandler(int id)
     {
-        auto it = d->returnHandlers.find(id);
-        if (it != d->returnHandlers.end())
-            d->returnHandlers.erase(it);
+        d->returnHandlers.remove(id);
     }
 
     void LineEdit::timerEvent(int id)
@@ -283,7 +274,7 @@ namespace SA
 
         d->styleState = state ? HoveredState : EnableState;
         update();
-        for (const auto &it: d->hoverHandlers) it.second(state);
+        d->hoverHandlers(state);
     }
 
     void LineEdit::mouseMoveEvent(const Point &pos)
@@ -467,7 +458,7 @@ namespace SA
 
     void LineEdit::keyReactionReturn()
     {
-        for (const auto &it: d->returnHandlers) it.second();
+        d->returnHandlers();
     }
 
     void LineEdit::keyReactionHome()
@@ -3,6 +3,7 @@
 
 #include "utility.h"
 #include "scrollbar.h"
+#include "handlerlist.h"
 
 static const uint16_t MIN_HANDLE_SIZE = 30;
 
@@ -33,7 +34,7 @@ namespace SA
         Color handleColors[AllStates];
         Color backgrounds[AllStates];
 
-        std::map<int, std::function<void (uint32_t)> > scrollHandlers;
+        SA::HandlerList<void (uint32_t)> scrollHandlers;
     };
 
     ScrollBar::ScrollBar(Orientation orientation, Widget *parent) : Widget(parent),
@@ -110,17 +111,12 @@ namespace SA
 
     int ScrollBar::addScrollHandler(const std::function<void (uint32_t)> &func)
     {
-        int id = static_cast<int>(d->scrollHandlers.size());
-        for (auto const& it : d->scrollHandlers) if (it.first != ++id) break;
-        d->scrollHandlers.insert({id, func});
-        return id;
+        return d->scrollHandlers.add(func);
     }
 
     void ScrollBar::removeScrollHandler(int id)
     {
-        auto it = d->scrollHandlers.find(id);
-        if (it != d->scrollHandlers.end())
-            d->scrollHandlers.erase(it);
+        d->scrollHandlers.remove(id);
     }
 
     void ScrollBar::paintEvent()
@@ -216,7 +212,7 @@ namespace SA
         if (value == d->value) return;
 
         d->value = value;
-        for (const auto &it: d->scrollHandlers) it.second(d->value);
+        d->scrollHandlers(d->value);
     }
 
     void ScrollBar::updateSizes()
@@ -1,9 +1,9 @@
 #include <algorithm>
 #include <iostream>
 #include <stack>
-#include <map>
 
 #include "textedit.h"
+#include "handlerlist.h"
 #include "scrollbar.h"
 #include "clipboard.h"
 #include "utility.h"
@@ -53,7 +53,7 @@ namespace SA
         Color selectionColor = {140, 140, 140};
 
         // Events listeners
-        std::map<int, std::function<void (bool)> > hoverHandlers;
+        SA::HandlerList<void (bool)> hoverHandlers;
 
         SA::ScrollBar *scrollBarV = nullptr;
         SA::ScrollBar *scrollBarH = nullptr;
@@ -473,17 +473,12 @@ namespace SA
 
     int TextEdit::addHoverHandler(const std::function<void (bool)> &func)
     {
-        int id = static_cast<int>(d->hoverHandlers.size());
-        for (auto const& it : d->hoverHandlers) if (it.first != ++id) break;
-        d->hoverHandlers.insert({id, func});
-        return id;
+        return d->hoverHandlers.add(func);
     }
 
     void TextEdit::removeHoverHandler(int id)
     {
-        auto it = d->hoverHandlers.find(id);
-        if (it != d->hoverHandlers.end())
-            d->hoverHandlers.erase(it);
+        d->hoverHandlers.remove(id);
     }
 
     void TextEdit::timerEvent(int id)
@@ -516,7 +511,7 @@ namespace SA
 
         d->styleState = state ? HoveredState : EnableState;
         update();
-        for (const auto &it: d->hoverHandlers) it.second(state);
+        d->hoverHandlers(state);
     }
 
     void TextEdit::mouseMoveEvent(const Point &pos)
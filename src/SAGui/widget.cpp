@@ -294,53 +294,43 @@ namespace SA
     void Widget::mainLoopEvent()
     {
         d->widget->mainLoopEvent();
+
+#ifdef __linux__
+        // The X11 connection wakes the loop, this only drains what Xlib queued
+        setMainLoopPolled(false);
+#endif //__linux__
     }
 
-    void Widget::event(SA::EventTypes type, const std::any &value)
+    void Widget::event(const SA::Event &event)
     {
-        switch (type)
+        switch (event.type)
         {
         case SA::EventTypes::KeyboardEvent:
-            keyboardEvent(std::any_cast<KeyEvent>(value));
+            keyboardEvent(std::get<KeyEvent>(event.value));
             break;
         case SA::EventTypes::MouseMoveEvent:
-        {
-            auto mousePair = std::any_cast<std::pair<int32_t, int32_t> >(value);
-            mouseMoveEvent({mousePair.first, mousePair.second});
+            mouseMoveEvent(std::get<SA::Point>(event.value));
             break;
-        }
         case SA::EventTypes::MouseHoverEvent:
-        {
-            mouseHoverEvent(std::any_cast<bool>(value));
+            mouseHoverEvent(std::get<bool>(event.value));
             break;
-        }
         case SA::EventTypes::MouseButtonEvent:
-        {
-            mouseButtonEvent(std::any_cast<MouseEvent>(value));
+            mouseButtonEvent(std::get<MouseEvent>(event.value));
             break;
-        }
         case SA::EventTypes::MouseWheelEvent:
-        {
-            mouseWheelEvent(std::any_cast<int32_t>(value));
+            mouseWheelEvent(std::get<int32_t>(event.value));
             break;
-        }
         case SA::EventTypes::PaintEvent:
             paintEvent();
             break;
         case SA::EventTypes::MoveEvent:
-        {
-            auto movePair = std::any_cast<std::pair<int32_t, int32_t> >(value);
-            moveEvent({movePair.first, movePair.second});
+            moveEvent(std::get<SA::Point>(event.value));
             break;
-        }
         case SA::EventTypes::FocusInEvent: focusEvent(true); break;
         case SA::EventTypes::FocusOutEvent: focusEvent(false); break;
         case SA::EventTypes::ResizeEvent:
-        {
-            auto sizePair = std::any_cast<std::pair<uint32_t, uint32_t> >(value);
-            resizeEvent({sizePair.first, sizePair.second});
+            resizeEvent(std::get<SA::Size>(event.value));
             break;
-        }
         default:
             break;
         }
@@ -82,7 +82,7 @@ namespace SA
 
     private:
         void mainLoopEvent();
-        void event(SA::EventTypes type, const std::any &value);
+        void event(const SA::Event &event);
 
         struct WidgetPrivate;
         WidgetPrivate * const d;
@@ -1,6 +1,7 @@
 #ifdef __linux__
 
 #include "application.h"
+#include "eventloop.h"
 #include "widgetlinux.h"
 #include "clipboard.h"
 
@@ -144,6 +145,7 @@ namespace SA
         friend class WidgetLinux;
 
         WidgetLinux *parent = nullptr;
+        EventLoop *loop = nullptr;
         Display *display = nullptr;
         Window window;
         XEvent event;
@@ -152,7 +154,7 @@ namespace SA
         XFontStruct *font = nullptr;
 
         fd_set inFileDescriptor;
-        int x11FileDescriptor;
+        int x11FileDescriptor = -1;
 
         int32_t x = 0;
         int32_t y = 0;
@@ -174,6 +176,7 @@ namespace SA
         d(new WidgetLinuxPrivate)
     {
         d->parent = parent;
+        d->loop = EventLoop::current();
 
         if (!d->parent)
         {
@@ -235,10 +238,17 @@ namespace SA
 
         WIDGETS_MAP.insert({d->window, this});
         WIDGET_IN_FOCUS = this;
+
+        /* Child windows share the parent's connection */
+        if (!d->parent)
+            d->loop->addDescriptorListener(d->x11FileDescriptor, [this](int){ mainLoopEvent(); });
     }
 
     WidgetLinux::~WidgetLinux()
     {
+        if (!d->parent)
+            d->loop->removeDescriptorListener(d->x11FileDescriptor);
+
         if (d->font)
             XFreeFont(d->display, d->font);
 
@@ -329,7 +339,7 @@ namespace SA
         XMoveWindow(d->display, d->window, d->x, d->y);
 
         sendEvent(SA::EventTypes::MoveEvent,
-                  std::pair<int32_t, int32_t>(d->x, d->y));
+                  SA::Point(d->x, d->y));
     }
 
     void WidgetLinux::resize(uint32_t width, uint32_t height)
@@ -342,7 +352,7 @@ namespace SA
         XResizeWindow(d->display, d->window, d->width, d->height);
 
         sendEvent(SA::EventTypes::ResizeEvent,
-                  std::pair<uint32_t, uint32_t>(d->width, d->height));
+                  SA::Size(d->width, d->height));
     }
 
     void WidgetLinux::setGeometry(int32_t x, int32_t y, uint32_t w, uint32_t h)
@@ -358,10 +368,10 @@ namespace SA
         XMoveResizeWindow(d->display, d->window, d->x, d->y, d->width, d->height);
 
         sendEvent(SA::EventTypes::MoveEvent,
-                  std::pair<int32_t, int32_t>(d->x, d->y));
+                  SA::Point(d->x, d->y));
 
         sendEvent(SA::EventTypes::ResizeEvent,
-                  std::pair<uint32_t, uint32_t>(d->width, d->height));
+                  SA::Size(d->width, d->height));
     }
 
     int32_t WidgetLinux::x()
@@ -559,7 +569,7 @@ namespace SA
                 auto it = WIDGETS_MAP.find(d->event.xany.window);
 
                 if (it != WIDGETS_MAP.end())
-                    return it->second->procEvent(&d->event);
+                    it->second->procEvent(&d->event);
                 else cout << "strange event: " << d->event.xany.window << endl;
             }
         }
@@ -608,7 +618,7 @@ namespace SA
         }
         case FocusIn: if (WIDGET_IN_FOCUS) WIDGET_IN_FOCUS->sendEvent(SA::EventTypes::FocusInEvent, true); break;
         case FocusOut: if (WIDGET_IN_FOCUS) WIDGET_IN_FOCUS->sendEvent(SA::EventTypes::FocusOutEvent, false); break;
-        case MotionNotify: sendEvent(MouseMoveEvent, std::pair<int32_t, int32_t>(event->xmotion.x, event->xmotion.y)); break;
+        case MotionNotify: sendEvent(MouseMoveEvent, SA::Point(event->xmotion.x, event->xmotion.y)); break;
         case Expose: if (event->xexpose.count > 0) break; sendEvent(SA::EventTypes::PaintEvent, true); break;
         case ConfigureNotify: geometryUpdated(); break;
         case SelectionRequest: Clipboard::instance().onSelectionRequestEvent(event); break;
@@ -618,10 +628,11 @@ namespace SA
         }
     }
 
-    void WidgetLinux::sendEvent(EventTypes type, const std::any &value)
+    void WidgetLinux::sendEvent(EventTypes type, const EventValue &value)
     {
+        const SA::Event event(type, value);
         for (SA::Object *object: d->eventListners)
-            object->event(type, value);
+            object->event(event);
     }
 
     void WidgetLinux::focusEvent(bool state)
@@ -692,7 +703,7 @@ namespace SA
             d->x = x;
             d->y = y;
             sendEvent(SA::EventTypes::MoveEvent,
-                      std::pair<int32_t, int32_t>(d->x, d->y));
+                      SA::Point(d->x, d->y));
         }
 
         if (width != d->width || height != d->height)
@@ -700,7 +711,7 @@ namespace SA
             d->width = width;
             d->height = height;
             sendEvent(SA::EventTypes::ResizeEvent,
-                      std::pair<uint32_t, uint32_t>(d->width, d->height));
+                      SA::Size(d->width, d->height));
         }
     }
 
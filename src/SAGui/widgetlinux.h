@@ -63,7 +63,7 @@ namespace SA
 
     private:
         void procEvent(XEvent *event);
-        void sendEvent(SA::EventTypes type, const std::any &value);
+        void sendEvent(SA::EventTypes type, const SA::EventValue &value);
         void focusEvent(bool state);
         void keyEvent(XKeyEvent *event, bool pressed);
         void mouseEvent(MouseButton btn, bool pressed);
@@ -540,7 +540,7 @@ namespace SA
         case WM_MOUSEMOVE:
         {
             sendEvent(SA::EventTypes::MouseMoveEvent,
-                      std::pair<int32_t, int32_t>(GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam)));
+                      SA::Point(GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam)));
 
             if (!d->isHovered)
             {
@@ -581,10 +581,11 @@ namespace SA
         return DefWindowProc(d->hwnd, msg, wParam, lParam);
     }
 
-    void WidgetWindows::sendEvent(EventTypes type, const any &value)
+    void WidgetWindows::sendEvent(EventTypes type, const EventValue &value)
     {
+        const SA::Event event(type, value);
         for (Object *object: d->eventListners)
-            object->event(type, value);
+            object->event(event);
     }
 
     void WidgetWindows::focusEvent(bool state)
@@ -675,7 +676,7 @@ namespace SA
             d->width = static_cast<int>(width);
             d->height = static_cast<int>(height);
             sendEvent(SA::EventTypes::ResizeEvent,
-                      std::pair<uint32_t, uint32_t>(d->width, d->height));
+                      SA::Size(d->width, d->height));
         }
     }
 }
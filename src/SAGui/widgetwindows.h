@@ -61,7 +61,7 @@ namespace SA
         int windowProc(unsigned int msg, unsigned int wParam, long lParam);
 
     private:
-        void sendEvent(SA::EventTypes type, const std::any &value);
+        void sendEvent(SA::EventTypes type, const SA::EventValue &value);
         void focusEvent(bool state);
         void keyEvent(unsigned int param, bool pressed);
         void mouseEvent(SA::MouseButton btn, bool pressed);
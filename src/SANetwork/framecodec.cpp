@@ -0,0 +1,322 @@
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+
+#include "framecodec.h"
+#include "tcpsocket.h"
+#include "handlerlist.h"
+
+static const size_t DefaultMaxFrameSize = 1024 * 1024;
+static const size_t U32HeaderSize = 4;
+static const size_t MaxVarintSize = 5;
+
+namespace SA
+{
+    struct FrameCodec::FrameCodecPrivate
+    {
+        SA::FrameCodec::Framing framing = SA::FrameCodec::LengthU32;
+        std::string delimiter = "\n";
+        size_t fixedSize = 1;
+        size_t maxFrameSize = DefaultMaxFrameSize;
+        bool isFailed = false;
+
+        // Bytes of the pending frame already searched for the delimiter
+        size_t scanned = 0;
+
+        SA::HandlerList<void (std::span<const char>)> frameHandlers;
+        SA::HandlerList<void (SA::FrameCodec::Error)> errorHandlers;
+    };
+
+    FrameCodec::FrameCodec():
+        d(new FrameCodecPrivate)
+    {
+    }
+
+    FrameCodec::~FrameCodec()
+    {
+        delete d;
+    }
+
+    void FrameCodec::setFraming(Framing framing)
+    {
+        d->framing = framing;
+        reset();
+    }
+
+    FrameCodec::Framing FrameCodec::framing()
+    {
+        return d->framing;
+    }
+
+    void FrameCodec::setDelimiter(const std::string &delimiter)
+    {
+        if (delimiter.empty()) return;
+
+        d->delimiter = delimiter;
+        setFraming(Delimiter);
+    }
+
+    void FrameCodec::setFixedSize(size_t size)
+    {
+        if (size == 0) return;
+
+        d->fixedSize = size;
+        setFraming(FixedSize);
+    }
+
+    bool FrameCodec::setMaxFrameSize(size_t size)
+    {
+        // Larger frames could never be read, the socket fails first
+        size_t overhead = std::max(MaxVarintSize, d->delimiter.size());
+        if (size > SA::TcpSocket::MaxReadSize - overhead) return false;
+
+        d->maxFrameSize = size;
+        return true;
+    }
+
+    size_t FrameCodec::maxFrameSize()
+    {
+        return d->maxFrameSize;
+    }
+
+    int FrameCodec::addFrameHandler(const std::function<void (std::span<const char>)> &func)
+    {
+        return d->frameHandlers.add(func);
+    }
+
+    void FrameCodec::removeFrameHandler(int id)
+    {
+        d->frameHandlers.remove(id);
+    }
+
+    int FrameCodec::addErrorHandler(const std::function<void (SA::FrameCodec::Error)> &func)
+    {
+        return d->errorHandlers.add(func);
+    }
+
+    void FrameCodec::removeErrorHandler(int id)
+    {
+        d->errorHandlers.remove(id);
+    }
+
+    size_t FrameCodec::decode(std::span<const char> data)
+    {
+        if (d->isFailed) return data.size();
+
+        size_t consumed = 0;
+        switch (d->framing)
+        {
+        case LengthU32:
+        case LengthVarint: consumed = decodeLength(data); break;
+        case Delimiter: consumed = decodeDelimited(data); break;
+        case FixedSize: consumed = decodeFixed(data); break;
+        }
+
+        return d->isFailed ? data.size() : consumed;
+    }
+
+    bool FrameCodec::isFailed()
+    {
+        return d->isFailed;
+    }
+
+    void FrameCodec::reset()
+    {
+        d->isFailed = false;
+        d->scanned = 0;
+    }
+
+    bool FrameCodec::encode(std::span<const char> payload, std::vector<char> &out)
+    {
+        if (payload.size() > d->maxFrameSize) return false;
+
+        switch (d->framing)
+        {
+        case LengthU32:
+        {
+            if (payload.size() > UINT32_MAX) return false;
+
+            uint32_t length = static_cast<uint32_t>(payload.size());
+            out.push_back(static_cast<char>(length >> 24));
+            out.push_back(static_cast<char>(length >> 16));
+            out.push_back(static_cast<char>(length >> 8));
+            out.push_back(static_cast<char>(length));
+            break;
+        }
+        case LengthVarint:
+        {
+            uint64_t length = payload.size();
+
+            do
+            {
+                uint8_t byte = length & 0x7F;
+                length >>= 7;
+                out.push_back(static_cast<char>(length ? byte | 0x80 : byte));
+            }
+            while (length);
+            break;
+        }
+        case Delimiter:
+        {
+            // The receiver would cut the payload at the delimiter
+            std::string_view view(payload.data(), payload.size());
+            if (view.find(d->delimiter) != std::string_view::npos) return false;
+
+            out.insert(out.end(), payload.begin(), payload.end());
+            out.insert(out.end(), d->delimiter.begin(), d->delimiter.end());
+            return true;
+        }
+        case FixedSize:
+            if (payload.size() != d->fixedSize) return false;
+            break;
+        }
+
+        out.insert(out.end(), payload.begin(), payload.end());
+        return true;
+    }
+
+    std::vector<char> FrameCodec::encode(std::span<const char> payload)
+    {
+        std::vector<char> out;
+        out.reserve(payload.size() + std::max(MaxVarintSize, d->delimiter.size()));
+        encode(payload, out);
+        return out;
+    }
+
+    int FrameCodec::attach(SA::TcpSocket &socket)
+    {
+        SA::TcpSocket *target = &socket;
+        return socket.addReadHandler([this, target](std::span<const char> data) {
+            size_t consumed = decode(data);
+            if (d->isFailed && target->isConnected())
+                target->disconnect();
+            return consumed;
+        });
+    }
+
+    size_t FrameCodec::decodeLength(std::span<const char> data)
+    {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data.data());
+        size_t consumed = 0;
+
+        while (!d->isFailed)
+        {
+            size_t available = data.size() - consumed;
+            const uint8_t *header = bytes + consumed;
+            uint64_t length = 0;
+            size_t headerSize = 0;
+
+            if (d->framing == LengthU32)
+            {
+                if (available < U32HeaderSize) break;
+
+                length = (static_cast<uint32_t>(header[0]) << 24) | (static_cast<uint32_t>(header[1]) << 16) |
+                         (static_cast<uint32_t>(header[2]) << 8) | static_cast<uint32_t>(header[3]);
+                headerSize = U32HeaderSize;
+            }
+            else
+            {
+                bool isComplete = false;
+                while (headerSize < available && headerSize < MaxVarintSize)
+                {
+                    uint8_t byte = header[headerSize];
+                    length |= static_cast<uint64_t>(byte & 0x7F) << (7 * headerSize);
+                    ++headerSize;
+
+                    if (!(byte & 0x80))
+                    {
+                        isComplete = true;
+                        break;
+                    }
+                }
+
+                if (!isComplete)
+                {
+                    if (headerSize == MaxVarintSize) fail(MalformedLength);
+                    break;
+                }
+            }
+
+            // Known before the payload arrives, don't wait for it
+            if (length > d->maxFrameSize)
+            {
+                fail(FrameTooLarge);
+                break;
+            }
+
+            if (available - headerSize < length) break;
+
+            emitFrame(data.subspan(consumed + headerSize, static_cast<size_t>(length)));
+            consumed += headerSize + static_cast<size_t>(length);
+        }
+
+        return consumed;
+    }
+
+    size_t FrameCodec::decodeDelimited(std::span<const char> data)
+    {
+        std::string_view view(data.data(), data.size());
+        const std::string &delimiter = d->delimiter;
+        size_t consumed = 0;
+
+        while (!d->isFailed)
+        {
+            // Search only what came since the last call, frames that arrive
+            // in many small pieces would be scanned over and over otherwise
+            size_t position = view.find(delimiter, consumed + d->scanned);
+
+            if (position == std::string_view::npos)
+            {
+                size_t pending = view.size() - consumed;
+                d->scanned = pending >= delimiter.size() ? pending - delimiter.size() + 1 : 0;
+
+                if (d->scanned > d->maxFrameSize)
+                    fail(FrameTooLarge);
+                break;
+            }
+
+            size_t frameSize = position - consumed;
+            if (frameSize > d->maxFrameSize)
+            {
+                fail(FrameTooLarge);
+                break;
+            }
+
+            d->scanned = 0;
+            emitFrame(data.subspan(consumed, frameSize));
+            consumed = position + delimiter.size();
+        }
+
+        return consumed;
+    }
+
+    size_t FrameCodec::decodeFixed(std::span<const char> data)
+    {
+        if (d->fixedSize > d->maxFrameSize)
+        {
+            fail(FrameTooLarge);
+            return 0;
+        }
+
+        size_t consumed = 0;
+        while (!d->isFailed && data.size() - consumed >= d->fixedSize)
+        {
+            emitFrame(data.subspan(consumed, d->fixedSize));
+            consumed += d->fixedSize;
+        }
+
+        return consumed;
+    }
+
+    void FrameCodec::emitFrame(std::span<const char> frame)
+    {
+        d->frameHandlers(frame);
+    }
+
+    void FrameCodec::fail(SA::FrameCodec::Error error)
+    {
+        d->isFailed = true;
+        d->scanned = 0;
+        d->errorHandlers(error);
+    }
+}
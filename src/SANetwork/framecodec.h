@@ -0,0 +1,87 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <span>
+#include <functional>
+
+namespace SA
+{
+    class TcpSocket;
+
+    // Splits a byte stream into frames. Frames are handed out as views of the
+    // bytes passed to decode(), what is left of an incomplete frame is not
+    // consumed and comes back with the next read, so nothing is copied.
+    class FrameCodec
+    {
+    public:
+        enum Framing
+        {
+            LengthU32,      // 4 byte big-endian length before the payload
+            LengthVarint,   // LEB128 length before the payload
+            Delimiter,      // payload followed by the delimiter
+            FixedSize       // payloads of one size, no header
+        };
+
+        enum Error
+        {
+            FrameTooLarge,
+            MalformedLength
+        };
+
+        FrameCodec();
+        ~FrameCodec();
+
+        // LengthU32 by default
+        void setFraming(Framing framing);
+        Framing framing();
+
+        // Also switch the framing to Delimiter and FixedSize
+        void setDelimiter(const std::string &delimiter);
+        void setFixedSize(size_t size);
+
+        // 1 MiB by default, the header or delimiter does not count. False if
+        // a frame of that size would not fit into the read buffer of the
+        // socket together with its header or delimiter (TcpSocket::MaxReadSize).
+        bool setMaxFrameSize(size_t size);
+        size_t maxFrameSize();
+
+        // The view is only valid during the call
+        int addFrameHandler(const std::function<void (std::span<const char> frame)> &func);
+        void removeFrameHandler(int id);
+
+        // After an error everything is dropped until reset()
+        int addErrorHandler(const std::function<void (SA::FrameCodec::Error error)> &func);
+        void removeErrorHandler(int id);
+
+        // Returns how many bytes the complete frames in data took, the codec
+        // must be the only consumer of the stream
+        size_t decode(std::span<const char> data);
+        bool isFailed();
+        void reset();
+
+        // Appends the framed payload to out, false if it can't be framed
+        bool encode(std::span<const char> payload, std::vector<char> &out);
+        std::vector<char> encode(std::span<const char> payload);
+
+        // Decodes what the socket reads and disconnects it on errors.
+        // Returns the id of the read handler.
+        int attach(SA::TcpSocket &socket);
+
+    private:
+        size_t decodeLength(std::span<const char> data);
+        size_t decodeDelimited(std::span<const char> data);
+        size_t decodeFixed(std::span<const char> data);
+        void emitFrame(std::span<const char> frame);
+        void fail(SA::FrameCodec::Error error);
+
+        FrameCodec(const SA::FrameCodec &) = delete;
+        FrameCodec(SA::FrameCodec &&) = delete;
+        void operator = (const SA::FrameCodec &) = delete;
+        void operator = (SA::FrameCodec &&) = delete;
+
+        struct FrameCodecPrivate;
+        FrameCodecPrivate * const d;
+
+    }; // class FrameCodec
+} // namespace SA
@@ -0,0 +1,1174 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "httpserver.h"
+#include "tcpserver.h"
+#include "tcpsocket.h"
+#include "websocket.h"
+
+#ifdef SACore
+#include "eventloop.h"
+#endif
+
+static const size_t DefaultMaxHeaderSize = 16 * 1024;
+static const size_t DefaultMaxBodySize = 1024 * 1024;
+static const int DefaultIdleTimeout = 30000;
+
+static bool equalsIgnoreCase(std::string_view left, std::string_view right)
+{
+    if (left.size() != right.size()) return false;
+
+    for (size_t i=0; i<left.size(); ++i)
+    {
+        char a = left[i], b = right[i];
+        if (a >= 'A' && a <= 'Z') a += 'a' - 'A';
+        if (b >= 'A' && b <= 'Z') b += 'a' - 'A';
+        if (a != b) return false;
+    }
+    return true;
+}
+
+static std::string_view trimmed(std::string_view value)
+{
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+    return value;
+}
+
+// RFC 9110 token characters, what methods and header names are made of
+static bool isToken(std::string_view value)
+{
+    if (value.empty()) return false;
+
+    for (char c : value)
+    {
+        bool isAlnum = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        if (!isAlnum && std::string_view("!#$%&'*+-.^_`|~").find(c) == std::string_view::npos)
+            return false;
+    }
+    return true;
+}
+
+// Comma separated list, as in Connection: keep-alive, Upgrade
+static bool hasToken(std::string_view list, std::string_view token)
+{
+    while (!list.empty())
+    {
+        size_t comma = list.find(',');
+        if (equalsIgnoreCase(trimmed(list.substr(0, comma)), token)) return true;
+        if (comma == std::string_view::npos) break;
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+static bool hasLineBreak(std::string_view value)
+{
+    return value.find_first_of("\r\n") != std::string_view::npos;
+}
+
+static std::string_view reasonPhrase(int status)
+{
+    switch (status)
+    {
+    case 100: return "Continue";
+    case 101: return "Switching Protocols";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 307: return "Temporary Redirect";
+    case 308: return "Permanent Redirect";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 409: return "Conflict";
+    case 411: return "Length Required";
+    case 413: return "Content Too Large";
+    case 414: return "URI Too Long";
+    case 415: return "Unsupported Media Type";
+    case 426: return "Upgrade Required";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 505: return "HTTP Version Not Supported";
+    default: return "Unknown";
+    }
+}
+
+static std::string_view contentTypeFor(std::string_view path)
+{
+    static const std::pair<std::string_view, std::string_view> types[] = {
+        {".html", "text/html; charset=utf-8"}, {".htm", "text/html; charset=utf-8"},
+        {".css", "text/css; charset=utf-8"}, {".js", "text/javascript; charset=utf-8"},
+        {".mjs", "text/javascript; charset=utf-8"}, {".json", "application/json"},
+        {".txt", "text/plain; charset=utf-8"}, {".xml", "application/xml"},
+        {".svg", "image/svg+xml"}, {".png", "image/png"}, {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"}, {".gif", "image/gif"}, {".webp", "image/webp"},
+        {".ico", "image/x-icon"}, {".wasm", "application/wasm"}, {".pdf", "application/pdf"},
+        {".mp4", "video/mp4"}, {".woff", "font/woff"}, {".woff2", "font/woff2"}};
+
+    size_t dot = path.rfind('.');
+    if (dot != std::string_view::npos && path.find('/', dot) == std::string_view::npos)
+    {
+        std::string_view extension = path.substr(dot);
+        for (const auto &type : types)
+            if (equalsIgnoreCase(type.first, extension)) return type.second;
+    }
+
+    return "application/octet-stream";
+}
+
+// False on malformed escapes
+static bool percentDecode(std::string_view value, std::string &out)
+{
+    out.clear();
+    out.reserve(value.size());
+
+    for (size_t i=0; i<value.size(); ++i)
+    {
+        if (value[i] != '%')
+        {
+            out.push_back(value[i]);
+            continue;
+        }
+
+        unsigned char byte = 0;
+        if (i + 2 >= value.size() ||
+            std::from_chars(value.data() + i + 1, value.data() + i + 3, byte, 16).ptr != value.data() + i + 3)
+            return false;
+
+        out.push_back(static_cast<char>(byte));
+        i += 2;
+    }
+    return true;
+}
+
+static void append(std::vector<char> &out, std::string_view text)
+{
+    out.insert(out.end(), text.begin(), text.end());
+}
+
+template<typename T>
+static void appendNumber(std::vector<char> &out, T value, int base = 10)
+{
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value, base);
+    out.insert(out.end(), digits, result.ptr);
+}
+
+namespace SA
+{
+    struct StringHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view value) const { return std::hash<std::string_view>{}(value); }
+    };
+
+    struct HttpServer::Connection
+    {
+        int id = -1;
+        SA::TcpSocket *socket = nullptr;
+
+        // Pipelined requests that came while a response was open, and the
+        // rest after them. Empty most of the time, then requests are parsed
+        // in the read buffer of the socket.
+        std::string pending;
+
+        // Request being received: bytes searched for the end of the head,
+        // and its full size once the head is known
+        size_t scanned = 0;
+        size_t requestSize = 0;
+        bool isContinueSent = false;
+        std::vector<SA::HttpHeader> headers;
+
+        // Response of the request in flight
+        uint32_t sequence = 0;
+        bool isResponseOpen = false;
+        bool isHeadSent = false;
+        bool isChunked = false;
+        bool isHeadRequest = false;
+        bool isKeepAlive = true;
+        int versionMinor = 1;
+        int status = 200;
+        std::string responseHeaders;
+
+        // Set once the connection is upgraded, it gets every byte from then on
+        std::unique_ptr<SA::WebSocket> webSocket;
+
+        // Handlers of this connection on the stack, it is erased after them
+        int dispatchDepth = 0;
+        bool isGone = false;
+        bool isClosing = false;
+        std::chrono::steady_clock::time_point lastActivity;
+    };
+
+    struct MethodHandler
+    {
+        std::string method;
+        std::shared_ptr<SA::HttpServer::Handler> handler;
+    };
+
+    using MethodHandlers = std::vector<MethodHandler>;
+
+    struct RouteNode
+    {
+        std::unordered_map<std::string, std::unique_ptr<RouteNode>, StringHash, std::equal_to<> > children;
+        MethodHandlers handlers;
+    };
+
+    struct HttpServer::HttpServerPrivate
+    {
+        SA::TcpServer server;
+        std::unordered_map<int, SA::HttpServer::Connection> connections;
+
+        std::unordered_map<std::string, MethodHandlers, StringHash, std::equal_to<> > exactRoutes;
+        RouteNode prefixRoutes;
+        std::vector<const MethodHandlers*> candidates;
+        std::shared_ptr<SA::HttpServer::Handler> defaultHandler;
+        std::unordered_map<std::string, std::shared_ptr<std::function<void (SA::WebSocket &)> >,
+                           StringHash, std::equal_to<> > webSocketRoutes;
+
+        size_t maxHeaderSize = DefaultMaxHeaderSize;
+        size_t maxBodySize = DefaultMaxBodySize;
+        int idleTimeout = DefaultIdleTimeout;
+        int idleTimer = -1;
+
+        // Formatted once a second
+        std::time_t dateTime = 0;
+        std::string dateLine;
+
+#ifdef SACore
+        SA::EventLoop *loop = nullptr;
+#endif
+
+        std::chrono::steady_clock::time_point now()
+        {
+#ifdef SACore
+            return loop->clock().now();
+#else
+            return std::chrono::steady_clock::now();
+#endif
+        }
+    };
+
+    // Exact method first, then routes for every method, GET serves HEAD
+    static const std::shared_ptr<SA::HttpServer::Handler> *matchMethod(const MethodHandlers &handlers, std::string_view method)
+    {
+        for (const MethodHandler &handler : handlers)
+            if (handler.method == method) return &handler.handler;
+
+        for (const MethodHandler &handler : handlers)
+            if (handler.method.empty()) return &handler.handler;
+
+        if (method == "HEAD")
+            for (const MethodHandler &handler : handlers)
+                if (handler.method == "GET") return &handler.handler;
+
+        return nullptr;
+    }
+
+    static std::string allowedMethods(const MethodHandlers &handlers)
+    {
+        std::string allow;
+        bool hasGet = false, hasHead = false;
+
+        for (const MethodHandler &handler : handlers)
+        {
+            if (!allow.empty()) allow += ", ";
+            allow += handler.method;
+            hasGet |= handler.method == "GET";
+            hasHead |= handler.method == "HEAD";
+        }
+
+        if (hasGet && !hasHead) allow += ", HEAD";
+        return allow;
+    }
+
+    static void removeMethod(MethodHandlers &handlers, std::string_view method)
+    {
+        handlers.erase(std::remove_if(handlers.begin(), handlers.end(),
+                                      [method](const MethodHandler &handler) { return handler.method == method; }),
+                       handlers.end());
+    }
+
+    std::string_view HttpRequest::header(std::string_view name) const
+    {
+        for (const SA::HttpHeader &header : headers)
+            if (equalsIgnoreCase(header.name, name)) return header.value;
+
+        return {};
+    }
+
+    void HttpResponse::setStatus(int status)
+    {
+        HttpServer::Connection *connection = server ? server->findResponse(*this) : nullptr;
+        if (!connection || connection->isHeadSent || status < 200 || status > 999) return;
+
+        connection->status = status;
+    }
+
+    void HttpResponse::setHeader(std::string_view name, std::string_view value)
+    {
+        HttpServer::Connection *connection = server ? server->findResponse(*this) : nullptr;
+        if (!connection || connection->isHeadSent || !isToken(name) || hasLineBreak(value)) return;
+
+        connection->responseHeaders.append(name).append(": ").append(value).append("\r\n");
+    }
+
+    bool HttpResponse::send(std::string_view body)
+    {
+        return send(body, {});
+    }
+
+    bool HttpResponse::send(std::string_view body, std::string_view contentType)
+    {
+        HttpServer::Connection *connection = server ? server->findResponse(*this) : nullptr;
+        if (!connection || connection->isHeadSent || hasLineBreak(contentType)) return false;
+
+        std::vector<char> out;
+        out.reserve(256 + connection->responseHeaders.size() + body.size());
+        server->writeHead(connection, out, body.size(), contentType);
+
+        if (server->isBodyAllowed(connection))
+            append(out, body);
+
+        connection->socket->send(std::move(out));
+        server->finishResponse(connection);
+        return true;
+    }
+
+    bool HttpResponse::sendFile(const std::string &path, std::string_view contentType)
+    {
+        HttpServer::Connection *connection = server ? server->findResponse(*this) : nullptr;
+        if (!connection || connection->isHeadSent || hasLineBreak(contentType)) return false;
+
+        std::error_code error;
+        if (!std::filesystem::is_regular_file(path, error)) return false;
+
+        uintmax_t size = std::filesystem::file_size(path, error);
+        if (error) return false;
+
+        std::vector<char> out;
+        out.reserve(256 + connection->responseHeaders.size());
+        server->writeHead(connection, out, size, contentType.empty() ? contentTypeFor(path) : contentType);
+        connection->socket->send(std::move(out));
+
+        // The head promised size bytes, a file that can't be read any more
+        // ends the connection
+        if (server->isBodyAllowed(connection) && size > 0 &&
+            !connection->socket->sendFile(path, 0, static_cast<size_t>(size)))
+        {
+            server->closeConnection(connection);
+            return false;
+        }
+
+        server->finishResponse(connection);
+        return true;
+    }
+
+    bool HttpResponse::write(std::string_view data)
+    {
+        HttpServer::Connection *connection = server ? server->findResponse(*this) : nullptr;
+        if (!connection) return false;
+
+        std::vector<char> out;
+        out.reserve(256 + data.size());
+
+        if (!connection->isHeadSent)
+        {
+            connection->isChunked = connection->versionMinor > 0;
+
+            // Without chunks the end of the body is the end of the connection
+            if (!connection->isChunked) connection->isKeepAlive = false;
+
+            server->writeHead(connection, out, -1, {});
+        }
+
+        if (!data.empty() && server->isBodyAllowed(connection))
+        {
+            if (connection->isChunked)
+            {
+                appendNumber(out, data.size(), 16);
+                append(out, "\r\n");
+                append(out, data);
+                append(out, "\r\n");
+            }
+            else
+            {
+                append(out, data);
+            }
+        }
+
+        if (!out.empty()) connection->socket->send(std::move(out));
+        return true;
+    }
+
+    bool HttpResponse::end()
+    {
+        HttpServer::Connection *connection = server ? server->findResponse(*this) : nullptr;
+        if (!connection) return false;
+
+        if (!connection->isHeadSent) return send({});
+
+        if (connection->isChunked && server->isBodyAllowed(connection))
+            connection->socket->send(std::vector<char>{'0', '\r', '\n', '\r', '\n'});
+
+        server->finishResponse(connection);
+        return true;
+    }
+
+    bool HttpResponse::isOpen() const
+    {
+        return server && server->findResponse(*this);
+    }
+
+    HttpServer::HttpServer():
+        d(new HttpServerPrivate)
+    {
+#ifdef SACore
+        d->loop = SA::EventLoop::current();
+#endif
+
+        d->server.addConnectionHandler([this](int id, SA::TcpSocket &socket) { addConnection(id, socket); });
+        d->server.addDisconnectionHandler([this](int id) {
+            auto it = d->connections.find(id);
+            if (it == d->connections.end()) return;
+
+            if (it->second.webSocket)
+                it->second.webSocket->processDisconnected();
+
+            // Erased once its handlers return
+            if (it->second.dispatchDepth > 0) it->second.isGone = true;
+            else d->connections.erase(it);
+        });
+    }
+
+    HttpServer::~HttpServer()
+    {
+        close();
+        delete d;
+    }
+
+    bool HttpServer::listen(uint16_t port)
+    {
+        if (!d->server.listen(port)) return false;
+
+        scheduleIdleSweep();
+        return true;
+    }
+
+    void HttpServer::close()
+    {
+#ifdef SACore
+        if (d->idleTimer > -1)
+            d->loop->killTimer(d->idleTimer);
+#endif
+        d->idleTimer = -1;
+        d->server.close();
+    }
+
+    bool HttpServer::isListen()
+    {
+        return d->server.isListen();
+    }
+
+    void HttpServer::addRoute(const std::string &method, const std::string &path, const Handler &handler)
+    {
+        if (!handler || path.empty() || path.front() != '/') return;
+
+        MethodHandlers *handlers = nullptr;
+        std::string_view view(path);
+
+        if (view == "/*" || view.ends_with("/*"))
+        {
+            RouteNode *node = &d->prefixRoutes;
+            view.remove_suffix(2);
+
+            while (!view.empty())
+            {
+                size_t slash = view.find('/', 1);
+                std::string_view segment = view.substr(1, slash == std::string_view::npos ? slash : slash - 1);
+                view.remove_prefix(slash == std::string_view::npos ? view.size() : slash);
+                if (segment.empty()) continue;
+
+                std::unique_ptr<RouteNode> &child = node->children[std::string(segment)];
+                if (!child) child = std::make_unique<RouteNode>();
+                node = child.get();
+            }
+
+            handlers = &node->handlers;
+        }
+        else
+        {
+            handlers = &d->exactRoutes[path];
+        }
+
+        removeMethod(*handlers, method);
+        handlers->push_back({method, std::make_shared<Handler>(handler)});
+    }
+
+    void HttpServer::removeRoute(const std::string &method, const std::string &path)
+    {
+        std::string_view view(path);
+
+        if (view == "/*" || view.ends_with("/*"))
+        {
+            RouteNode *node = &d->prefixRoutes;
+            view.remove_suffix(2);
+
+            while (node && !view.empty())
+            {
+                size_t slash = view.find('/', 1);
+                std::string_view segment = view.substr(1, slash == std::string_view::npos ? slash : slash - 1);
+                view.remove_prefix(slash == std::string_view::npos ? view.size() : slash);
+                if (segment.empty()) continue;
+
+                auto it = node->children.find(segment);
+                node = it == node->children.end() ? nullptr : it->second.get();
+            }
+
+            if (node) removeMethod(node->handlers, method);
+        }
+        else
+        {
+            auto it = d->exactRoutes.find(path);
+            if (it == d->exactRoutes.end()) return;
+
+            removeMethod(it->second, method);
+            if (it->second.empty()) d->exactRoutes.erase(it);
+        }
+    }
+
+    void HttpServer::addStaticDirectory(const std::string &prefix, const std::string &directory)
+    {
+        std::string base = prefix;
+        while (!base.empty() && base.back() == '/') base.pop_back();
+
+        Handler handler = [base, directory](const SA::HttpRequest &request, SA::HttpResponse &response) {
+            std::string relative;
+            bool isValid = percentDecode(request.path.substr(std::min(base.size(), request.path.size())), relative);
+
+            // Nothing outside the directory: no parent segments, no other
+            // separators, no embedded zeros
+            std::string_view rest(relative);
+            while (isValid && !rest.empty())
+            {
+                size_t slash = rest.find('/');
+                std::string_view segment = rest.substr(0, slash);
+                if (segment == ".." || segment.find_first_of(std::string_view("\\\0:", 3)) != std::string_view::npos)
+                    isValid = false;
+                rest.remove_prefix(slash == std::string_view::npos ? rest.size() : slash + 1);
+            }
+
+            if (relative.empty() || relative.back() == '/')
+                relative += "index.html";
+
+            if (!isValid || !response.sendFile(directory + (relative.front() == '/' ? "" : "/") + relative))
+            {
+                response.setStatus(404);
+                response.send(reasonPhrase(404), "text/plain; charset=utf-8");
+            }
+        };
+
+        addRoute("GET", base + "/*", handler);
+    }
+
+    void HttpServer::addWebSocketRoute(const std::string &path, const std::function<void (SA::WebSocket &)> &handler)
+    {
+        if (!handler) return;
+        d->webSocketRoutes[path] = std::make_shared<std::function<void (SA::WebSocket &)> >(handler);
+    }
+
+    void HttpServer::removeWebSocketRoute(const std::string &path)
+    {
+        d->webSocketRoutes.erase(path);
+    }
+
+    void HttpServer::setDefaultHandler(const Handler &handler)
+    {
+        d->defaultHandler = handler ? std::make_shared<Handler>(handler) : nullptr;
+    }
+
+    bool HttpServer::setMaxHeaderSize(size_t size)
+    {
+        // A larger request could never be read, the socket fails first
+        if (size > SA::TcpSocket::MaxReadSize || d->maxBodySize > SA::TcpSocket::MaxReadSize - size)
+            return false;
+
+        d->maxHeaderSize = size;
+        return true;
+    }
+
+    bool HttpServer::setMaxBodySize(size_t size)
+    {
+        if (size > SA::TcpSocket::MaxReadSize || d->maxHeaderSize > SA::TcpSocket::MaxReadSize - size)
+            return false;
+
+        d->maxBodySize = size;
+        return true;
+    }
+
+    void HttpServer::setIdleTimeout(int timeout)
+    {
+        d->idleTimeout = std::max(timeout, 0);
+
+#ifdef SACore
+        if (d->idleTimer > -1)
+            d->loop->killTimer(d->idleTimer);
+#endif
+        d->idleTimer = -1;
+
+        if (d->server.isListen())
+            scheduleIdleSweep();
+    }
+
+    size_t HttpServer::connectionCount()
+    {
+        return d->connections.size();
+    }
+
+    void HttpServer::addConnection(int id, SA::TcpSocket &socket)
+    {
+        Connection &connection = d->connections[id];
+        connection.id = id;
+        connection.socket = &socket;
+        connection.lastActivity = d->now();
+
+        socket.addReadHandler([this, id](std::span<const char> data) { return processData(id, data); });
+    }
+
+    size_t HttpServer::processData(int id, std::span<const char> data)
+    {
+        auto it = d->connections.find(id);
+        if (it == d->connections.end()) return data.size();
+
+        Connection *connection = &it->second;
+        if (connection->isClosing) return data.size();
+
+        // A slow client in the middle of a request is not idle
+        connection->lastActivity = d->now();
+
+        // Behind a response that is still open, or behind what came then
+        if (connection->isResponseOpen || !connection->pending.empty())
+        {
+            if (!isPendingAllowed(connection, data.size()))
+            {
+                closeConnection(connection);
+                return data.size();
+            }
+
+            connection->pending.append(data.data(), data.size());
+            if (!connection->isResponseOpen) processPending(connection);
+            return data.size();
+        }
+
+        ++connection->dispatchDepth;
+        size_t consumed = processRequests(connection, data);
+
+        // Requests after an open response wait for it, the socket would
+        // only offer them again with the next read
+        if (!connection->isGone && !connection->isClosing && connection->isResponseOpen && consumed < data.size())
+        {
+            if (isPendingAllowed(connection, data.size() - consumed))
+                connection->pending.assign(data.data() + consumed, data.size() - consumed);
+            else
+                closeConnection(connection);
+
+            consumed = data.size();
+        }
+
+        endDispatch(connection);
+        return consumed;
+    }
+
+    void HttpServer::processPending(Connection *connection)
+    {
+        ++connection->dispatchDepth;
+
+        // Requests are views of it, it can't grow while they are handled
+        std::string pending = std::move(connection->pending);
+        size_t consumed = processRequests(connection, pending);
+
+        if (!connection->isGone && !connection->isClosing)
+        {
+            pending.erase(0, consumed);
+            pending.append(connection->pending);
+            connection->pending = std::move(pending);
+        }
+
+        endDispatch(connection);
+    }
+
+    bool HttpServer::isPendingAllowed(Connection *connection, size_t size)
+    {
+        // One largest request may wait behind an open response. A client
+        // that sends more does not read its responses, it only costs memory.
+        if (!connection->isResponseOpen) return true;
+        return connection->pending.size() + size <= d->maxHeaderSize + d->maxBodySize;
+    }
+
+    void HttpServer::endDispatch(Connection *connection)
+    {
+        if (--connection->dispatchDepth == 0 && connection->isGone)
+            d->connections.erase(connection->id);
+    }
+
+    size_t HttpServer::processRequests(Connection *connection, std::span<const char> data)
+    {
+        size_t consumed = 0;
+
+        while (consumed < data.size() && !connection->isResponseOpen && !connection->isClosing &&
+               !connection->isGone && !connection->webSocket)
+        {
+            size_t size = parseRequest(connection, data.subspan(consumed));
+            if (size == 0) break;
+            consumed += size;
+        }
+
+        // What follows an upgrade are frames
+        if (connection->webSocket && !connection->isGone && consumed < data.size())
+            consumed += connection->webSocket->decode(data.subspan(consumed));
+
+        return (connection->isClosing || connection->isGone) ? data.size() : consumed;
+    }
+
+    size_t HttpServer::parseRequest(Connection *connection, std::span<const char> data)
+    {
+        std::string_view view(data.data(), data.size());
+
+        // Waiting for the body of a request whose head was seen already
+        if (connection->requestSize > view.size()) return 0;
+
+        // Empty lines before a request are allowed
+        size_t start = 0;
+        while (start + 1 < view.size() && view[start] == '\r' && view[start + 1] == '\n')
+            start += 2;
+
+        size_t headEnd = view.find("\r\n\r\n", std::max(start, connection->scanned));
+        if (headEnd == std::string_view::npos)
+        {
+            connection->scanned = view.size() >= 3 ? view.size() - 3 : 0;
+            if (view.size() - start > d->maxHeaderSize) sendError(connection, 431);
+            return 0;
+        }
+
+        if (headEnd - start > d->maxHeaderSize)
+        {
+            sendError(connection, 431);
+            return 0;
+        }
+
+        SA::HttpRequest request;
+        request.connection = connection->id;
+
+        // Request line: method SP target SP HTTP/1.x
+        std::string_view head = view.substr(start, headEnd - start);
+        size_t lineEnd = head.find("\r\n");
+        std::string_view line = head.substr(0, lineEnd);
+        head.remove_prefix(lineEnd == std::string_view::npos ? head.size() : lineEnd + 2);
+
+        size_t firstSpace = line.find(' ');
+        size_t lastSpace = line.rfind(' ');
+        if (firstSpace == std::string_view::npos || firstSpace == lastSpace)
+        {
+            sendError(connection, 400);
+            return 0;
+        }
+
+        request.method = line.substr(0, firstSpace);
+        request.target = line.substr(firstSpace + 1, lastSpace - firstSpace - 1);
+        std::string_view version = line.substr(lastSpace + 1);
+
+        if (!isToken(request.method) || request.target.empty() ||
+            request.target.find_first_of(" \t\r\n") != std::string_view::npos ||
+            version.size() != 8 || !version.starts_with("HTTP/") || version[6] != '.')
+        {
+            sendError(connection, 400);
+            return 0;
+        }
+
+        if (version[5] != '1' || (version[7] != '0' && version[7] != '1'))
+        {
+            sendError(connection, 505);
+            return 0;
+        }
+
+        request.versionMinor = version[7] - '0';
+        connection->versionMinor = request.versionMinor;
+
+        size_t question = request.target.find('?');
+        request.path = request.target.substr(0, question);
+        if (question != std::string_view::npos)
+            request.query = request.target.substr(question + 1);
+
+        // Header fields, no obsolete line folding
+        std::vector<SA::HttpHeader> &headers = connection->headers;
+        headers.clear();
+
+        size_t contentLength = 0;
+        bool hasContentLength = false;
+        bool expectsContinue = false;
+        std::string_view connectionHeader;
+
+        while (!head.empty())
+        {
+            lineEnd = head.find("\r\n");
+            line = head.substr(0, lineEnd);
+            head.remove_prefix(lineEnd == std::string_view::npos ? head.size() : lineEnd + 2);
+
+            size_t colon = line.find(':');
+            if (colon == std::string_view::npos || !isToken(line.substr(0, colon)) || hasLineBreak(line))
+            {
+                sendError(connection, 400);
+                return 0;
+            }
+
+            SA::HttpHeader header{line.substr(0, colon), trimmed(line.substr(colon + 1))};
+            headers.push_back(header);
+
+            if (equalsIgnoreCase(header.name, "Content-Length"))
+            {
+                size_t length = 0;
+                auto result = std::from_chars(header.value.data(), header.value.data() + header.value.size(), length);
+
+                // Repeated lengths have to agree, or the body is ambiguous
+                if (header.value.empty() || result.ec != std::errc() ||
+                    result.ptr != header.value.data() + header.value.size() ||
+                    (hasContentLength && length != contentLength))
+                {
+                    sendError(connection, 400);
+                    return 0;
+                }
+
+                contentLength = length;
+                hasContentLength = true;
+            }
+            else if (equalsIgnoreCase(header.name, "Transfer-Encoding"))
+            {
+                sendError(connection, 501);
+                return 0;
+            }
+            else if (equalsIgnoreCase(header.name, "Connection"))
+            {
+                connectionHeader = header.value;
+            }
+            else if (equalsIgnoreCase(header.name, "Expect"))
+            {
+                expectsContinue = equalsIgnoreCase(header.value, "100-continue");
+            }
+        }
+
+        if (contentLength > d->maxBodySize)
+        {
+            sendError(connection, 413);
+            return 0;
+        }
+
+        size_t bodyStart = headEnd + 4;
+        if (view.size() - bodyStart < contentLength)
+        {
+            connection->requestSize = bodyStart + contentLength;
+            connection->scanned = headEnd;
+
+            if (expectsContinue && request.versionMinor > 0 && !connection->isContinueSent)
+            {
+                connection->isContinueSent = true;
+                connection->socket->send(std::vector<char>{'H', 'T', 'T', 'P', '/', '1', '.', '1', ' ',
+                                                           '1', '0', '0', ' ', 'C', 'o', 'n', 't', 'i', 'n', 'u', 'e',
+                                                           '\r', '\n', '\r', '\n'});
+            }
+            return 0;
+        }
+
+        request.headers = headers;
+        request.body = view.substr(bodyStart, contentLength);
+        request.isKeepAlive = request.versionMinor > 0 ? !hasToken(connectionHeader, "close")
+                                                       : hasToken(connectionHeader, "keep-alive");
+
+        connection->scanned = 0;
+        connection->requestSize = 0;
+        connection->isContinueSent = false;
+
+        dispatch(connection, request);
+        return bodyStart + contentLength;
+    }
+
+    void HttpServer::dispatch(Connection *connection, const SA::HttpRequest &request)
+    {
+        ++connection->sequence;
+        connection->isResponseOpen = true;
+        connection->isHeadSent = false;
+        connection->isChunked = false;
+        connection->isHeadRequest = request.method == "HEAD";
+        connection->isKeepAlive = request.isKeepAlive;
+        connection->status = 200;
+        connection->responseHeaders.clear();
+
+        SA::HttpResponse response(this, connection->id, connection->sequence);
+
+        if (!d->webSocketRoutes.empty() && hasToken(request.header("Upgrade"), "websocket"))
+        {
+            auto route = d->webSocketRoutes.find(request.path);
+            if (route != d->webSocketRoutes.end())
+            {
+                // Copied, the handler may change the routes
+                std::shared_ptr<std::function<void (SA::WebSocket &)> > handler = route->second;
+                upgradeWebSocket(connection, request, *handler);
+                return;
+            }
+        }
+
+        // One hash lookup for exact paths, then the longest prefix route
+        const std::shared_ptr<Handler> *handler = nullptr;
+        const MethodHandlers *pathMatch = nullptr;
+
+        auto exact = d->exactRoutes.find(request.path);
+        if (exact != d->exactRoutes.end())
+        {
+            pathMatch = &exact->second;
+            handler = matchMethod(exact->second, request.method);
+        }
+
+        if (!handler)
+        {
+            std::vector<const MethodHandlers*> &candidates = d->candidates;
+            candidates.clear();
+
+            const RouteNode *node = &d->prefixRoutes;
+            if (!node->handlers.empty()) candidates.push_back(&node->handlers);
+
+            std::string_view rest = request.path;
+            while (node && !rest.empty())
+            {
+                size_t slash = rest.find('/', 1);
+                std::string_view segment = rest.substr(1, slash == std::string_view::npos ? slash : slash - 1);
+                rest.remove_prefix(slash == std::string_view::npos ? rest.size() : slash);
+                if (segment.empty()) continue;
+
+                auto it = node->children.find(segment);
+                node = it == node->children.end() ? nullptr : it->second.get();
+                if (node && !node->handlers.empty()) candidates.push_back(&node->handlers);
+            }
+
+            for (auto it = candidates.rbegin(); it != candidates.rend() && !handler; ++it)
+            {
+                if (!pathMatch) pathMatch = *it;
+                handler = matchMethod(**it, request.method);
+            }
+        }
+
+        // Copied, the handler may change the routes
+        std::shared_ptr<Handler> target = handler ? *handler : d->defaultHandler;
+
+        if (target)
+        {
+            (*target)(request, response);
+        }
+        else if (pathMatch)
+        {
+            response.setStatus(405);
+            response.setHeader("Allow", allowedMethods(*pathMatch));
+            response.send(reasonPhrase(405), "text/plain; charset=utf-8");
+        }
+        else
+        {
+            response.setStatus(404);
+            response.send(reasonPhrase(404), "text/plain; charset=utf-8");
+        }
+    }
+
+    void HttpServer::upgradeWebSocket(Connection *connection, const SA::HttpRequest &request,
+                                      const std::function<void (SA::WebSocket &)> &handler)
+    {
+        SA::HttpResponse response(this, connection->id, connection->sequence);
+        std::string_view key = request.header("Sec-WebSocket-Key");
+
+        if (request.method != "GET" || request.versionMinor == 0 || !request.body.empty() ||
+            !hasToken(request.header("Connection"), "upgrade") || key.size() != 24)
+        {
+            response.setStatus(400);
+            response.send(reasonPhrase(400), "text/plain; charset=utf-8");
+            return;
+        }
+
+        if (request.header("Sec-WebSocket-Version") != "13")
+        {
+            response.setStatus(426);
+            response.setHeader("Sec-WebSocket-Version", "13");
+            response.send(reasonPhrase(426), "text/plain; charset=utf-8");
+            return;
+        }
+
+        connection->status = 101;
+        connection->isKeepAlive = true;
+        connection->responseHeaders = "Upgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ";
+        connection->responseHeaders.append(SA::WebSocket::acceptKey(key)).append("\r\n");
+
+        std::vector<char> out;
+        writeHead(connection, out, -1, {});
+        connection->socket->send(std::move(out));
+        connection->isResponseOpen = false;
+
+        connection->webSocket = std::make_unique<SA::WebSocket>();
+        connection->webSocket->accept(*connection->socket);
+        handler(*connection->webSocket);
+    }
+
+    void HttpServer::sendError(Connection *connection, int status)
+    {
+        std::string_view reason = reasonPhrase(status);
+
+        connection->status = status;
+        connection->isKeepAlive = false;
+        connection->isHeadRequest = false;
+        connection->responseHeaders.clear();
+
+        std::vector<char> out;
+        writeHead(connection, out, reason.size(), "text/plain; charset=utf-8");
+        append(out, reason);
+        connection->socket->send(std::move(out));
+
+        finishResponse(connection);
+    }
+
+    HttpServer::Connection *HttpServer::findResponse(const SA::HttpResponse &response)
+    {
+        auto it = d->connections.find(response.connection);
+        if (it == d->connections.end()) return nullptr;
+
+        Connection *connection = &it->second;
+        if (connection->isGone || !connection->isResponseOpen || connection->sequence != response.sequence)
+            return nullptr;
+
+        return connection;
+    }
+
+    bool HttpServer::isBodyAllowed(Connection *connection)
+    {
+        return !connection->isHeadRequest && connection->status != 204 && connection->status != 304;
+    }
+
+    void HttpServer::writeHead(Connection *connection, std::vector<char> &out, int64_t contentLength,
+                               std::string_view contentType)
+    {
+        append(out, "HTTP/1.1 ");
+        appendNumber(out, connection->status);
+        append(out, " ");
+        append(out, reasonPhrase(connection->status));
+        append(out, "\r\n");
+
+        std::time_t time = std::time(nullptr);
+        if (time != d->dateTime)
+        {
+            std::tm parts = {};
+#ifdef _WIN32
+            gmtime_s(&parts, &time);
+#else
+            gmtime_r(&time, &parts);
+#endif
+            char date[64];
+            size_t size = std::strftime(date, sizeof(date), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &parts);
+            d->dateLine.assign(date, size);
+            d->dateTime = time;
+        }
+        append(out, d->dateLine);
+
+        if (!contentType.empty())
+        {
+            append(out, "Content-Type: ");
+            append(out, contentType);
+            append(out, "\r\n");
+        }
+
+        append(out, connection->responseHeaders);
+
+        if (contentLength < 0)
+        {
+            if (connection->isChunked) append(out, "Transfer-Encoding: chunked\r\n");
+        }
+        else if (connection->status != 204 && connection->status != 304)
+        {
+            append(out, "Content-Length: ");
+            appendNumber(out, contentLength);
+            append(out, "\r\n");
+        }
+
+        if (!connection->isKeepAlive) append(out, "Connection: close\r\n");
+        else if (connection->versionMinor == 0) append(out, "Connection: keep-alive\r\n");
+
+        append(out, "\r\n");
+        connection->isHeadSent = true;
+    }
+
+    void HttpServer::finishResponse(Connection *connection)
+    {
+        connection->isResponseOpen = false;
+        connection->lastActivity = d->now();
+
+        // The peer reads the response to the end and closes, which
+        // releases the connection
+        if (!connection->isKeepAlive)
+        {
+            connection->isClosing = true;
+            connection->pending.clear();
+            connection->socket->shutdown();
+            return;
+        }
+
+        // Completed later than the request came: go on with the pipeline
+        if (connection->dispatchDepth == 0 && !connection->pending.empty())
+            processPending(connection);
+    }
+
+    void HttpServer::closeConnection(Connection *connection)
+    {
+        connection->isClosing = true;
+        d->server.closeConnection(connection->id);
+    }
+
+    void HttpServer::scheduleIdleSweep()
+    {
+#ifdef SACore
+        if (d->idleTimeout == 0 || d->idleTimer > -1) return;
+
+        // Idle connections go within one and a half timeouts
+        d->idleTimer = d->loop->singleShot(std::max(d->idleTimeout / 2, 1), [this]() {
+            d->idleTimer = -1;
+            sweepIdleConnections();
+            scheduleIdleSweep();
+        });
+#endif
+    }
+
+    void HttpServer::sweepIdleConnections()
+    {
+        auto deadline = d->now() - std::chrono::milliseconds(d->idleTimeout);
+
+        std::vector<int> idle;
+        for (auto &[id, connection] : d->connections)
+            if (!connection.isResponseOpen && !connection.webSocket && connection.lastActivity < deadline)
+                idle.push_back(id);
+
+        for (int id : idle)
+            d->server.closeConnection(id);
+    }
+}
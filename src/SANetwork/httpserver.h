@@ -0,0 +1,157 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <functional>
+
+namespace SA
+{
+    class TcpSocket;
+    class WebSocket;
+    class HttpServer;
+
+    struct HttpHeader
+    {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    // Views into the receive buffer of the connection, valid during the
+    // handler call only. The target is not percent-decoded.
+    struct HttpRequest
+    {
+        int connection = -1;
+        std::string_view method;
+        std::string_view target;
+        std::string_view path;
+        std::string_view query;
+        int versionMinor = 1;
+        std::span<const HttpHeader> headers;
+        std::string_view body;
+        bool isKeepAlive = true;
+
+        // Case-insensitive, empty if there is no such header
+        std::string_view header(std::string_view name) const;
+    };
+
+    // Handle of the response to one request, may be kept and completed
+    // later. Later requests of a pipelining client wait until it is. Once
+    // complete, or once the connection is gone, the calls do nothing and
+    // return false. The server must outlive the handle.
+    class HttpResponse
+    {
+    public:
+        HttpResponse() = default;
+
+        // Before anything is sent, 200 by default
+        void setStatus(int status);
+        void setHeader(std::string_view name, std::string_view value);
+
+        // Complete responses with a Content-Length
+        bool send(std::string_view body);
+        bool send(std::string_view body, std::string_view contentType);
+        bool sendFile(const std::string &path, std::string_view contentType = {});
+
+        // Chunked transfer: the head goes out with the first write(), end()
+        // completes the response (HTTP/1.0 clients get the data as it is
+        // and the connection is closed at the end)
+        bool write(std::string_view data);
+        bool end();
+
+        bool isOpen() const;
+
+    private:
+        friend class HttpServer;
+        HttpResponse(SA::HttpServer *server_, int connection_, uint32_t sequence_):
+            server(server_), connection(connection_), sequence(sequence_){}
+
+        SA::HttpServer *server = nullptr;
+        int connection = -1;
+        uint32_t sequence = 0;
+
+    }; // class HttpResponse
+
+    // HTTP/1.1 server on a TcpServer: keep-alive, pipelining, chunked
+    // responses, static files with sendfile. Requests are parsed in place,
+    // a request that fits one read is handled without copying it.
+    // Request bodies need a Content-Length, chunked uploads get 501.
+    class HttpServer
+    {
+    public:
+        using Handler = std::function<void (const SA::HttpRequest &request, SA::HttpResponse &response)>;
+
+        HttpServer();
+        virtual ~HttpServer();
+
+        bool listen(uint16_t port);
+        void close();
+        bool isListen();
+
+        // Exact paths are found with one hash lookup. A path ending with
+        // "/*" matches everything below it, the longest such prefix wins
+        // (a trie of path segments). An empty method matches every method.
+        void addRoute(const std::string &method, const std::string &path, const Handler &handler);
+        void removeRoute(const std::string &method, const std::string &path);
+
+        // GET and HEAD of files below directory, "/" maps to index.html
+        void addStaticDirectory(const std::string &prefix, const std::string &directory);
+
+        // WebSocket upgrades of requests to path, other requests to it go to
+        // the routes. The socket is valid until its close handlers have run.
+        void addWebSocketRoute(const std::string &path, const std::function<void (SA::WebSocket &socket)> &handler);
+        void removeWebSocketRoute(const std::string &path);
+
+        // For requests no route matches, 404 by default
+        void setDefaultHandler(const Handler &handler);
+
+        // Larger requests get 431 or 413 and the connection is closed. Behind
+        // a response that is still open the connection buffers requests up to
+        // both sizes together, then it is closed. False if both together would
+        // not fit into the read buffer of the socket (TcpSocket::MaxReadSize).
+        bool setMaxHeaderSize(size_t size);
+        bool setMaxBodySize(size_t size);
+
+        // Connections without a request in flight are closed after timeout
+        // ms, 0 keeps them open
+        void setIdleTimeout(int timeout);
+
+        size_t connectionCount();
+
+    private:
+        friend class HttpResponse;
+        struct Connection;
+
+        void addConnection(int id, SA::TcpSocket &socket);
+        size_t processData(int id, std::span<const char> data);
+        void processPending(Connection *connection);
+        bool isPendingAllowed(Connection *connection, size_t size);
+        void endDispatch(Connection *connection);
+        size_t processRequests(Connection *connection, std::span<const char> data);
+        size_t parseRequest(Connection *connection, std::span<const char> data);
+        void dispatch(Connection *connection, const SA::HttpRequest &request);
+        void sendError(Connection *connection, int status);
+        void upgradeWebSocket(Connection *connection, const SA::HttpRequest &request,
+                              const std::function<void (SA::WebSocket &)> &handler);
+
+        Connection *findResponse(const SA::HttpResponse &response);
+        bool isBodyAllowed(Connection *connection);
+        void writeHead(Connection *connection, std::vector<char> &out, int64_t contentLength, std::string_view contentType);
+        void finishResponse(Connection *connection);
+        void closeConnection(Connection *connection);
+
+        void scheduleIdleSweep();
+        void sweepIdleConnections();
+
+        HttpServer(const SA::HttpServer &) = delete;
+        HttpServer(SA::HttpServer &&) = delete;
+        void operator = (const SA::HttpServer &) = delete;
+        void operator = (SA::HttpServer &&) = delete;
+
+        struct HttpServerPrivate;
+        HttpServerPrivate * const d;
+
+    }; // class HttpServer
+} // namespace SA
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace SA
+{
+    // Compact binary encoding for payloads. Integers are varints, signed ones
+    // zigzag encoded, single bytes and bools are stored as they are. Floats
+    // and fixed() fields are little-endian of their full width. Strings and
+    // containers start with their size as a varint, tuples, pairs and arrays
+    // are their elements in order, optionals a bool and the value.
+    //
+    // Structs take part with one member template for both directions:
+    //     template<typename Stream> void serialize(Stream &stream) { stream(id, name, points); }
+    //
+    // Writer appends to a vector that can be moved into TcpSocket::send(),
+    // Reader works on the span a read or frame handler gets, so neither side
+    // needs a buffer of its own. Header-only, like handlerlist.h.
+
+    namespace SerializationDetail
+    {
+        template<typename T>
+        struct IsOptional : std::false_type {};
+
+        template<typename T>
+        struct IsOptional<std::optional<T> > : std::true_type {};
+
+        template<typename T, typename Stream>
+        concept Serializable = requires(T &value, Stream &stream) { value.serialize(stream); };
+
+        template<typename T>
+        concept TupleLike = requires { std::tuple_size<T>::value; };
+
+        template<typename T>
+        concept Map = requires { typename T::key_type; typename T::mapped_type; };
+
+        template<typename T>
+        concept Byte = sizeof(T) == 1 && (std::is_integral_v<T> || std::is_same_v<T, std::byte>) &&
+                       !std::is_same_v<T, bool>;
+
+        // Contiguous bytes are copied in one piece
+        template<typename T>
+        concept ByteRange = std::ranges::contiguous_range<T> && Byte<std::ranges::range_value_t<T> >;
+
+        template<typename T>
+        constexpr bool AlwaysFalse = false;
+
+        constexpr uint64_t zigzag(int64_t value)
+        {
+            return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+        }
+
+        constexpr int64_t unzigzag(uint64_t value)
+        {
+            return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        }
+
+        template<typename T>
+        using Bits = std::conditional_t<sizeof(T) == 1, uint8_t,
+                     std::conditional_t<sizeof(T) == 2, uint16_t,
+                     std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t> > >;
+    }
+
+    // Bytes a value takes as a varint
+    constexpr size_t varintSize(uint64_t value)
+    {
+        size_t size = 1;
+        while (value >= 0x80)
+        {
+            value >>= 7;
+            ++size;
+        }
+        return size;
+    }
+
+    class Writer
+    {
+    public:
+        explicit Writer(std::vector<char> &buffer_) : buffer(buffer_), start(buffer_.size()) {}
+
+        template<typename... Args>
+        Writer &operator()(const Args &...args)
+        {
+            (write(args), ...);
+            return *this;
+        }
+
+        template<typename T>
+        void write(const T &value)
+        {
+            using namespace SerializationDetail;
+
+            if constexpr (std::is_same_v<T, bool>)
+                buffer.push_back(value ? 1 : 0);
+            else if constexpr (Byte<T>)
+                buffer.push_back(static_cast<char>(value));
+            else if constexpr (std::is_enum_v<T>)
+                write(static_cast<std::underlying_type_t<T> >(value));
+            else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+                writeVarint(zigzag(value));
+            else if constexpr (std::is_integral_v<T>)
+                writeVarint(value);
+            else if constexpr (std::is_floating_point_v<T>)
+                fixed(value);
+            else if constexpr (std::is_convertible_v<const T &, std::string_view>)
+                writeBytes(std::string_view(value));
+            else if constexpr (IsOptional<T>::value)
+            {
+                write(value.has_value());
+                if (value) write(*value);
+            }
+            else if constexpr (Serializable<T, Writer>)
+                const_cast<T &>(value).serialize(*this);
+            else if constexpr (TupleLike<T>)
+                std::apply([this](const auto &...items) { (write(items), ...); }, value);
+            else if constexpr (ByteRange<T>)
+                writeBytes(std::string_view(reinterpret_cast<const char*>(std::ranges::data(value)), std::ranges::size(value)));
+            else if constexpr (std::ranges::sized_range<T>)
+            {
+                writeVarint(std::ranges::size(value));
+                for (const auto &item : value)
+                    write(item);
+            }
+            else
+                static_assert(AlwaysFalse<T>, "SA::Writer can't write this type");
+        }
+
+        // Little-endian, all bytes of the type
+        template<typename T>
+        void fixed(const T &value)
+        {
+            static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>, "SA::Writer::fixed() takes numbers");
+
+            auto bits = std::bit_cast<SerializationDetail::Bits<T> >(value);
+            for (size_t i=0; i<sizeof(T); ++i)
+                buffer.push_back(static_cast<char>(bits >> (8 * i)));
+        }
+
+        void writeVarint(uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                buffer.push_back(static_cast<char>(value | 0x80));
+                value >>= 7;
+            }
+            buffer.push_back(static_cast<char>(value));
+        }
+
+        void writeBytes(std::string_view bytes)
+        {
+            writeVarint(bytes.size());
+            buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+        }
+
+        // Bytes written by this writer
+        size_t size() const
+        {
+            return buffer.size() - start;
+        }
+
+    private:
+        std::vector<char> &buffer;
+        size_t start;
+
+    }; // class Writer
+
+    class Reader
+    {
+    public:
+        explicit Reader(std::span<const char> data_) : data(data_) {}
+
+        // False once anything failed, the rest is not read then
+        template<typename... Args>
+        bool operator()(Args &...args)
+        {
+            static_cast<void>((read(args) && ...));
+            return !hasFailed;
+        }
+
+        // Views (string_view, span) point into the data, the rest is copied.
+        // A size that is larger than the bytes left makes the data invalid.
+        template<typename T>
+        bool read(T &value)
+        {
+            using namespace SerializationDetail;
+            if (hasFailed) return false;
+
+            if constexpr (std::is_same_v<T, bool>)
+            {
+                uint8_t byte = 0;
+                if (!readByte(byte) || byte > 1) return fail();
+                value = byte != 0;
+            }
+            else if constexpr (Byte<T>)
+            {
+                uint8_t byte = 0;
+                if (!readByte(byte)) return false;
+                value = static_cast<T>(byte);
+            }
+            else if constexpr (std::is_enum_v<T>)
+            {
+                std::underlying_type_t<T> underlying;
+                if (!read(underlying)) return false;
+                value = static_cast<T>(underlying);
+            }
+            else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+            {
+                uint64_t encoded = 0;
+                if (!readVarint(encoded)) return false;
+
+                int64_t decoded = unzigzag(encoded);
+                if (decoded < std::numeric_limits<T>::min() || decoded > std::numeric_limits<T>::max()) return fail();
+                value = static_cast<T>(decoded);
+            }
+            else if constexpr (std::is_integral_v<T>)
+            {
+                uint64_t decoded = 0;
+                if (!readVarint(decoded)) return false;
+
+                if (decoded > std::numeric_limits<T>::max()) return fail();
+                value = static_cast<T>(decoded);
+            }
+            else if constexpr (std::is_floating_point_v<T>)
+                return fixed(value);
+            else if constexpr (std::is_same_v<T, std::string_view> || std::is_same_v<T, std::span<const char> >)
+            {
+                std::span<const char> bytes;
+                if (!readBytes(bytes)) return false;
+                value = T(bytes.data(), bytes.size());
+            }
+            else if constexpr (!TupleLike<T> && ByteRange<T> && requires { value.resize(0); })
+            {
+                std::span<const char> bytes;
+                if (!readBytes(bytes)) return false;
+
+                value.resize(bytes.size());
+                if (!bytes.empty()) std::memcpy(value.data(), bytes.data(), bytes.size());
+            }
+            else if constexpr (IsOptional<T>::value)
+            {
+                bool hasValue = false;
+                if (!read(hasValue)) return false;
+
+                if (!hasValue) value.reset();
+                else if (!read(value.emplace())) return false;
+            }
+            else if constexpr (Serializable<T, Reader>)
+                value.serialize(*this);
+            else if constexpr (TupleLike<T>)
+                std::apply([this](auto &...items) { static_cast<void>((read(items) && ...)); }, value);
+            else if constexpr (Map<T>)
+            {
+                size_t size = 0;
+                if (!readSize(size)) return false;
+
+                value.clear();
+                for (size_t i=0; i<size && !hasFailed; ++i)
+                {
+                    typename T::key_type key{};
+                    typename T::mapped_type mapped{};
+                    if (read(key) && read(mapped))
+                        value.emplace(std::move(key), std::move(mapped));
+                }
+            }
+            else if constexpr (requires { value.emplace_back(); })
+            {
+                size_t size = 0;
+                if (!readSize(size)) return false;
+
+                value.clear();
+                if constexpr (requires { value.reserve(size); })
+                    value.reserve(size);
+
+                for (size_t i=0; i<size && !hasFailed; ++i)
+                    read(value.emplace_back());
+            }
+            else if constexpr (requires { value.insert(std::declval<std::ranges::range_value_t<T> >()); })
+            {
+                size_t size = 0;
+                if (!readSize(size)) return false;
+
+                value.clear();
+                for (size_t i=0; i<size && !hasFailed; ++i)
+                {
+                    std::ranges::range_value_t<T> item{};
+                    if (read(item)) value.insert(std::move(item));
+                }
+            }
+            else
+                static_assert(AlwaysFalse<T>, "SA::Reader can't read this type");
+
+            return !hasFailed;
+        }
+
+        template<typename T>
+        bool fixed(T &value)
+        {
+            static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>, "SA::Reader::fixed() takes numbers");
+            if (hasFailed || data.size() - position < sizeof(T)) return fail();
+
+            SerializationDetail::Bits<T> bits = 0;
+            for (size_t i=0; i<sizeof(T); ++i)
+                bits |= static_cast<SerializationDetail::Bits<T> >(static_cast<uint8_t>(data[position + i])) << (8 * i);
+
+            value = std::bit_cast<T>(bits);
+            position += sizeof(T);
+            return true;
+        }
+
+        bool readVarint(uint64_t &value)
+        {
+            // Most sizes and small numbers take one byte
+            if (!hasFailed && position < data.size() && static_cast<uint8_t>(data[position]) < 0x80)
+            {
+                value = static_cast<uint8_t>(data[position++]);
+                return true;
+            }
+
+            value = 0;
+            for (size_t i=0; i<10; ++i)
+            {
+                uint8_t byte = 0;
+                if (!readByte(byte)) return false;
+
+                // The tenth byte holds the last bit only
+                if (i == 9 && byte > 1) return fail();
+
+                value |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+                if (!(byte & 0x80)) return true;
+            }
+            return fail();
+        }
+
+        bool readBytes(std::span<const char> &bytes)
+        {
+            size_t size = 0;
+            if (!readSize(size)) return false;
+
+            bytes = data.subspan(position, size);
+            position += size;
+            return true;
+        }
+
+        bool isValid() const
+        {
+            return !hasFailed;
+        }
+
+        // Bytes read so far, and bytes left
+        size_t offset() const
+        {
+            return position;
+        }
+
+        size_t remaining() const
+        {
+            return data.size() - position;
+        }
+
+        bool atEnd() const
+        {
+            return position == data.size();
+        }
+
+    private:
+        bool readByte(uint8_t &byte)
+        {
+            if (hasFailed || position == data.size()) return fail();
+            byte = static_cast<uint8_t>(data[position++]);
+            return true;
+        }
+
+        // Every element takes a byte at least, so a larger size is malformed
+        // and can't make a container allocate more than the data holds
+        bool readSize(size_t &size)
+        {
+            uint64_t encoded = 0;
+            if (!readVarint(encoded)) return false;
+            if (encoded > remaining()) return fail();
+
+            size = static_cast<size_t>(encoded);
+            return true;
+        }
+
+        bool fail()
+        {
+            hasFailed = true;
+            return false;
+        }
+
+        std::span<const char> data;
+        size_t position = 0;
+        bool hasFailed = false;
+
+    }; // class Reader
+
+} // namespace SA
@@ -1,11 +1,16 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <memory>
+#include <coroutine>
 #include <functional>
 
 namespace SA
 {
+    class EventLoop;
+    class TcpSocket;
+
     class TcpServer
     {
     public:
@@ -13,16 +18,66 @@ namespace SA
         virtual ~TcpServer();
 
         bool listen(uint16_t port);
+
+        // Multi-acceptor mode: one SO_REUSEPORT listener per loop, so the
+        // kernel spreads connections across them. The handler runs on the
+        // loop that accepted and owns the non-blocking descriptor, so a
+        // TcpSocket created there belongs to that loop. Close the server
+        // before the loops are destroyed.
+        bool listen(uint16_t port, const std::vector<SA::EventLoop*> &loops,
+                    const std::function<void (int sockDscr, uint32_t host, uint16_t port)> &handler);
         void close();
         bool isListen();
 
+        // The descriptor belongs to the handler from then on
         int addConnectHandler(const std::function<void (int sockDscr, uint32_t host, uint16_t port)> &func);
         void removeConnectHandler(int id);
+
+        // Connection table: once a connection handler is added, accepted
+        // descriptors become TcpSocket objects owned by the server, found by
+        // a generational id. Closed connections are reported and destroyed
+        // by the server, close() closes all of them.
+        int addConnectionHandler(const std::function<void (int id, SA::TcpSocket &socket)> &func);
+        void removeConnectionHandler(int id);
+        int addDisconnectionHandler(const std::function<void (int id)> &func);
+        void removeDisconnectionHandler(int id);
+
+        SA::TcpSocket *connection(int id); // nullptr once closed
+        size_t connectionCount();
+        void closeConnection(int id);
+        void forEachConnection(const std::function<void (int id, SA::TcpSocket &socket)> &func);
         void mainLoopHandler();
 
+        struct AcceptResult
+        {
+            int descriptor = -1;
+            uint32_t host = 0;
+            uint16_t port = 0;
+        };
+
+        struct AcceptAwaiter
+        {
+            SA::TcpServer *server = nullptr;
+            AcceptResult result;
+
+            bool await_ready();
+            bool await_suspend(std::coroutine_handle<> handle);
+            AcceptResult await_resume() { return result; }
+        };
+
+        // co_await accept() resumes with the next incoming connection, or with
+        // descriptor -1 once the server is closed. After the first call new
+        // connections go to awaiting coroutines instead of connect handlers.
+        // One coroutine accepts at a time, others resume at once with -1.
+        AcceptAwaiter accept();
+
     private:
         bool createServer();
         void deleteServer();
+        void resumeAcceptor(const AcceptResult &result);
+        void addConnection(int descr);
+        void releaseConnection(int id);
+        void deleteClosedConnections();
 
         TcpServer(const SA::TcpServer &) = delete;
         TcpServer(SA::TcpServer &&) = delete;
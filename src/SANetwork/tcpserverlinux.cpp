@@ -4,7 +4,10 @@
 #include <memory>
 #include <vector>
 #include <string>
-#include <map>
+#include <deque>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -13,37 +16,136 @@
 #include <arpa/inet.h>
 
 #include "tcpserver.h"
+#include "tcpsocket.h"
+#include "handlerlist.h"
+#include "slotmap.h"
 
 #ifdef SACore
-#include "application.h"
+#include "eventloop.h"
+#endif
+
+// Non-blocking listening socket on any address, -1 on failure
+static int openListener(uint16_t port, bool reusePort)
+{
+    int socketFd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (socketFd < 0) return -1;
+
+    int option = 1;
+    ::setsockopt(socketFd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+    if (reusePort) ::setsockopt(socketFd, SOL_SOCKET, SO_REUSEPORT, &option, sizeof(option));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (::bind(socketFd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        ::listen(socketFd, SOMAXCONN) < 0)
+    {
+        ::close(socketFd);
+        return -1;
+    }
+
+    return socketFd;
+}
+
+static const int AcceptRetryDelay = 100;
+
+// Calls func for every pending connection until accept4 would block.
+// Returns the error that stopped it if it was not that.
+template<typename Func>
+static int acceptPending(int socketFd, Func &&func)
+{
+    for (;;)
+    {
+        sockaddr_in socketAddr;
+        socklen_t adrlen = sizeof(socketAddr);
+        int newsockfd = ::accept4(socketFd, (struct sockaddr *) &socketAddr, &adrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (newsockfd < 0)
+        {
+            // The peer gave up before we got to it, the next one may be fine
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : errno;
+        }
+
+        if (!func(newsockfd, socketAddr)) return 0;
+    }
+}
+
+// Out of descriptors or memory the connection stays in the backlog and the
+// listener readable, it would be reported again right away. Stop listening
+// for a while instead, calls resume once the delay is over.
+static bool isAcceptExhausted(int error)
+{
+    return error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM;
+}
+
+#ifdef SACore
+static int pauseAccepting(SA::EventLoop *loop, int socketFd, int error, const std::function<void ()> &resume)
+{
+    std::cout << "TcpServer: accept failed: " << std::strerror(error)
+              << ", retrying in " << AcceptRetryDelay << " ms" << std::endl;
+
+    loop->setDescriptorEvents(socketFd, 0);
+    return loop->singleShot(AcceptRetryDelay, resume);
+}
 #endif
 
 namespace SA
 {
     struct TcpServer::TcpServerPrivate
     {
+        SA::EventLoop *loop = nullptr;
         int socketFd = -1;
-        int mainLoopId = -1;
         bool isListen = false;
+        int acceptTimer = -1;
         sockaddr_in address;
 
-        std::vector<int> sockets;
-        std::map<int, std::function<void (int, uint16_t, uint32_t)> > connectHandlers;
+        SA::HandlerList<void (int, uint32_t, uint16_t)> connectHandlers;
+
+        struct Connection
+        {
+            SA::TcpSocket socket;
+            bool isClosed = false;
+        };
+
+        SA::SlotMap<Connection> connections;
+        std::vector<int> closedConnections;
+        SA::HandlerList<void (int, SA::TcpSocket &)> connectionHandlers;
+        SA::HandlerList<void (int)> disconnectionHandlers;
+
+        // Posted cleanups check it, the server may be gone by then
+        std::shared_ptr<bool> isAlive = std::make_shared<bool>(true);
+
+        struct Acceptor
+        {
+            SA::EventLoop *loop = nullptr;
+            int socketFd = -1;
+            std::atomic<bool> isOpen = true;
+            std::function<void (int, uint32_t, uint16_t)> handler;
+        };
+
+        // Shared with the worker loops, which may still hold one after close()
+        std::vector<std::shared_ptr<Acceptor> > acceptors;
+
+        bool isAcceptAwaited = false;
+        std::deque<AcceptResult> acceptQueue;
+        AcceptAwaiter *acceptAwaiter = nullptr;
+        std::coroutine_handle<> acceptHandle;
     };
 
     TcpServer::TcpServer():
         d(new TcpServerPrivate)
     {
 #ifdef SACore
-        d->mainLoopId = SA::Application::instance().addMainLoopListener(std::bind(&TcpServer::mainLoopHandler, this));
+        d->loop = SA::EventLoop::current();
 #endif
     }
 
     SA::TcpServer::~TcpServer()
     {
-#ifdef SACore
-        SA::Application::instance().removeMainLoopListener(d->mainLoopId);
-#endif
+        *d->isAlive = false;
         deleteServer();
         delete d;
     }
@@ -59,16 +161,90 @@ namespace SA
         int state = ::bind(d->socketFd, (struct sockaddr *)&d->address, sizeof(d->address));
 
         if (state > -1)
-            state = ::listen(d->socketFd, 255);
+            state = ::listen(d->socketFd, SOMAXCONN);
 
         d->isListen = (state > -1);
 
+#ifdef SACore
+        if (d->isListen)
+            d->loop->addDescriptorListener(d->socketFd, [this](int){ mainLoopHandler(); });
+#endif
+
         return d->isListen;
     }
 
+    bool TcpServer::listen(uint16_t port, const std::vector<SA::EventLoop*> &loops,
+                           const std::function<void (int, uint32_t, uint16_t)> &handler)
+    {
+#ifdef SACore
+        deleteServer();
+        if (loops.empty() || !handler) return false;
+
+        for (SA::EventLoop *loop : loops)
+        {
+            auto acceptor = std::make_shared<TcpServerPrivate::Acceptor>();
+            acceptor->loop = loop;
+            acceptor->handler = handler;
+            acceptor->socketFd = openListener(port, true);
+
+            if (acceptor->socketFd < 0)
+            {
+                deleteServer();
+                return false;
+            }
+
+            d->acceptors.push_back(acceptor);
+        }
+
+        for (const std::shared_ptr<TcpServerPrivate::Acceptor> &acceptor : d->acceptors)
+        {
+            // Descriptor listeners belong to the loop's own thread
+            acceptor->loop->post([acceptor]() {
+                if (!acceptor->isOpen) return;
+
+                acceptor->loop->addDescriptorListener(acceptor->socketFd, [acceptor](int) {
+                    int error = acceptPending(acceptor->socketFd, [&acceptor](int newsockfd, const sockaddr_in &socketAddr) {
+                        if (!acceptor->isOpen)
+                        {
+                            ::close(newsockfd);
+                            return false;
+                        }
+
+                        acceptor->handler(newsockfd, socketAddr.sin_addr.s_addr, socketAddr.sin_port);
+                        return true;
+                    });
+
+                    // The descriptor is closed on this loop, after isOpen is cleared
+                    if (isAcceptExhausted(error))
+                    {
+                        pauseAccepting(acceptor->loop, acceptor->socketFd, error, [acceptor]() {
+                            if (acceptor->isOpen)
+                                acceptor->loop->setDescriptorEvents(acceptor->socketFd, SA::DescriptorRead);
+                        });
+                    }
+                });
+            });
+        }
+
+        d->isListen = true;
+        return true;
+#else
+        (void)port; (void)loops; (void)handler;
+        return false;
+#endif
+    }
+
     void TcpServer::close()
     {
+        // Reported like any other close. The sockets are destroyed from the
+        // loop, close() may be called from one of their handlers.
+        std::vector<int> ids;
+        forEachConnection([&ids](int id, SA::TcpSocket &) { ids.push_back(id); });
+        for (int id : ids)
+            closeConnection(id);
+
         deleteServer();
+        resumeAcceptor(AcceptResult());
     }
 
     bool TcpServer::isListen()
@@ -78,50 +254,191 @@ namespace SA
 
     int TcpServer::addConnectHandler(const std::function<void (int, uint32_t, uint16_t)> &func)
     {
-        int id = static_cast<int>(d->connectHandlers.size());
-        for (auto const& it : d->connectHandlers) if (it.first != ++id) break;
-        d->connectHandlers.insert({id, func});
-        return id;
+        return d->connectHandlers.add(func);
     }
 
     void TcpServer::removeConnectHandler(int id)
     {
-        auto it = d->connectHandlers.find(id);
-        if (it != d->connectHandlers.end())
-            d->connectHandlers.erase(it);
+        d->connectHandlers.remove(id);
     }
 
     void TcpServer::mainLoopHandler()
     {
-        if (!d->isListen) return;
+#ifndef SACore
+        deleteClosedConnections();
+#endif
 
-        struct sockaddr_in socketAddr;
-        socklen_t adrlen = sizeof(socketAddr);
-        int newsockfd = accept(d->socketFd, (struct sockaddr *) &socketAddr, &adrlen);
+        if (!d->isListen || d->socketFd < 0) return;
+
+        int error = acceptPending(d->socketFd, [this](int newsockfd, const sockaddr_in &socketAddr) {
+            if (d->isAcceptAwaited)
+                resumeAcceptor({newsockfd, socketAddr.sin_addr.s_addr, socketAddr.sin_port});
+            else if (!d->connectionHandlers.isEmpty())
+                addConnection(newsockfd);
+            else
+                d->connectHandlers(newsockfd, socketAddr.sin_addr.s_addr, socketAddr.sin_port);
+
+            // A handler or coroutine may have closed the server
+            return d->isListen;
+        });
+
+#ifdef SACore
+        if (isAcceptExhausted(error) && d->acceptTimer < 0)
+        {
+            d->acceptTimer = pauseAccepting(d->loop, d->socketFd, error, [this]() {
+                d->acceptTimer = -1;
+                d->loop->setDescriptorEvents(d->socketFd, SA::DescriptorRead);
+            });
+        }
+#else
+        (void)error;
+#endif
+    }
 
-        if (newsockfd > -1)
+    int TcpServer::addConnectionHandler(const std::function<void (int, SA::TcpSocket &)> &func)
+    {
+        return d->connectionHandlers.add(func);
+    }
+
+    void TcpServer::removeConnectionHandler(int id)
+    {
+        d->connectionHandlers.remove(id);
+    }
+
+    int TcpServer::addDisconnectionHandler(const std::function<void (int)> &func)
+    {
+        return d->disconnectionHandlers.add(func);
+    }
+
+    void TcpServer::removeDisconnectionHandler(int id)
+    {
+        d->disconnectionHandlers.remove(id);
+    }
+
+    SA::TcpSocket *TcpServer::connection(int id)
+    {
+        TcpServerPrivate::Connection *connection = d->connections.find(id);
+        if (!connection || connection->isClosed) return nullptr;
+        return &connection->socket;
+    }
+
+    size_t TcpServer::connectionCount()
+    {
+        return d->connections.size() - d->closedConnections.size();
+    }
+
+    void TcpServer::closeConnection(int id)
+    {
+        TcpServerPrivate::Connection *connection = d->connections.find(id);
+        if (!connection || connection->isClosed) return;
+
+        connection->socket.disconnect();
+        releaseConnection(id);
+    }
+
+    void TcpServer::forEachConnection(const std::function<void (int, SA::TcpSocket &)> &func)
+    {
+        d->connections.forEach([&func](int id, TcpServerPrivate::Connection &connection) {
+            if (!connection.isClosed) func(id, connection.socket);
+        });
+    }
+
+    void TcpServer::addConnection(int descr)
+    {
+        int id = d->connections.emplace();
+        TcpServerPrivate::Connection *connection = d->connections.find(id);
+
+        if (!connection)
+        {
+            ::close(descr);
+            return;
+        }
+
+        connection->socket.setDescriptor(descr);
+        connection->socket.addDisconnectHandler([this, id](int) { releaseConnection(id); });
+
+        d->connectionHandlers(id, connection->socket);
+    }
+
+    void TcpServer::releaseConnection(int id)
+    {
+        TcpServerPrivate::Connection *connection = d->connections.find(id);
+        if (!connection || connection->isClosed) return;
+
+        connection->isClosed = true;
+        d->closedConnections.push_back(id);
+        d->disconnectionHandlers(id);
+
+        // The socket may be inside its own handler, destroy it from the loop
+        if (d->closedConnections.size() > 1) return;
+
+#ifdef SACore
+        std::shared_ptr<bool> isAlive = d->isAlive;
+        d->loop->post([this, isAlive]() { if (*isAlive) deleteClosedConnections(); });
+#endif
+    }
+
+    void TcpServer::deleteClosedConnections()
+    {
+        for (int id : d->closedConnections)
+            d->connections.remove(id);
+
+        d->closedConnections.clear();
+    }
+
+    TcpServer::AcceptAwaiter TcpServer::accept()
+    {
+        d->isAcceptAwaited = true;
+        return AcceptAwaiter{this, AcceptResult()};
+    }
+
+    bool TcpServer::AcceptAwaiter::await_ready()
+    {
+        if (!server->d->acceptQueue.empty())
         {
-            d->sockets.push_back(newsockfd);
+            result = server->d->acceptQueue.front();
+            server->d->acceptQueue.pop_front();
+            return true;
+        }
+
+        return !server->isListen();
+    }
+
+    bool TcpServer::AcceptAwaiter::await_suspend(std::coroutine_handle<> handle)
+    {
+        // Another coroutine is waiting already, this one gets descriptor -1
+        if (server->d->acceptHandle) return false;
 
-            for (const auto &it: d->connectHandlers)
-                it.second(newsockfd, socketAddr.sin_addr.s_addr, socketAddr.sin_port);
+        server->d->acceptAwaiter = this;
+        server->d->acceptHandle = handle;
+        return true;
+    }
+
+    void TcpServer::resumeAcceptor(const AcceptResult &result)
+    {
+        if (!d->acceptHandle)
+        {
+            if (result.descriptor > -1)
+                d->acceptQueue.push_back(result);
+            return;
         }
+
+        std::coroutine_handle<> handle = d->acceptHandle;
+        d->acceptHandle = nullptr;
+        d->acceptAwaiter->result = result;
+        d->acceptAwaiter = nullptr;
+        handle.resume();
     }
 
     bool TcpServer::createServer()
     {
         d->isListen = false;
-        d->socketFd = socket(AF_INET, SOCK_STREAM, 0);
+        d->socketFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
 
         if (d->socketFd > -1) {
 
             int iSetOption = 1;
             setsockopt(d->socketFd, SOL_SOCKET, SO_REUSEADDR, (char*)&iSetOption, sizeof(iSetOption));
-
-            struct timeval read_timeout;
-            read_timeout.tv_sec = 0;
-            read_timeout.tv_usec = 10;
-            setsockopt(d->socketFd, SOL_SOCKET, SO_RCVTIMEO, &read_timeout, sizeof(read_timeout));
         }
         return (d->socketFd > -1);
     }
@@ -130,19 +447,32 @@ namespace SA
     {
         d->isListen = false;
 
-        for (int socketFd : d->sockets) {
-            if (socketFd > -1) {
-                ::shutdown(socketFd, SHUT_RDWR);
-                ::close(socketFd);
-            }
-        }
-
         if (d->socketFd > -1) {
+#ifdef SACore
+            if (d->acceptTimer > -1) d->loop->killTimer(d->acceptTimer);
+            d->acceptTimer = -1;
+            d->loop->removeDescriptorListener(d->socketFd);
+#endif
             ::shutdown(d->socketFd, SHUT_RDWR);
             ::close(d->socketFd);
         }
 
         d->socketFd = -1;
+
+        for (const std::shared_ptr<TcpServerPrivate::Acceptor> &acceptor : d->acceptors)
+        {
+            acceptor->isOpen = false;
+
+#ifdef SACore
+            // Queued after the registration, so the listener is always there
+            acceptor->loop->post([acceptor]() {
+                acceptor->loop->removeDescriptorListener(acceptor->socketFd);
+                ::close(acceptor->socketFd);
+            });
+#endif
+        }
+
+        d->acceptors.clear();
     }
 }
 
@@ -6,31 +6,63 @@
 #include <memory>
 #include <vector>
 #include <string>
-#include <map>
+#include <deque>
 
 #include "tcpserver.h"
+#include "tcpsocket.h"
+#include "handlerlist.h"
+#include "slotmap.h"
 
 #ifdef SACore
-#include "application.h"
+#include "eventloop.h"
 #endif
 
 namespace SA
 {
     struct TcpServer::TcpServerPrivate
     {
+        SA::EventLoop *loop = nullptr;
         SOCKET socketFd = INVALID_SOCKET;
         int mainLoopId = -1;
         bool isListen = false;
         bool isWinsockStarted = false;
         SOCKADDR_IN address;
 
-        std::vector<SOCKET> sockets;
-        std::map<int, std::function<void (int, uint16_t, uint32_t)> > connectHandlers;
+        SA::HandlerList<void (int, uint32_t, uint16_t)> connectHandlers;
+
+        struct Connection
+        {
+            SA::TcpSocket socket;
+            bool isClosed = false;
+        };
+
+        SA::SlotMap<Connection> connections;
+        std::vector<int> closedConnections;
+        SA::HandlerList<void (int, SA::TcpSocket &)> connectionHandlers;
+        SA::HandlerList<void (int)> disconnectionHandlers;
+
+        // Posted cleanups check it, the server may be gone by then
+        std::shared_ptr<bool> isAlive = std::make_shared<bool>(true);
+
+        // Multi-acceptor mode, there is no SO_REUSEPORT, so one listener
+        // accepts and hands connections to the loops in turn
+        std::vector<SA::EventLoop*> workerLoops;
+        std::function<void (int, uint32_t, uint16_t)> workerHandler;
+        size_t nextWorker = 0;
+
+        bool isAcceptAwaited = false;
+        std::deque<AcceptResult> acceptQueue;
+        AcceptAwaiter *acceptAwaiter = nullptr;
+        std::coroutine_handle<> acceptHandle;
     };
 
     TcpServer::TcpServer():
         d(new TcpServerPrivate)
     {
+#ifdef SACore
+        d->loop = SA::EventLoop::current();
+#endif
+
         WSADATA wsa;
         long rc = WSAStartup(MAKEWORD(2, 2), &wsa);
         d->isWinsockStarted = (rc == 0);
@@ -38,7 +70,7 @@ namespace SA
         if (d->isWinsockStarted)
         {
 #ifdef SACore
-        d->mainLoopId = SA::Application::instance().addMainLoopListener(std::bind(&TcpServer::mainLoopHandler, this));
+        d->mainLoopId = d->loop->addMainLoopListener(std::bind(&TcpServer::mainLoopHandler, this));
 #endif
         }
     }
@@ -46,8 +78,9 @@ namespace SA
     SA::TcpServer::~TcpServer()
     {
 #ifdef SACore
-        SA::Application::instance().removeMainLoopListener(d->mainLoopId);
+        d->loop->removeMainLoopListener(d->mainLoopId);
 #endif
+        *d->isAlive = false;
         deleteServer();
         WSACleanup();
         delete d;
@@ -71,9 +104,34 @@ namespace SA
         return d->isListen;
     }
 
+    bool TcpServer::listen(uint16_t port, const std::vector<SA::EventLoop*> &loops,
+                           const std::function<void (int, uint32_t, uint16_t)> &handler)
+    {
+#ifdef SACore
+        if (loops.empty() || !handler) return false;
+        if (!listen(port)) return false;
+
+        d->workerLoops = loops;
+        d->workerHandler = handler;
+        d->nextWorker = 0;
+        return true;
+#else
+        (void)port; (void)loops; (void)handler;
+        return false;
+#endif
+    }
+
     void TcpServer::close()
     {
+        // Reported like any other close. The sockets are destroyed from the
+        // loop, close() may be called from one of their handlers.
+        std::vector<int> ids;
+        forEachConnection([&ids](int id, SA::TcpSocket &) { ids.push_back(id); });
+        for (int id : ids)
+            closeConnection(id);
+
         deleteServer();
+        resumeAcceptor(AcceptResult());
     }
 
     bool TcpServer::isListen()
@@ -83,35 +141,186 @@ namespace SA
 
     int TcpServer::addConnectHandler(const std::function<void (int, uint32_t, uint16_t)> &func)
     {
-        int id = static_cast<int>(d->connectHandlers.size());
-        for (auto const& it : d->connectHandlers) if (it.first != ++id) break;
-        d->connectHandlers.insert({id, func});
-        return id;
+        return d->connectHandlers.add(func);
     }
 
     void TcpServer::removeConnectHandler(int id)
     {
-        auto it = d->connectHandlers.find(id);
-        if (it != d->connectHandlers.end())
-            d->connectHandlers.erase(it);
+        d->connectHandlers.remove(id);
     }
 
     void TcpServer::mainLoopHandler()
     {
+#ifndef SACore
+        deleteClosedConnections();
+#endif
+
         if (!d->isListen) return;
 
-        SOCKADDR_IN socketAddr;
-        int sockaddrLen = sizeof(socketAddr);
+        // Non-blocking listener, take everything that is pending
+        while (d->isListen)
+        {
+            SOCKADDR_IN socketAddr;
+            int sockaddrLen = sizeof(socketAddr);
+
+            SOCKET newsockfd = ::accept(d->socketFd, (SOCKADDR *)&socketAddr, &sockaddrLen);
+            if (newsockfd == INVALID_SOCKET) break;
+
+#ifdef SACore
+            if (!d->workerLoops.empty())
+            {
+                SA::EventLoop *loop = d->workerLoops[d->nextWorker++ % d->workerLoops.size()];
+                std::function<void (int, uint32_t, uint16_t)> handler = d->workerHandler;
+                uint32_t host = socketAddr.sin_addr.s_addr;
+                uint16_t port = socketAddr.sin_port;
+
+                loop->post([handler, newsockfd, host, port]() { handler(static_cast<int>(newsockfd), host, port); });
+                continue;
+            }
+#endif
+
+            if (d->isAcceptAwaited)
+                resumeAcceptor({static_cast<int>(newsockfd), socketAddr.sin_addr.s_addr, socketAddr.sin_port});
+            else if (!d->connectionHandlers.isEmpty())
+                addConnection(static_cast<int>(newsockfd));
+            else
+                d->connectHandlers(static_cast<int>(newsockfd), socketAddr.sin_addr.s_addr, socketAddr.sin_port);
+        }
+    }
+
+    int TcpServer::addConnectionHandler(const std::function<void (int, SA::TcpSocket &)> &func)
+    {
+        return d->connectionHandlers.add(func);
+    }
 
-        SOCKET newsockfd = ::accept(d->socketFd, (SOCKADDR *)&socketAddr, &sockaddrLen);
+    void TcpServer::removeConnectionHandler(int id)
+    {
+        d->connectionHandlers.remove(id);
+    }
 
-        if (newsockfd != SOCKET_ERROR)
+    int TcpServer::addDisconnectionHandler(const std::function<void (int)> &func)
+    {
+        return d->disconnectionHandlers.add(func);
+    }
+
+    void TcpServer::removeDisconnectionHandler(int id)
+    {
+        d->disconnectionHandlers.remove(id);
+    }
+
+    SA::TcpSocket *TcpServer::connection(int id)
+    {
+        TcpServerPrivate::Connection *connection = d->connections.find(id);
+        if (!connection || connection->isClosed) return nullptr;
+        return &connection->socket;
+    }
+
+    size_t TcpServer::connectionCount()
+    {
+        return d->connections.size() - d->closedConnections.size();
+    }
+
+    void TcpServer::closeConnection(int id)
+    {
+        TcpServerPrivate::Connection *connection = d->connections.find(id);
+        if (!connection || connection->isClosed) return;
+
+        connection->socket.disconnect();
+        releaseConnection(id);
+    }
+
+    void TcpServer::forEachConnection(const std::function<void (int, SA::TcpSocket &)> &func)
+    {
+        d->connections.forEach([&func](int id, TcpServerPrivate::Connection &connection) {
+            if (!connection.isClosed) func(id, connection.socket);
+        });
+    }
+
+    void TcpServer::addConnection(int descr)
+    {
+        int id = d->connections.emplace();
+        TcpServerPrivate::Connection *connection = d->connections.find(id);
+
+        if (!connection)
         {
-            d->sockets.push_back(newsockfd);
+            ::closesocket(static_cast<SOCKET>(descr));
+            return;
+        }
+
+        connection->socket.setDescriptor(descr);
+        connection->socket.addDisconnectHandler([this, id](int) { releaseConnection(id); });
 
-            for (const auto &it: d->connectHandlers)
-                it.second(static_cast<int>(newsockfd), socketAddr.sin_addr.s_addr, socketAddr.sin_port);
+        d->connectionHandlers(id, connection->socket);
+    }
+
+    void TcpServer::releaseConnection(int id)
+    {
+        TcpServerPrivate::Connection *connection = d->connections.find(id);
+        if (!connection || connection->isClosed) return;
+
+        connection->isClosed = true;
+        d->closedConnections.push_back(id);
+        d->disconnectionHandlers(id);
+
+        // The socket may be inside its own handler, destroy it from the loop
+        if (d->closedConnections.size() > 1) return;
+
+#ifdef SACore
+        std::shared_ptr<bool> isAlive = d->isAlive;
+        d->loop->post([this, isAlive]() { if (*isAlive) deleteClosedConnections(); });
+#endif
+    }
+
+    void TcpServer::deleteClosedConnections()
+    {
+        for (int id : d->closedConnections)
+            d->connections.remove(id);
+
+        d->closedConnections.clear();
+    }
+
+    TcpServer::AcceptAwaiter TcpServer::accept()
+    {
+        d->isAcceptAwaited = true;
+        return AcceptAwaiter{this, AcceptResult()};
+    }
+
+    bool TcpServer::AcceptAwaiter::await_ready()
+    {
+        if (!server->d->acceptQueue.empty())
+        {
+            result = server->d->acceptQueue.front();
+            server->d->acceptQueue.pop_front();
+            return true;
+        }
+
+        return !server->isListen();
+    }
+
+    bool TcpServer::AcceptAwaiter::await_suspend(std::coroutine_handle<> handle)
+    {
+        // Another coroutine is waiting already, this one gets descriptor -1
+        if (server->d->acceptHandle) return false;
+
+        server->d->acceptAwaiter = this;
+        server->d->acceptHandle = handle;
+        return true;
+    }
+
+    void TcpServer::resumeAcceptor(const AcceptResult &result)
+    {
+        if (!d->acceptHandle)
+        {
+            if (result.descriptor > -1)
+                d->acceptQueue.push_back(result);
+            return;
         }
+
+        std::coroutine_handle<> handle = d->acceptHandle;
+        d->acceptHandle = nullptr;
+        d->acceptAwaiter->result = result;
+        d->acceptAwaiter = nullptr;
+        handle.resume();
     }
 
     bool TcpServer::createServer()
@@ -125,9 +334,6 @@ namespace SA
             int iSetOption = 0;
             setsockopt(d->socketFd, SOL_SOCKET, SO_REUSEADDR, (char*)&iSetOption, sizeof(iSetOption));
 
-            int iVal = 10;
-            setsockopt(d->socketFd, SOL_SOCKET, SO_RCVTIMEO, (char *)&iVal, sizeof(iVal));
-
             unsigned long iMode = 1;
             int res = ioctlsocket(d->socketFd, FIONBIO, &iMode);
             isSocketCreated = (res == NO_ERROR);
@@ -140,12 +346,8 @@ namespace SA
     {
         d->isListen = false;
 
-        for (int socketFd : d->sockets) {
-            if (socketFd != INVALID_SOCKET) {
-                ::shutdown(socketFd, SD_BOTH);
-                ::closesocket(socketFd);
-            }
-        }
+        d->workerLoops.clear();
+        d->workerHandler = nullptr;
 
         if (d->socketFd != INVALID_SOCKET) {
             ::shutdown(d->socketFd, SD_BOTH);
@@ -1,6 +1,11 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <coroutine>
 #include <functional>
 
 namespace SA
@@ -8,31 +13,109 @@ namespace SA
     class TcpSocket
     {
     public:
+        // Unconsumed bytes the socket buffers at most. A full buffer that no
+        // read handler consumes from fails the socket with EMSGSIZE.
+        static const size_t MaxReadSize = 4 * 1024 * 1024;
+
         TcpSocket();
         virtual ~TcpSocket();
 
+        // Blocking, host is an IPv4 or IPv6 address or a name
         bool connect(uint32_t host, uint16_t port);
         bool connect(const char* host, uint16_t port);
         bool connect(const std::string &host, uint16_t port);
 
+        // Returns at once and connects through the event loop. Names are
+        // resolved on the application's thread pool. The addresses are tried
+        // alternating IPv6 and IPv4, a new attempt starts every 250 ms while
+        // the earlier ones are pending and the first to connect wins (happy
+        // eyeballs, RFC 8305). Then connect handlers are called, or error
+        // handlers with the errno of the last failure: ETIMEDOUT after timeout
+        // ms (0 leaves it to the kernel), EHOSTUNREACH if nothing resolved.
+        // disconnect() cancels it. Error handlers also get EMSGSIZE before a
+        // connected socket is closed because its read buffer is full.
+        bool connectAsync(const std::string &host, uint16_t port, int timeout = 10000);
+        bool isConnecting();
+
+        int addConnectHandler(const std::function<void ()> &func);
+        void removeConnectHandler(int id);
+
+        int addErrorHandler(const std::function<void (int error)> &func);
+        void removeErrorHandler(int id);
+
         bool isConnected();
         void disconnect();
 
+        // What the kernel does not take right away is queued and flushed once
+        // the socket is writable. Moved and shared buffers are queued without
+        // a copy. Replies sent from read handlers go out together in one call
+        // once the handlers return.
         bool send(const std::vector<char> &data);
+        bool send(std::vector<char> &&data);
+        bool send(const std::shared_ptr<const std::vector<char> > &data);
+
+        // Queues size bytes of the file from offset (all that follows by
+        // default), the kernel copies them from the page cache (sendfile)
+        bool sendFile(const std::string &path, size_t offset = 0, size_t size = SIZE_MAX);
+
+        // Ends the sending side once the write queue is flushed. The peer
+        // gets everything and then the end of stream, disconnect handlers
+        // run as usual once it closes.
+        void shutdown();
+
+        // Backpressure: isWritable() turns false once more than high bytes
+        // are queued, drain handlers are called when it is back under low.
+        void setWriteWatermarks(size_t low, size_t high);
+        size_t bytesToWrite();
+        bool isWritable();
+
+        int addDrainHandler(const std::function<void ()> &func);
+        void removeDrainHandler(int id);
 
         int descriptor();
         void setDescriptor(int descr);
 
-        int addReadHandler(const std::function<void (const std::vector<char> &)> &func);
+        // Handlers see every byte that is buffered and not consumed yet, and
+        // return how many they consumed. The rest is offered again together
+        // with the next read, the most any handler consumed is dropped.
+        int addReadHandler(const std::function<size_t (std::span<const char> data)> &func);
         void removeReadHandler(int id);
 
         int addDisconnectHandler(const std::function<void (int descr)> &func);
         void removeDisconnectHandler(int id);
         void mainLoopHandler();
 
+        struct ReadAwaiter
+        {
+            SA::TcpSocket *socket = nullptr;
+            std::vector<char> data;
+
+            bool await_ready();
+            bool await_suspend(std::coroutine_handle<> handle);
+            std::vector<char> await_resume() { return std::move(data); }
+        };
+
+        // co_await read() resumes with the next received bytes, or with an
+        // empty vector once the socket is disconnected. After the first call
+        // data that arrives between reads is buffered for the next one, more
+        // than MaxReadSize fails the socket like a full read buffer. One
+        // coroutine reads at a time, others resume at once with nothing.
+        ReadAwaiter read();
+
     private:
-        bool createSocket();
+        bool createSocket(int family);
         void deleteSocket();
+        void startConnectAttempt();
+        void processConnectAttempt(int descr);
+        void finishConnect(int descr, int error);
+        void stopConnecting();
+        void resumeReader();
+        void failRead();
+        void flushWriteQueue();
+        bool flushFile(); // Linux only, files are read into the queue elsewhere
+        size_t prepareReadSpace();
+        void processReadData(size_t bytesRead);
+        void processReceived(std::span<const char> data, int result);
 
         TcpSocket(const SA::TcpSocket &) = delete;
         TcpSocket(SA::TcpSocket &&) = delete;
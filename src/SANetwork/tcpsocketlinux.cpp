@@ -3,79 +3,285 @@
 #include <memory>
 #include <vector>
 #include <string>
-#include <map>
+#include <deque>
+#include <algorithm>
+#include <cstring>
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
+#include <netdb.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <cerrno>
 
 #include "tcpsocket.h"
+#include "handlerlist.h"
 
 #ifdef SACore
+#include "eventloop.h"
 #include "application.h"
+#include "threadpool.h"
 #endif
 
-static const size_t DefaultLen = 1024;
+static const size_t InitialReadSize = 4 * 1024;
+static const size_t ReadGrowLimit = 256 * 1024;
 static const int ConnectionCheckInterval = 500;
+static const size_t DefaultLowWatermark = 256 * 1024;
+static const size_t DefaultHighWatermark = 1024 * 1024;
+static const int MaxWriteChunks = 64;
+static const size_t MaxSendFileSize = 1024 * 1024;
+static const int ConnectAttemptDelay = 250;
 
 namespace SA
 {
+    struct FileDescriptor
+    {
+        int descr;
+        ~FileDescriptor() { ::close(descr); }
+    };
+
+    // Owned bytes, a shared buffer or a file range, the offset tracks
+    // partial writes (the file position for files, up to fileEnd)
+    struct WriteChunk
+    {
+        std::vector<char> data;
+        std::shared_ptr<const std::vector<char> > shared;
+        std::shared_ptr<FileDescriptor> file;
+        size_t fileEnd = 0;
+        size_t offset = 0;
+
+        const char *begin() const { return (shared ? shared->data() : data.data()) + offset; }
+        size_t size() const { return (file ? fileEnd : shared ? shared->size() : data.size()) - offset; }
+    };
+
+    struct Endpoint
+    {
+        sockaddr_storage address;
+        socklen_t size;
+    };
+
+    // Both families alternately, starting with the one getaddrinfo puts
+    // first (RFC 6724 order, IPv6 where it is reachable)
+    static std::vector<Endpoint> resolve(const std::string &host, uint16_t port, int flags)
+    {
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = flags | AI_NUMERICSERV;
+
+        addrinfo *list = nullptr;
+        if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &list) != 0 || !list)
+            return {};
+
+        std::vector<Endpoint> first, second;
+        for (addrinfo *info = list; info; info = info->ai_next)
+        {
+            if (info->ai_addrlen > sizeof(sockaddr_storage)) continue;
+
+            Endpoint endpoint = {};
+            std::memcpy(&endpoint.address, info->ai_addr, info->ai_addrlen);
+            endpoint.size = info->ai_addrlen;
+            (info->ai_family == list->ai_family ? first : second).push_back(endpoint);
+        }
+        ::freeaddrinfo(list);
+
+        std::vector<Endpoint> endpoints;
+        for (size_t i=0; i<std::max(first.size(), second.size()); ++i)
+        {
+            if (i < first.size()) endpoints.push_back(first[i]);
+            if (i < second.size()) endpoints.push_back(second[i]);
+        }
+        return endpoints;
+    }
+
     struct TcpSocket::TcpSocketPrivate
     {
+        SA::EventLoop *loop = nullptr;
         int socketFd = -1;
-        int mainLoopId = -1;
         bool isConnected = false;
         sockaddr_in address;
 
-        std::vector<char> dataIn, dataTmp;
-        std::map<int, std::function<void (const std::vector<char>&)> > readHandlers;
-        std::map<int, std::function<void (int)> > disconnectHandlers;
+        // connectAsync(): the addresses to try and the sockets in flight.
+        // Posted calls and resolver results only count while the token is
+        // the one they were made with.
+        bool isConnecting = false;
+        std::vector<Endpoint> connectAddresses;
+        size_t nextAddress = 0;
+        std::vector<int> connectAttempts;
+        int connectError = 0;
+        int attemptTimer = -1;
+        int connectTimer = -1;
+        std::shared_ptr<int> connectToken;
+        SA::HandlerList<void ()> connectHandlers;
+        SA::HandlerList<void (int)> errorHandlers;
+
+        // Unconsumed bytes live in [readBegin, readEnd), recv appends after them
+        std::vector<char> dataIn;
+        size_t readBegin = 0;
+        size_t readEnd = 0;
+        SA::HandlerList<size_t (std::span<const char>)> readHandlers;
+        SA::HandlerList<void (int)> disconnectHandlers;
+
+        std::deque<WriteChunk> writeQueue;
+        size_t writeQueueSize = 0;
+        size_t lowWatermark = DefaultLowWatermark;
+        size_t highWatermark = DefaultHighWatermark;
+        bool isWriteBlocked = false;
+        bool isWriteWatched = false;
+        bool isShutdownPending = false;
+
+        // Replies that read handlers send go out together once they return
+        bool isWriteHeld = false;
+        SA::HandlerList<void ()> drainHandlers;
+
+        // The loop receives for us (io_uring), only writability is polled
+        bool isReceiving = false;
+
+        bool isReadAwaited = false;
+        std::vector<char> readBuffer;
+        ReadAwaiter *readAwaiter = nullptr;
+        std::coroutine_handle<> readHandle;
     };
 
     TcpSocket::TcpSocket():
         d(new TcpSocketPrivate)
     {
-        d->dataIn.resize(DefaultLen, 0);
-        d->dataTmp.reserve(DefaultLen);
-
 #ifdef SACore
-        d->mainLoopId = SA::Application::instance().addMainLoopListener(std::bind(&TcpSocket::mainLoopHandler, this));
+        d->loop = SA::EventLoop::current();
 #endif
+
+        d->dataIn.resize(InitialReadSize);
     }
 
     SA::TcpSocket::~TcpSocket()
     {
-#ifdef SACore
-        SA::Application::instance().removeMainLoopListener(d->mainLoopId);
-#endif
+        stopConnecting();
         deleteSocket();
         delete d;
     }
 
     bool TcpSocket::connect(uint32_t host, uint16_t port)
     {
-        if (!createSocket()) return false;
+        stopConnecting();
+        if (!createSocket(AF_INET)) return false;
 
         d->address.sin_family = AF_INET;
         d->address.sin_port = htons(port);
         d->address.sin_addr.s_addr = htonl(host);
 
         int state = ::connect(d->socketFd, (struct sockaddr *)&d->address, sizeof(d->address));
-        d->isConnected = (state > -1);
+
+        if (state > -1)
+        {
+            setDescriptor(d->socketFd);
+        }
+        else
+        {
+            ::close(d->socketFd);
+            d->socketFd = -1;
+        }
 
         return d->isConnected;
     }
 
     bool TcpSocket::connect(const char* host, uint16_t port)
     {
-        return connect(htonl(inet_addr(host)), port);
+        return connect(std::string(host), port);
     }
 
     bool TcpSocket::connect(const std::string &host, uint16_t port)
     {
-        return connect(host.c_str(), port);
+        stopConnecting();
+
+        for (const Endpoint &endpoint : resolve(host, port, 0))
+        {
+            if (!createSocket(endpoint.address.ss_family)) continue;
+
+            if (::connect(d->socketFd, reinterpret_cast<const sockaddr *>(&endpoint.address), endpoint.size) > -1)
+            {
+                setDescriptor(d->socketFd);
+                return d->isConnected;
+            }
+
+            ::close(d->socketFd);
+            d->socketFd = -1;
+        }
+
+        return false;
+    }
+
+    bool TcpSocket::connectAsync(const std::string &host, uint16_t port, int timeout)
+    {
+#ifdef SACore
+        if (d->isConnected || d->isConnecting) return false;
+
+        d->isConnecting = true;
+        d->connectError = 0;
+        d->connectToken = std::make_shared<int>(0);
+        std::weak_ptr<int> token = d->connectToken;
+
+        if (timeout > 0)
+        {
+            d->connectTimer = d->loop->singleShot(timeout, [this]() {
+                d->connectTimer = -1;
+                finishConnect(-1, ETIMEDOUT);
+            });
+        }
+
+        auto start = [this, token](std::vector<Endpoint> endpoints) {
+            if (token.expired()) return;
+            d->connectAddresses = std::move(endpoints);
+            d->nextAddress = 0;
+            startConnectAttempt();
+        };
+
+        // Addresses need no lookup, handlers still run from the loop only
+        std::vector<Endpoint> endpoints = resolve(host, port, AI_NUMERICHOST);
+        if (!endpoints.empty())
+        {
+            d->loop->post([start, endpoints]() { start(endpoints); });
+            return true;
+        }
+
+        SA::Application::instance().threadPool().submit([host, port]() {
+            return resolve(host, port, AI_ADDRCONFIG);
+        }).then(start);
+
+        return true;
+#else
+        (void)host; (void)port; (void)timeout;
+        return false;
+#endif
+    }
+
+    bool TcpSocket::isConnecting()
+    {
+        return d->isConnecting;
+    }
+
+    int TcpSocket::addConnectHandler(const std::function<void ()> &func)
+    {
+        return d->connectHandlers.add(func);
+    }
+
+    void TcpSocket::removeConnectHandler(int id)
+    {
+        d->connectHandlers.remove(id);
+    }
+
+    int TcpSocket::addErrorHandler(const std::function<void (int)> &func)
+    {
+        return d->errorHandlers.add(func);
+    }
+
+    void TcpSocket::removeErrorHandler(int id)
+    {
+        d->errorHandlers.remove(id);
     }
 
     bool TcpSocket::isConnected()
@@ -85,13 +291,146 @@ namespace SA
 
     void TcpSocket::disconnect()
     {
+        stopConnecting();
+
+        // Hand over what the kernel can still take, the rest is dropped
+        d->isWriteHeld = false;
+        flushWriteQueue();
         deleteSocket();
     }
 
     bool TcpSocket::send(const std::vector<char> &data)
     {
         if (!d->isConnected) return false;
-        return (::send(d->socketFd, data.data(), data.size(), 0) > -1);
+        if (data.empty()) return true;
+
+        size_t bytesSent = 0;
+        if (d->writeQueue.empty() && !d->isWriteHeld)
+        {
+            ssize_t result = ::send(d->socketFd, data.data(), data.size(), MSG_NOSIGNAL);
+
+            if (result > -1)
+                bytesSent = static_cast<size_t>(result);
+            else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                return false;
+
+            if (bytesSent == data.size()) return true;
+        }
+
+        WriteChunk chunk;
+        chunk.data.assign(data.begin() + static_cast<ptrdiff_t>(bytesSent), data.end());
+        d->writeQueueSize += chunk.size();
+        d->writeQueue.push_back(std::move(chunk));
+        flushWriteQueue();
+
+        return true;
+    }
+
+    bool TcpSocket::send(std::vector<char> &&data)
+    {
+        if (!d->isConnected) return false;
+        if (data.empty()) return true;
+
+        size_t bytesSent = 0;
+        if (d->writeQueue.empty() && !d->isWriteHeld)
+        {
+            ssize_t result = ::send(d->socketFd, data.data(), data.size(), MSG_NOSIGNAL);
+
+            if (result > -1)
+                bytesSent = static_cast<size_t>(result);
+            else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                return false;
+
+            if (bytesSent == data.size()) return true;
+        }
+
+        // The rest is queued in place, the offset skips what went out
+        WriteChunk chunk;
+        chunk.data = std::move(data);
+        chunk.offset = bytesSent;
+        d->writeQueueSize += chunk.size();
+        d->writeQueue.push_back(std::move(chunk));
+        flushWriteQueue();
+
+        return true;
+    }
+
+    bool TcpSocket::send(const std::shared_ptr<const std::vector<char> > &data)
+    {
+        if (!d->isConnected || !data) return false;
+        if (data->empty()) return true;
+
+        WriteChunk chunk;
+        chunk.shared = data;
+        d->writeQueueSize += chunk.size();
+        d->writeQueue.push_back(std::move(chunk));
+        flushWriteQueue();
+
+        return true;
+    }
+
+    bool TcpSocket::sendFile(const std::string &path, size_t offset, size_t size)
+    {
+        if (!d->isConnected) return false;
+
+        int descr = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (descr < 0) return false;
+
+        auto file = std::make_shared<FileDescriptor>();
+        file->descr = descr;
+
+        struct stat info;
+        if (::fstat(descr, &info) < 0 || !S_ISREG(info.st_mode)) return false;
+
+        size_t fileSize = static_cast<size_t>(info.st_size);
+        if (offset > fileSize) return false;
+
+        size = std::min(size, fileSize - offset);
+        if (size == 0) return true;
+
+        WriteChunk chunk;
+        chunk.file = file;
+        chunk.offset = offset;
+        chunk.fileEnd = offset + size;
+        d->writeQueueSize += chunk.size();
+        d->writeQueue.push_back(std::move(chunk));
+        flushWriteQueue();
+
+        return true;
+    }
+
+    void TcpSocket::shutdown()
+    {
+        if (!d->isConnected) return;
+
+        d->isShutdownPending = true;
+        flushWriteQueue();
+    }
+
+    void TcpSocket::setWriteWatermarks(size_t low, size_t high)
+    {
+        d->lowWatermark = std::min(low, high);
+        d->highWatermark = high;
+    }
+
+    size_t TcpSocket::bytesToWrite()
+    {
+        return d->writeQueueSize;
+    }
+
+    bool TcpSocket::isWritable()
+    {
+        return d->isConnected && !d->isWriteBlocked;
+    }
+
+    int TcpSocket::addDrainHandler(const std::function<void ()> &func)
+    {
+        return d->drainHandlers.add(func);
+    }
+
+    void TcpSocket::removeDrainHandler(int id)
+    {
+        d->drainHandlers.remove(id);
     }
 
     int TcpSocket::descriptor()
@@ -110,79 +449,544 @@ namespace SA
         int res = getsockopt(descr, SOL_SOCKET, SO_ERROR, &optval, &optlen);
         d->isConnected = (optval==0 && res==0);
 
-        struct timeval read_timeout;
-        read_timeout.tv_sec = 0;
-        read_timeout.tv_usec = 10;
-        ::setsockopt(descr, SOL_SOCKET, SO_RCVTIMEO, &read_timeout, sizeof(read_timeout));
+        int flags = ::fcntl(descr, F_GETFL, 0);
+        ::fcntl(descr, F_SETFL, flags | O_NONBLOCK);
+
+#ifdef SACore
+        if (d->isConnected)
+        {
+            d->isReceiving = d->loop->addReceiveListener(descr, [this](std::span<const char> data, int result) {
+                processReceived(data, result);
+            });
+
+            d->loop->addDescriptorListener(descr, [this](int events) {
+                if (events & SA::DescriptorWrite) flushWriteQueue();
+                if (events & ~SA::DescriptorWrite) mainLoopHandler();
+            }, (d->isReceiving ? 0 : SA::DescriptorRead) | SA::DescriptorEdge);
+        }
+#endif
     }
 
-    int TcpSocket::addReadHandler(const std::function<void (const std::vector<char>&)> &func)
+    int TcpSocket::addReadHandler(const std::function<size_t (std::span<const char>)> &func)
     {
-        int id = static_cast<int>(d->readHandlers.size());
-        for (auto const& it : d->readHandlers) if (it.first != ++id) break;
-        d->readHandlers.insert({id, func});
-        return id;
+        return d->readHandlers.add(func);
     }
 
     void TcpSocket::removeReadHandler(int id)
     {
-        auto it = d->readHandlers.find(id);
-        if (it != d->readHandlers.end())
-            d->readHandlers.erase(it);
+        d->readHandlers.remove(id);
     }
 
     int TcpSocket::addDisconnectHandler(const std::function<void (int)> &func)
     {
-        int id = static_cast<int>(d->disconnectHandlers.size());
-        for (auto const& it : d->disconnectHandlers) if (it.first != ++id) break;
-        d->disconnectHandlers.insert({id, func});
-        return id;
+        return d->disconnectHandlers.add(func);
     }
 
     void TcpSocket::removeDisconnectHandler(int id)
     {
-        auto it = d->disconnectHandlers.find(id);
-        if (it != d->disconnectHandlers.end())
-            d->disconnectHandlers.erase(it);
+        d->disconnectHandlers.remove(id);
     }
 
     void TcpSocket::mainLoopHandler()
     {
-        if (!d->isConnected) return;
+        if (!d->writeQueue.empty())
+            flushWriteQueue();
+
+        // Errors and hangups come through processReceived() as well
+        if (d->isReceiving) return;
 
-        ssize_t bytesRead = ::recv(d->socketFd, d->dataIn.data(), d->dataIn.size(), 0);
+        // Edge-triggered, so drain until the kernel buffer is empty.
+        // Handlers may disconnect the socket, check it on every pass.
+        while (d->isConnected)
+        {
+            size_t space = prepareReadSpace();
+            if (space == 0) break;
+
+            ssize_t bytesRead = ::recv(d->socketFd, d->dataIn.data() + d->readEnd, space, 0);
+
+            if (bytesRead > 0)
+            {
+                processReadData(static_cast<size_t>(bytesRead));
+
+                // A full read means more is coming, read bigger pieces
+                if (static_cast<size_t>(bytesRead) == space && d->dataIn.size() < ReadGrowLimit)
+                    d->dataIn.resize(d->dataIn.size() * 2);
+            }
+            else if (bytesRead < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            else if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                break;
+            }
+            else
+            {
+                deleteSocket();
+
+                d->disconnectHandlers(d->socketFd);
+
+                resumeReader();
+            }
+        }
+    }
 
-        if (bytesRead > 0)
+    TcpSocket::ReadAwaiter TcpSocket::read()
+    {
+        d->isReadAwaited = true;
+        return ReadAwaiter{this, {}};
+    }
+
+    bool TcpSocket::ReadAwaiter::await_ready()
+    {
+        if (socket->d->readBuffer.empty() && socket->isConnected())
+            return false;
+
+        data.swap(socket->d->readBuffer);
+        return true;
+    }
+
+    bool TcpSocket::ReadAwaiter::await_suspend(std::coroutine_handle<> handle)
+    {
+        // Another coroutine is waiting already, this one gets nothing
+        if (socket->d->readHandle) return false;
+
+        socket->d->readAwaiter = this;
+        socket->d->readHandle = handle;
+        return true;
+    }
+
+    void TcpSocket::resumeReader()
+    {
+        if (!d->readHandle) return;
+
+        std::coroutine_handle<> handle = d->readHandle;
+        d->readHandle = nullptr;
+        d->readAwaiter->data.swap(d->readBuffer);
+        d->readAwaiter = nullptr;
+        handle.resume();
+    }
+
+    size_t TcpSocket::prepareReadSpace()
+    {
+        size_t size = d->dataIn.size();
+        if (size - d->readEnd >= size / 4)
+            return size - d->readEnd;
+
+        // Move what handlers left to the front, grow only if that is not enough
+        if (d->readBegin > 0)
         {
-            d->dataTmp.clear();
-            d->dataTmp.insert(d->dataTmp.begin(), d->dataIn.begin(), d->dataIn.begin() + bytesRead);
+            std::memmove(d->dataIn.data(), d->dataIn.data() + d->readBegin, d->readEnd - d->readBegin);
+            d->readEnd -= d->readBegin;
+            d->readBegin = 0;
+        }
 
-            for (const auto &it: d->readHandlers)
-                it.second(d->dataTmp);
+        if (size - d->readEnd < size / 4)
+        {
+            if (size < MaxReadSize)
+                d->dataIn.resize(size * 2);
+            else if (d->readEnd == size)
+            {
+                // Nobody consumes anything and the stream can't be cut
+                failRead();
+                return 0;
+            }
         }
-        else if(bytesRead == 0)
+
+        return d->dataIn.size() - d->readEnd;
+    }
+
+    void TcpSocket::failRead()
+    {
+        // An error handler may have disconnected it already
+        d->errorHandlers(EMSGSIZE);
+        if (d->isConnected)
         {
             deleteSocket();
 
-            for (const auto &it: d->disconnectHandlers)
-                it.second(d->socketFd);
+            d->disconnectHandlers(d->socketFd);
+        }
+
+        resumeReader();
+    }
+
+    void TcpSocket::processReadData(size_t bytesRead)
+    {
+        const char *received = d->dataIn.data() + d->readEnd;
+        d->readEnd += bytesRead;
+
+        if (d->isReadAwaited)
+        {
+            // Same as above for bytes no coroutine reads
+            if (d->readBuffer.size() + bytesRead > MaxReadSize)
+            {
+                failRead();
+                return;
+            }
+
+            d->readBuffer.insert(d->readBuffer.end(), received, received + bytesRead);
+        }
+
+        std::span<const char> data(d->dataIn.data() + d->readBegin, d->readEnd - d->readBegin);
+        size_t consumed = d->readHandlers.isEmpty() ? data.size() : 0;
+
+        d->isWriteHeld = true;
+        d->readHandlers.forEach([&](int, const std::function<size_t (std::span<const char>)> &handler) {
+            consumed = std::max(consumed, handler(data));
+        });
+        d->isWriteHeld = false;
+
+        // A handler that disconnected has already emptied the buffer
+        if (d->isConnected)
+        {
+            d->readBegin += std::min(consumed, data.size());
+            if (d->readBegin == d->readEnd)
+                d->readBegin = d->readEnd = 0;
+        }
+
+        flushWriteQueue();
+
+        if (d->isReadAwaited)
+            resumeReader();
+    }
+
+    void TcpSocket::processReceived(std::span<const char> data, int result)
+    {
+        if (!d->isConnected) return;
+
+        if (result > 0)
+        {
+            // Nothing left over from before: handlers read the loop's buffer
+            // in place and only the tail they leave is copied
+            if (d->readBegin == d->readEnd && !d->isReadAwaited)
+            {
+                size_t consumed = d->readHandlers.isEmpty() ? data.size() : 0;
+
+                d->isWriteHeld = true;
+                d->readHandlers.forEach([&](int, const std::function<size_t (std::span<const char>)> &handler) {
+                    consumed = std::max(consumed, handler(data));
+                });
+                d->isWriteHeld = false;
+
+                flushWriteQueue();
+
+                // The loop's buffer goes back to the kernel after this call,
+                // keep the rest where handlers expect unconsumed data to be
+                data = data.subspan(std::min(consumed, data.size()));
+                while (!data.empty() && d->isConnected)
+                {
+                    size_t size = std::min(prepareReadSpace(), data.size());
+                    if (size == 0) break;
+
+                    std::memcpy(d->dataIn.data() + d->readEnd, data.data(), size);
+                    d->readEnd += size;
+                    data = data.subspan(size);
+                }
+                return;
+            }
+
+            size_t offset = 0;
+            while (offset < data.size() && d->isConnected)
+            {
+                size_t size = std::min(prepareReadSpace(), data.size() - offset);
+                if (size == 0) break;
+
+                std::memcpy(d->dataIn.data() + d->readEnd, data.data() + offset, size);
+                offset += size;
+                processReadData(size);
+            }
+        }
+        else
+        {
+            deleteSocket();
+
+            d->disconnectHandlers(d->socketFd);
+
+            resumeReader();
+        }
+    }
+
+    void TcpSocket::flushWriteQueue()
+    {
+        if (d->isWriteHeld) return;
+
+        while (d->isConnected && !d->writeQueue.empty())
+        {
+            if (d->writeQueue.front().file)
+            {
+                if (!flushFile()) break;
+                continue;
+            }
+
+            // Coalesce the queued chunks up to the next file into one syscall
+            iovec vectors[MaxWriteChunks];
+            int count = 0;
+
+            auto it = d->writeQueue.begin();
+            for (; it != d->writeQueue.end() && !it->file && count < MaxWriteChunks; ++it, ++count)
+            {
+                vectors[count].iov_base = const_cast<char*>(it->begin());
+                vectors[count].iov_len = it->size();
+            }
+
+            // A header before a file shares the first segment with it
+            int flags = MSG_NOSIGNAL;
+            if (it != d->writeQueue.end() && it->file) flags |= MSG_MORE;
+
+            msghdr message = {};
+            message.msg_iov = vectors;
+            message.msg_iovlen = static_cast<size_t>(count);
+
+            ssize_t result = ::sendmsg(d->socketFd, &message, flags);
+
+            if (result < 0)
+            {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+                // The connection is gone, the read side reports it
+                d->writeQueue.clear();
+                d->writeQueueSize = 0;
+                break;
+            }
+
+            size_t written = static_cast<size_t>(result);
+            d->writeQueueSize -= written;
+
+            while (written > 0)
+            {
+                WriteChunk &chunk = d->writeQueue.front();
+                if (written < chunk.size())
+                {
+                    chunk.offset += written;
+                    break;
+                }
+
+                written -= chunk.size();
+                d->writeQueue.pop_front();
+            }
+        }
+
+        if (d->isShutdownPending && d->isConnected && d->writeQueue.empty())
+        {
+            d->isShutdownPending = false;
+            ::shutdown(d->socketFd, SHUT_WR);
+        }
+
+#ifdef SACore
+        // Only ask for writability while something is waiting for it
+        bool isWriteWatched = d->isConnected && !d->writeQueue.empty();
+        if (isWriteWatched != d->isWriteWatched)
+        {
+            d->isWriteWatched = isWriteWatched;
+            d->loop->setDescriptorEvents(d->socketFd, (d->isReceiving ? 0 : SA::DescriptorRead) | SA::DescriptorEdge |
+                                         (isWriteWatched ? SA::DescriptorWrite : 0));
         }
+#endif
+
+        if (d->writeQueueSize > d->highWatermark)
+        {
+            d->isWriteBlocked = true;
+        }
+        else if (d->isWriteBlocked && d->writeQueueSize <= d->lowWatermark)
+        {
+            d->isWriteBlocked = false;
+            d->drainHandlers();
+        }
+    }
+
+    bool TcpSocket::flushFile()
+    {
+        WriteChunk &chunk = d->writeQueue.front();
+        off_t offset = static_cast<off_t>(chunk.offset);
+        ssize_t result = ::sendfile(d->socketFd, chunk.file->descr, &offset, std::min(chunk.size(), MaxSendFileSize));
+
+        if (result < 0 && errno == EINTR) return true;
+        if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return false;
+
+        if (result <= 0)
+        {
+            // Failed or the file got shorter, the peer must not take the
+            // rest for a complete response: end the connection, the read
+            // side reports it
+            d->writeQueue.clear();
+            d->writeQueueSize = 0;
+            ::shutdown(d->socketFd, SHUT_RDWR);
+            return false;
+        }
+
+        chunk.offset += static_cast<size_t>(result);
+        d->writeQueueSize -= static_cast<size_t>(result);
+        if (chunk.size() == 0) d->writeQueue.pop_front();
+
+        return true;
     }
 
-    bool TcpSocket::createSocket()
+    bool TcpSocket::createSocket(int family)
     {
         d->isConnected = false;
-        int descr = socket(AF_INET, SOCK_STREAM, 0);
-        setDescriptor(descr);
-        return (descr > -1);
+        d->socketFd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        return (d->socketFd > -1);
+    }
+
+    void TcpSocket::startConnectAttempt()
+    {
+#ifdef SACore
+        if (d->attemptTimer > -1)
+        {
+            d->loop->killTimer(d->attemptTimer);
+            d->attemptTimer = -1;
+        }
+
+        while (d->nextAddress < d->connectAddresses.size())
+        {
+            const Endpoint &endpoint = d->connectAddresses[d->nextAddress++];
+
+            int descr = ::socket(endpoint.address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (descr < 0)
+            {
+                d->connectError = errno;
+                continue;
+            }
+
+            if (::connect(descr, reinterpret_cast<const sockaddr *>(&endpoint.address), endpoint.size) == 0)
+            {
+                finishConnect(descr, 0);
+                return;
+            }
+
+            if (errno != EINPROGRESS)
+            {
+                d->connectError = errno;
+                ::close(descr);
+                continue;
+            }
+
+            // Writable once connected or failed
+            d->connectAttempts.push_back(descr);
+            d->loop->addDescriptorListener(descr, [this, descr](int) {
+                processConnectAttempt(descr);
+            }, SA::DescriptorWrite);
+
+            // The next address gets its turn early if this one is slow
+            if (d->nextAddress < d->connectAddresses.size())
+            {
+                d->attemptTimer = d->loop->singleShot(ConnectAttemptDelay, [this]() {
+                    d->attemptTimer = -1;
+                    startConnectAttempt();
+                });
+            }
+            return;
+        }
+
+        if (d->connectAttempts.empty())
+            finishConnect(-1, d->connectError != 0 ? d->connectError : EHOSTUNREACH);
+#endif
+    }
+
+    void TcpSocket::processConnectAttempt(int descr)
+    {
+        int error = 0;
+        socklen_t size = sizeof(error);
+        if (::getsockopt(descr, SOL_SOCKET, SO_ERROR, &error, &size) < 0)
+            error = errno;
+
+        // Only a peer means connected. The error may be gone already (polls
+        // through io_uring), then a read tells failed from still pending.
+        if (error == 0)
+        {
+            sockaddr_storage peer;
+            socklen_t peerSize = sizeof(peer);
+            if (::getpeername(descr, reinterpret_cast<sockaddr *>(&peer), &peerSize) == 0)
+            {
+                finishConnect(descr, 0);
+                return;
+            }
+
+            char byte;
+            error = ::recv(descr, &byte, 1, MSG_PEEK) < 0 ? errno : ENOTCONN;
+            if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR) return;
+        }
+
+#ifdef SACore
+        d->loop->removeDescriptorListener(descr);
+#endif
+        ::close(descr);
+        d->connectAttempts.erase(std::find(d->connectAttempts.begin(), d->connectAttempts.end(), descr));
+        d->connectError = error;
+
+        // A failure does not wait for the delay
+        startConnectAttempt();
+    }
+
+    void TcpSocket::finishConnect(int descr, int error)
+    {
+        // The winner is taken out first, the other attempts are dropped
+        auto winner = std::find(d->connectAttempts.begin(), d->connectAttempts.end(), descr);
+        if (winner != d->connectAttempts.end())
+        {
+#ifdef SACore
+            d->loop->removeDescriptorListener(descr);
+#endif
+            d->connectAttempts.erase(winner);
+        }
+
+        stopConnecting();
+
+        if (descr > -1)
+        {
+            setDescriptor(descr);
+            d->connectHandlers();
+        }
+        else
+        {
+            d->errorHandlers(error);
+        }
+    }
+
+    void TcpSocket::stopConnecting()
+    {
+        if (!d->isConnecting) return;
+
+#ifdef SACore
+        if (d->attemptTimer > -1) d->loop->killTimer(d->attemptTimer);
+        if (d->connectTimer > -1) d->loop->killTimer(d->connectTimer);
+
+        for (int descr : d->connectAttempts)
+        {
+            d->loop->removeDescriptorListener(descr);
+            ::close(descr);
+        }
+#endif
+
+        d->attemptTimer = d->connectTimer = -1;
+        d->connectAttempts.clear();
+        d->connectAddresses.clear();
+        d->connectToken.reset();
+        d->isConnecting = false;
     }
 
     void TcpSocket::deleteSocket()
     {
         if (d->isConnected)
+        {
+#ifdef SACore
+            if (d->isReceiving)
+                d->loop->removeReceiveListener(d->socketFd);
+
+            d->loop->removeDescriptorListener(d->socketFd);
+#endif
             ::close(d->socketFd);
+        }
 
         d->isConnected = false;
+        d->isReceiving = false;
+        d->readBegin = d->readEnd = 0;
+        d->isWriteBlocked = false;
+        d->isWriteWatched = false;
+        d->isShutdownPending = false;
+        d->writeQueue.clear();
+        d->writeQueueSize = 0;
     }
 }
 
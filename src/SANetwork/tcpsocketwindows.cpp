@@ -1,50 +1,151 @@
 #ifdef WIN32
 
 #include <winsock2.h>
+#include <ws2tcpip.h>
 
 #include <iostream>
 #include <memory>
 #include <vector>
 #include <string>
-#include <map>
+#include <deque>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 
 #include "tcpsocket.h"
+#include "handlerlist.h"
 
 #ifdef SACore
+#include "eventloop.h"
 #include "application.h"
+#include "threadpool.h"
 #endif
 
-static const size_t DefaultLen = 1024;
+static const size_t InitialReadSize = 4 * 1024;
+static const size_t ReadGrowLimit = 256 * 1024;
+static const size_t DefaultLowWatermark = 256 * 1024;
+static const size_t DefaultHighWatermark = 1024 * 1024;
+static const DWORD MaxWriteChunks = 64;
+static const size_t MaxSendFileSize = 1024 * 1024;
+static const int ConnectAttemptDelay = 250;
 
 namespace SA
 {
+    // Owned bytes or a shared buffer, the offset tracks partial writes
+    struct WriteChunk
+    {
+        std::vector<char> data;
+        std::shared_ptr<const std::vector<char> > shared;
+        size_t offset = 0;
+
+        const char *begin() const { return (shared ? shared->data() : data.data()) + offset; }
+        size_t size() const { return (shared ? shared->size() : data.size()) - offset; }
+    };
+
+    struct Endpoint
+    {
+        sockaddr_storage address;
+        int size;
+    };
+
+    // Both families alternately, starting with the one getaddrinfo puts
+    // first (RFC 6724 order, IPv6 where it is reachable)
+    static std::vector<Endpoint> resolve(const std::string &host, uint16_t port, int flags)
+    {
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = flags | AI_NUMERICSERV;
+
+        addrinfo *list = nullptr;
+        if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &list) != 0 || !list)
+            return {};
+
+        std::vector<Endpoint> first, second;
+        for (addrinfo *info = list; info; info = info->ai_next)
+        {
+            if (info->ai_addrlen > sizeof(sockaddr_storage)) continue;
+
+            Endpoint endpoint = {};
+            std::memcpy(&endpoint.address, info->ai_addr, info->ai_addrlen);
+            endpoint.size = static_cast<int>(info->ai_addrlen);
+            (info->ai_family == list->ai_family ? first : second).push_back(endpoint);
+        }
+        ::freeaddrinfo(list);
+
+        std::vector<Endpoint> endpoints;
+        for (size_t i=0; i<std::max(first.size(), second.size()); ++i)
+        {
+            if (i < first.size()) endpoints.push_back(first[i]);
+            if (i < second.size()) endpoints.push_back(second[i]);
+        }
+        return endpoints;
+    }
+
     struct TcpSocket::TcpSocketPrivate
     {
+        SA::EventLoop *loop = nullptr;
         int mainLoopId = -1;
         SOCKET socketFd = INVALID_SOCKET;
         bool isConnected = false;
         bool isWinsockStarted = false;
         SOCKADDR_IN address;
 
-        std::vector<char> dataIn, dataTmp;
-        std::map<int, std::function<void (const std::vector<char>&)> > readHandlers;
-        std::map<int, std::function<void (int)> > disconnectHandlers;
+        // connectAsync(): the addresses to try and the sockets in flight,
+        // polled from the main loop. Posted calls and resolver results only
+        // count while the token is the one they were made with.
+        bool isConnecting = false;
+        std::vector<Endpoint> connectAddresses;
+        size_t nextAddress = 0;
+        std::vector<SOCKET> connectAttempts;
+        int connectError = 0;
+        int attemptTimer = -1;
+        int connectTimer = -1;
+        std::shared_ptr<int> connectToken;
+        SA::HandlerList<void ()> connectHandlers;
+        SA::HandlerList<void (int)> errorHandlers;
+
+        // Unconsumed bytes live in [readBegin, readEnd), recv appends after them
+        std::vector<char> dataIn;
+        size_t readBegin = 0;
+        size_t readEnd = 0;
+        SA::HandlerList<size_t (std::span<const char>)> readHandlers;
+        SA::HandlerList<void (int)> disconnectHandlers;
+
+        std::deque<WriteChunk> writeQueue;
+        size_t writeQueueSize = 0;
+        size_t lowWatermark = DefaultLowWatermark;
+        size_t highWatermark = DefaultHighWatermark;
+        bool isWriteBlocked = false;
+        bool isShutdownPending = false;
+
+        // Replies that read handlers send go out together once they return
+        bool isWriteHeld = false;
+        SA::HandlerList<void ()> drainHandlers;
+
+        bool isReadAwaited = false;
+        std::vector<char> readBuffer;
+        ReadAwaiter *readAwaiter = nullptr;
+        std::coroutine_handle<> readHandle;
     };
 
     TcpSocket::TcpSocket():
         d(new TcpSocketPrivate)
     {
+#ifdef SACore
+        d->loop = SA::EventLoop::current();
+#endif
+
         WSADATA wsa;
         long rc = WSAStartup(MAKEWORD(2, 0), &wsa);
         d->isWinsockStarted = (rc == 0);
 
         if (d->isWinsockStarted)
         {
-            d->dataIn.resize(DefaultLen, 0);
-            d->dataTmp.reserve(DefaultLen);
+            d->dataIn.resize(InitialReadSize);
 
 #ifdef SACore
-            d->mainLoopId = SA::Application::instance().addMainLoopListener(std::bind(&TcpSocket::mainLoopHandler, this));
+            d->mainLoopId = d->loop->addMainLoopListener(std::bind(&TcpSocket::mainLoopHandler, this));
 #endif
         }
     }
@@ -52,8 +153,9 @@ namespace SA
     SA::TcpSocket::~TcpSocket()
     {
 #ifdef SACore
-        SA::Application::instance().removeMainLoopListener(d->mainLoopId);
+        d->loop->removeMainLoopListener(d->mainLoopId);
 #endif
+        stopConnecting();
         deleteSocket();
         WSACleanup();
         delete d;
@@ -61,26 +163,121 @@ namespace SA
 
     bool TcpSocket::connect(uint32_t host, uint16_t port)
     {
-        if (!createSocket()) return false;
+        stopConnecting();
+        if (!createSocket(AF_INET)) return false;
 
         d->address.sin_family = AF_INET;
         d->address.sin_port = htons(port);
         d->address.sin_addr.s_addr = htonl(host);
 
         int state = ::connect(d->socketFd, (SOCKADDR *)&d->address, sizeof(d->address));
-        d->isConnected = (state > SOCKET_ERROR);
+
+        if (state > SOCKET_ERROR)
+        {
+            setDescriptor(static_cast<int>(d->socketFd));
+        }
+        else
+        {
+            ::closesocket(d->socketFd);
+            d->socketFd = INVALID_SOCKET;
+        }
 
         return d->isConnected;
     }
 
     bool TcpSocket::connect(const char* host, uint16_t port)
     {
-        return connect(htonl(inet_addr(host)), port);
+        return connect(std::string(host), port);
     }
 
     bool TcpSocket::connect(const std::string &host, uint16_t port)
     {
-        return connect(host.c_str(), port);
+        stopConnecting();
+
+        for (const Endpoint &endpoint : resolve(host, port, 0))
+        {
+            if (!createSocket(endpoint.address.ss_family)) continue;
+
+            if (::connect(d->socketFd, reinterpret_cast<const SOCKADDR *>(&endpoint.address), endpoint.size) != SOCKET_ERROR)
+            {
+                setDescriptor(static_cast<int>(d->socketFd));
+                return d->isConnected;
+            }
+
+            ::closesocket(d->socketFd);
+            d->socketFd = INVALID_SOCKET;
+        }
+
+        return false;
+    }
+
+    bool TcpSocket::connectAsync(const std::string &host, uint16_t port, int timeout)
+    {
+#ifdef SACore
+        if (!d->isWinsockStarted || d->isConnected || d->isConnecting) return false;
+
+        d->isConnecting = true;
+        d->connectError = 0;
+        d->connectToken = std::make_shared<int>(0);
+        std::weak_ptr<int> token = d->connectToken;
+
+        if (timeout > 0)
+        {
+            d->connectTimer = d->loop->singleShot(timeout, [this]() {
+                d->connectTimer = -1;
+                finishConnect(-1, WSAETIMEDOUT);
+            });
+        }
+
+        auto start = [this, token](std::vector<Endpoint> endpoints) {
+            if (token.expired()) return;
+            d->connectAddresses = std::move(endpoints);
+            d->nextAddress = 0;
+            startConnectAttempt();
+        };
+
+        // Addresses need no lookup, handlers still run from the loop only
+        std::vector<Endpoint> endpoints = resolve(host, port, AI_NUMERICHOST);
+        if (!endpoints.empty())
+        {
+            d->loop->post([start, endpoints]() { start(endpoints); });
+            return true;
+        }
+
+        SA::Application::instance().threadPool().submit([host, port]() {
+            return resolve(host, port, AI_ADDRCONFIG);
+        }).then(start);
+
+        return true;
+#else
+        (void)host; (void)port; (void)timeout;
+        return false;
+#endif
+    }
+
+    bool TcpSocket::isConnecting()
+    {
+        return d->isConnecting;
+    }
+
+    int TcpSocket::addConnectHandler(const std::function<void ()> &func)
+    {
+        return d->connectHandlers.add(func);
+    }
+
+    void TcpSocket::removeConnectHandler(int id)
+    {
+        d->connectHandlers.remove(id);
+    }
+
+    int TcpSocket::addErrorHandler(const std::function<void (int)> &func)
+    {
+        return d->errorHandlers.add(func);
+    }
+
+    void TcpSocket::removeErrorHandler(int id)
+    {
+        d->errorHandlers.remove(id);
     }
 
     bool TcpSocket::isConnected()
@@ -90,13 +287,145 @@ namespace SA
 
     void TcpSocket::disconnect()
     {
+        stopConnecting();
+
+        // Hand over what the kernel can still take, the rest is dropped
+        d->isWriteHeld = false;
+        flushWriteQueue();
         deleteSocket();
     }
 
     bool TcpSocket::send(const std::vector<char> &data)
     {
         if (!d->isConnected) return false;
-        return (::send(d->socketFd, data.data(), data.size(), 0) > -1);
+        if (data.empty()) return true;
+
+        size_t bytesSent = 0;
+        if (d->writeQueue.empty() && !d->isWriteHeld)
+        {
+            int result = ::send(d->socketFd, data.data(), static_cast<int>(data.size()), 0);
+
+            if (result != SOCKET_ERROR)
+                bytesSent = static_cast<size_t>(result);
+            else if (::WSAGetLastError() != WSAEWOULDBLOCK)
+                return false;
+
+            if (bytesSent == data.size()) return true;
+        }
+
+        WriteChunk chunk;
+        chunk.data.assign(data.begin() + static_cast<ptrdiff_t>(bytesSent), data.end());
+        d->writeQueueSize += chunk.size();
+        d->writeQueue.push_back(std::move(chunk));
+        flushWriteQueue();
+
+        return true;
+    }
+
+    bool TcpSocket::send(std::vector<char> &&data)
+    {
+        if (!d->isConnected) return false;
+        if (data.empty()) return true;
+
+        size_t bytesSent = 0;
+        if (d->writeQueue.empty() && !d->isWriteHeld)
+        {
+            int result = ::send(d->socketFd, data.data(), static_cast<int>(data.size()), 0);
+
+            if (result != SOCKET_ERROR)
+                bytesSent = static_cast<size_t>(result);
+            else if (::WSAGetLastError() != WSAEWOULDBLOCK)
+                return false;
+
+            if (bytesSent == data.size()) return true;
+        }
+
+        // The rest is queued in place, the offset skips what went out
+        WriteChunk chunk;
+        chunk.data = std::move(data);
+        chunk.offset = bytesSent;
+        d->writeQueueSize += chunk.size();
+        d->writeQueue.push_back(std::move(chunk));
+        flushWriteQueue();
+
+        return true;
+    }
+
+    bool TcpSocket::send(const std::shared_ptr<const std::vector<char> > &data)
+    {
+        if (!d->isConnected || !data) return false;
+        if (data->empty()) return true;
+
+        WriteChunk chunk;
+        chunk.shared = data;
+        d->writeQueueSize += chunk.size();
+        d->writeQueue.push_back(std::move(chunk));
+        flushWriteQueue();
+
+        return true;
+    }
+
+    bool TcpSocket::sendFile(const std::string &path, size_t offset, size_t size)
+    {
+        if (!d->isConnected) return false;
+
+        // No sendfile here, the range is read into the write queue
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) return false;
+
+        size_t fileSize = static_cast<size_t>(file.tellg());
+        if (offset > fileSize) return false;
+
+        size = std::min(size, fileSize - offset);
+        file.seekg(static_cast<std::streamoff>(offset));
+
+        while (size > 0)
+        {
+            WriteChunk chunk;
+            chunk.data.resize(std::min(size, MaxSendFileSize));
+            if (!file.read(chunk.data.data(), static_cast<std::streamsize>(chunk.data.size()))) return false;
+
+            size -= chunk.data.size();
+            d->writeQueueSize += chunk.size();
+            d->writeQueue.push_back(std::move(chunk));
+        }
+
+        flushWriteQueue();
+        return true;
+    }
+
+    void TcpSocket::shutdown()
+    {
+        if (!d->isConnected) return;
+
+        d->isShutdownPending = true;
+        flushWriteQueue();
+    }
+
+    void TcpSocket::setWriteWatermarks(size_t low, size_t high)
+    {
+        d->lowWatermark = std::min(low, high);
+        d->highWatermark = high;
+    }
+
+    size_t TcpSocket::bytesToWrite()
+    {
+        return d->writeQueueSize;
+    }
+
+    bool TcpSocket::isWritable()
+    {
+        return d->isConnected && !d->isWriteBlocked;
+    }
+
+    int TcpSocket::addDrainHandler(const std::function<void ()> &func)
+    {
+        return d->drainHandlers.add(func);
+    }
+
+    void TcpSocket::removeDrainHandler(int id)
+    {
+        d->drainHandlers.remove(id);
     }
 
     int TcpSocket::descriptor()
@@ -114,69 +443,395 @@ namespace SA
         d->isConnected = true;
         std::cout << __PRETTY_FUNCTION__ << " desc: " << d->socketFd << std::endl;
 
-        int iVal = 10;
-        ::setsockopt(d->socketFd, SOL_SOCKET, SO_RCVTIMEO, (char *)&iVal, sizeof(iVal));
+        u_long mode = 1;
+        ::ioctlsocket(d->socketFd, FIONBIO, &mode);
     }
 
-    int TcpSocket::addReadHandler(const std::function<void (const std::vector<char>&)> &func)
+    int TcpSocket::addReadHandler(const std::function<size_t (std::span<const char>)> &func)
     {
-        int id = static_cast<int>(d->readHandlers.size());
-        for (auto const& it : d->readHandlers) if (it.first != ++id) break;
-        d->readHandlers.insert({id, func});
-        return id;
+        return d->readHandlers.add(func);
     }
 
     void TcpSocket::removeReadHandler(int id)
     {
-        auto it = d->readHandlers.find(id);
-        if (it != d->readHandlers.end())
-            d->readHandlers.erase(it);
+        d->readHandlers.remove(id);
     }
 
     int TcpSocket::addDisconnectHandler(const std::function<void(int)> &func)
     {
-        int id = static_cast<int>(d->disconnectHandlers.size());
-        for (auto const& it : d->disconnectHandlers) if (it.first != ++id) break;
-        d->disconnectHandlers.insert({id, func});
-        return id;
+        return d->disconnectHandlers.add(func);
     }
 
     void TcpSocket::removeDisconnectHandler(int id)
     {
-        auto it = d->disconnectHandlers.find(id);
-        if (it != d->disconnectHandlers.end())
-            d->disconnectHandlers.erase(it);
+        d->disconnectHandlers.remove(id);
     }
 
     void TcpSocket::mainLoopHandler()
     {
-        if (!d->isConnected) return;
+        // Polled every iteration, so the write queue is flushed from here too
+        if (!d->writeQueue.empty())
+            flushWriteQueue();
+
+        // Connected sockets turn writable, failed ones report an exception
+        if (!d->connectAttempts.empty())
+        {
+            fd_set writeSet, errorSet;
+            FD_ZERO(&writeSet);
+            FD_ZERO(&errorSet);
+            for (SOCKET descr : d->connectAttempts)
+            {
+                FD_SET(descr, &writeSet);
+                FD_SET(descr, &errorSet);
+            }
+
+            timeval timeout = {0, 0};
+            if (::select(0, nullptr, &writeSet, &errorSet, &timeout) > 0)
+            {
+                // Handling one may drop the others
+                std::vector<SOCKET> attempts = d->connectAttempts;
+                for (SOCKET descr : attempts)
+                {
+                    if (!d->isConnecting) break;
+                    if (FD_ISSET(descr, &writeSet) || FD_ISSET(descr, &errorSet))
+                        processConnectAttempt(static_cast<int>(descr));
+                }
+            }
+        }
+
+        // Non-blocking, so read whatever is queued and return at WSAEWOULDBLOCK
+        while (d->isConnected)
+        {
+            size_t space = prepareReadSpace();
+            if (space == 0) break;
 
-        ssize_t bytesRead = ::recv(d->socketFd, d->dataIn.data(), d->dataIn.size(), 0);
+            int bytesRead = ::recv(d->socketFd, d->dataIn.data() + d->readEnd, static_cast<int>(space), 0);
 
-        if (bytesRead > 0)
+            if (bytesRead > 0)
+            {
+                processReadData(static_cast<size_t>(bytesRead));
+
+                // A full read means more is coming, read bigger pieces
+                if (static_cast<size_t>(bytesRead) == space && d->dataIn.size() < ReadGrowLimit)
+                    d->dataIn.resize(d->dataIn.size() * 2);
+            }
+            else if (bytesRead == SOCKET_ERROR && ::WSAGetLastError() == WSAEWOULDBLOCK)
+            {
+                break;
+            }
+            else
+            {
+                deleteSocket();
+
+                d->disconnectHandlers(d->socketFd);
+
+                resumeReader();
+            }
+        }
+    }
+
+    TcpSocket::ReadAwaiter TcpSocket::read()
+    {
+        d->isReadAwaited = true;
+        return ReadAwaiter{this, {}};
+    }
+
+    bool TcpSocket::ReadAwaiter::await_ready()
+    {
+        if (socket->d->readBuffer.empty() && socket->isConnected())
+            return false;
+
+        data.swap(socket->d->readBuffer);
+        return true;
+    }
+
+    bool TcpSocket::ReadAwaiter::await_suspend(std::coroutine_handle<> handle)
+    {
+        // Another coroutine is waiting already, this one gets nothing
+        if (socket->d->readHandle) return false;
+
+        socket->d->readAwaiter = this;
+        socket->d->readHandle = handle;
+        return true;
+    }
+
+    void TcpSocket::resumeReader()
+    {
+        if (!d->readHandle) return;
+
+        std::coroutine_handle<> handle = d->readHandle;
+        d->readHandle = nullptr;
+        d->readAwaiter->data.swap(d->readBuffer);
+        d->readAwaiter = nullptr;
+        handle.resume();
+    }
+
+    size_t TcpSocket::prepareReadSpace()
+    {
+        size_t size = d->dataIn.size();
+        if (size - d->readEnd >= size / 4)
+            return size - d->readEnd;
+
+        // Move what handlers left to the front, grow only if that is not enough
+        if (d->readBegin > 0)
         {
-            d->dataTmp.clear();
-            d->dataTmp.insert(d->dataTmp.begin(), d->dataIn.begin(), d->dataIn.begin() + bytesRead);
+            std::memmove(d->dataIn.data(), d->dataIn.data() + d->readBegin, d->readEnd - d->readBegin);
+            d->readEnd -= d->readBegin;
+            d->readBegin = 0;
+        }
 
-            for (const auto &it: d->readHandlers)
-                it.second(d->dataTmp);
+        if (size - d->readEnd < size / 4)
+        {
+            if (size < MaxReadSize)
+                d->dataIn.resize(size * 2);
+            else if (d->readEnd == size)
+            {
+                // Nobody consumes anything and the stream can't be cut
+                failRead();
+                return 0;
+            }
         }
-        else if(bytesRead == 0)
+
+        return d->dataIn.size() - d->readEnd;
+    }
+
+    void TcpSocket::failRead()
+    {
+        // An error handler may have disconnected it already
+        d->errorHandlers(WSAEMSGSIZE);
+        if (d->isConnected)
         {
             deleteSocket();
 
-            for (const auto &it: d->disconnectHandlers)
-                it.second(d->socketFd);
+            d->disconnectHandlers(d->socketFd);
         }
+
+        resumeReader();
     }
 
-    bool TcpSocket::createSocket()
+    void TcpSocket::processReadData(size_t bytesRead)
+    {
+        const char *received = d->dataIn.data() + d->readEnd;
+        d->readEnd += bytesRead;
+
+        if (d->isReadAwaited)
+        {
+            // Same as above for bytes no coroutine reads
+            if (d->readBuffer.size() + bytesRead > MaxReadSize)
+            {
+                failRead();
+                return;
+            }
+
+            d->readBuffer.insert(d->readBuffer.end(), received, received + bytesRead);
+        }
+
+        std::span<const char> data(d->dataIn.data() + d->readBegin, d->readEnd - d->readBegin);
+        size_t consumed = d->readHandlers.isEmpty() ? data.size() : 0;
+
+        d->isWriteHeld = true;
+        d->readHandlers.forEach([&](int, const std::function<size_t (std::span<const char>)> &handler) {
+            consumed = std::max(consumed, handler(data));
+        });
+        d->isWriteHeld = false;
+
+        // A handler that disconnected has already emptied the buffer
+        if (d->isConnected)
+        {
+            d->readBegin += std::min(consumed, data.size());
+            if (d->readBegin == d->readEnd)
+                d->readBegin = d->readEnd = 0;
+        }
+
+        flushWriteQueue();
+
+        if (d->isReadAwaited)
+            resumeReader();
+    }
+
+    void TcpSocket::flushWriteQueue()
+    {
+        if (d->isWriteHeld) return;
+
+        while (d->isConnected && !d->writeQueue.empty())
+        {
+            // Coalesce the queued chunks into one call
+            WSABUF buffers[MaxWriteChunks];
+            DWORD count = 0;
+
+            for (auto it = d->writeQueue.begin(); it != d->writeQueue.end() && count < MaxWriteChunks; ++it, ++count)
+            {
+                buffers[count].buf = const_cast<char*>(it->begin());
+                buffers[count].len = static_cast<ULONG>(it->size());
+            }
+
+            DWORD result = 0;
+            if (::WSASend(d->socketFd, buffers, count, &result, 0, nullptr, nullptr) == SOCKET_ERROR)
+            {
+                if (::WSAGetLastError() == WSAEWOULDBLOCK) break;
+
+                // The connection is gone, the read side reports it
+                d->writeQueue.clear();
+                d->writeQueueSize = 0;
+                break;
+            }
+
+            size_t written = static_cast<size_t>(result);
+            d->writeQueueSize -= written;
+
+            while (written > 0)
+            {
+                WriteChunk &chunk = d->writeQueue.front();
+                if (written < chunk.size())
+                {
+                    chunk.offset += written;
+                    break;
+                }
+
+                written -= chunk.size();
+                d->writeQueue.pop_front();
+            }
+        }
+
+        if (d->isShutdownPending && d->isConnected && d->writeQueue.empty())
+        {
+            d->isShutdownPending = false;
+            ::shutdown(d->socketFd, SD_SEND);
+        }
+
+        if (d->writeQueueSize > d->highWatermark)
+        {
+            d->isWriteBlocked = true;
+        }
+        else if (d->isWriteBlocked && d->writeQueueSize <= d->lowWatermark)
+        {
+            d->isWriteBlocked = false;
+            d->drainHandlers();
+        }
+    }
+
+    bool TcpSocket::createSocket(int family)
     {
-        SOCKET descr = socket(AF_INET, SOCK_STREAM, 0);
-        setDescriptor(static_cast<int>(descr));
         d->isConnected = false;
-        return (descr != INVALID_SOCKET);
+        d->socketFd = socket(family, SOCK_STREAM, 0);
+        return (d->socketFd != INVALID_SOCKET);
+    }
+
+    void TcpSocket::startConnectAttempt()
+    {
+#ifdef SACore
+        if (d->attemptTimer > -1)
+        {
+            d->loop->killTimer(d->attemptTimer);
+            d->attemptTimer = -1;
+        }
+
+        while (d->nextAddress < d->connectAddresses.size())
+        {
+            const Endpoint &endpoint = d->connectAddresses[d->nextAddress++];
+
+            SOCKET descr = ::socket(endpoint.address.ss_family, SOCK_STREAM, 0);
+            if (descr == INVALID_SOCKET)
+            {
+                d->connectError = ::WSAGetLastError();
+                continue;
+            }
+
+            u_long mode = 1;
+            ::ioctlsocket(descr, FIONBIO, &mode);
+
+            if (::connect(descr, reinterpret_cast<const SOCKADDR *>(&endpoint.address), endpoint.size) != SOCKET_ERROR)
+            {
+                finishConnect(static_cast<int>(descr), 0);
+                return;
+            }
+
+            int error = ::WSAGetLastError();
+            if (error != WSAEWOULDBLOCK)
+            {
+                d->connectError = error;
+                ::closesocket(descr);
+                continue;
+            }
+
+            d->connectAttempts.push_back(descr);
+
+            // The next address gets its turn early if this one is slow
+            if (d->nextAddress < d->connectAddresses.size())
+            {
+                d->attemptTimer = d->loop->singleShot(ConnectAttemptDelay, [this]() {
+                    d->attemptTimer = -1;
+                    startConnectAttempt();
+                });
+            }
+            return;
+        }
+
+        if (d->connectAttempts.empty())
+            finishConnect(-1, d->connectError != 0 ? d->connectError : WSAEHOSTUNREACH);
+#endif
+    }
+
+    void TcpSocket::processConnectAttempt(int descr)
+    {
+        SOCKET socketFd = static_cast<SOCKET>(descr);
+
+        int error = 0;
+        int size = sizeof(error);
+        if (::getsockopt(socketFd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char *>(&error), &size) == SOCKET_ERROR)
+            error = ::WSAGetLastError();
+
+        if (error == 0)
+        {
+            finishConnect(descr, 0);
+            return;
+        }
+
+        ::closesocket(socketFd);
+        d->connectAttempts.erase(std::find(d->connectAttempts.begin(), d->connectAttempts.end(), socketFd));
+        d->connectError = error;
+
+        // A failure does not wait for the delay
+        startConnectAttempt();
+    }
+
+    void TcpSocket::finishConnect(int descr, int error)
+    {
+        // The winner is taken out first, the other attempts are dropped
+        auto winner = std::find(d->connectAttempts.begin(), d->connectAttempts.end(), static_cast<SOCKET>(descr));
+        if (winner != d->connectAttempts.end())
+            d->connectAttempts.erase(winner);
+
+        stopConnecting();
+
+        if (descr > -1)
+        {
+            setDescriptor(descr);
+            d->connectHandlers();
+        }
+        else
+        {
+            d->errorHandlers(error);
+        }
+    }
+
+    void TcpSocket::stopConnecting()
+    {
+        if (!d->isConnecting) return;
+
+#ifdef SACore
+        if (d->attemptTimer > -1) d->loop->killTimer(d->attemptTimer);
+        if (d->connectTimer > -1) d->loop->killTimer(d->connectTimer);
+#endif
+
+        for (SOCKET descr : d->connectAttempts)
+            ::closesocket(descr);
+
+        d->attemptTimer = d->connectTimer = -1;
+        d->connectAttempts.clear();
+        d->connectAddresses.clear();
+        d->connectToken.reset();
+        d->isConnecting = false;
     }
 
     void TcpSocket::deleteSocket()
@@ -191,6 +846,11 @@ namespace SA
         }
 
         d->isConnected = false;
+        d->readBegin = d->readEnd = 0;
+        d->isWriteBlocked = false;
+        d->isShutdownPending = false;
+        d->writeQueue.clear();
+        d->writeQueueSize = 0;
     }
 }
 
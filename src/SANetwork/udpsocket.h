@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <span>
 #include <functional>
 
 namespace SA
@@ -8,6 +10,19 @@ namespace SA
     class UdpSocket
     {
     public:
+        // Host and port are in host byte order, as in send().
+        // The rest is receive metadata, left at zero when it is not enabled
+        // or the platform does not report it.
+        struct Datagram
+        {
+            std::span<const char> data;
+            uint32_t host = 0;
+            uint16_t port = 0;
+            uint32_t destination = 0;   // local address it was sent to, see setReceiveDestination()
+            int64_t timestamp = 0;      // kernel receive time, ns since epoch, see setReceiveTimestamps()
+            bool truncated = false;     // longer than the receive buffer, data holds the head only
+        };
+
         UdpSocket();
         virtual ~UdpSocket();
 
@@ -20,17 +35,81 @@ namespace SA
 
         void unbind();
 
+        // SO_REUSEADDR, lets several sockets bind one multicast port.
+        // Takes effect on the next bind().
+        void setReuseAddress(bool enable);
+
+        // Group membership of the bound socket, interface 0 lets the
+        // system choose. Memberships end with unbind().
+        bool joinGroup(uint32_t group, uint32_t localInterface = 0);
+        bool joinGroup(const char* group, const char* localInterface = nullptr);
+        bool joinGroup(const std::string &group, const std::string &localInterface = std::string());
+        bool leaveGroup(uint32_t group, uint32_t localInterface = 0);
+        bool leaveGroup(const char* group, const char* localInterface = nullptr);
+        bool leaveGroup(const std::string &group, const std::string &localInterface = std::string());
+
+        // Options for datagrams sent to groups
+        void setMulticastTtl(int ttl);
+        void setMulticastLoopback(bool enable);
+        void setMulticastInterface(uint32_t localInterface);
+        void setMulticastInterface(const char* localInterface);
+        void setMulticastInterface(const std::string &localInterface);
+
+        // A bound socket does not block: datagrams it cannot take yet are
+        // queued (up to 1 MiB) and sent when it is writable. False once the
+        // queue is full or on errors.
         bool send(const std::vector<char> &data, uint32_t host, uint16_t port);
         bool send(const std::vector<char> &data, const char* host, uint16_t port);
         bool send(const std::vector<char> &data, const std::string &host, uint16_t port);
 
-        int addReadHandler(const std::function<void (const std::vector<char> &)> &func);
+        // Sends every datagram with as few syscalls as possible (sendmmsg),
+        // returns how many were sent. A bound socket stops, without queueing,
+        // where its buffer is full.
+        size_t sendBatch(std::span<const Datagram> datagrams);
+
+        // Sends data as datagrams of segmentSize bytes (the last may be
+        // shorter), segmented by the kernel (UDP_SEGMENT) when it can.
+        // Returns how many bytes were sent, a bound socket stops where its
+        // buffer is full.
+        size_t sendSegmented(std::span<const char> data, uint16_t segmentSize, uint32_t host, uint16_t port);
+
+        // Called once per datagram, the view is only valid during the call
+        int addReadHandler(const std::function<void (std::span<const char> data)> &func);
         void removeReadHandler(int id);
+
+        // Same, with the sender and metadata, so a handler can reply
+        int addDatagramReadHandler(const std::function<void (const Datagram &datagram)> &func);
+        void removeDatagramReadHandler(int id);
+
+        // SO_TIMESTAMPNS and IP_PKTINFO, may be set before or after bind()
+        void setReceiveTimestamps(bool enable);
+        void setReceiveDestination(bool enable);
+
+        // UDP_GRO: the kernel may coalesce datagrams of one sender, they are
+        // split back before reaching the handlers. In batch mode use
+        // maxDatagramSize 65536, or coalesced reads are truncated.
+        void setReceiveOffload(bool enable);
+
+        // Batch mode reads up to count datagrams of at most maxDatagramSize
+        // bytes per syscall (recvmmsg), 0 turns it off. Batch handlers get
+        // each batch with the senders, read handlers still get every datagram.
+        // Called from a handler it takes effect once the batch is dispatched.
+        void setBatchSize(size_t count, size_t maxDatagramSize = 2048);
+        int addBatchReadHandler(const std::function<void (std::span<const Datagram> batch)> &func);
+        void removeBatchReadHandler(int id);
+
         void mainLoopHandler();
 
     private:
         bool createSocket();
         void deleteSocket();
+        void applyReceiveOptions();
+        void applyMulticastOptions();
+        bool changeMembership(int option, uint32_t group, uint32_t localInterface);
+        void readBatch();
+        void applyBatchSize();
+        void dispatch(const Datagram &datagram);
+        void flushSendQueue();
 
         UdpSocket(const SA::UdpSocket &) = delete;
         UdpSocket(SA::UdpSocket &&) = delete;
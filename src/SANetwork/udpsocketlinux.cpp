@@ -3,54 +3,164 @@
 #include <memory>
 #include <string>
 #include <vector>
-#include <map>
+#include <deque>
+#include <algorithm>
+#include <cstring>
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <fcntl.h>
+#include <cerrno>
 #include <netinet/in.h>
+#include <netinet/udp.h>
+#include <time.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 
 #include "udpsocket.h"
+#include "handlerlist.h"
 
 #ifdef SACore
-#include "application.h"
+#include "eventloop.h"
 #endif
 
-static const size_t DefaultLen = 1024;
+static const size_t MaxDatagramSize = 65536;
+static const int MaxReadsPerEvent = 64;
+static const int MaxBatchesPerEvent = 4;
+static const size_t ControlSize = CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(in_pktinfo)) + CMSG_SPACE(sizeof(int));
+static const size_t MaxSegments = 64;
+static const size_t MaxSegmentedSize = 65507;
+static const size_t MaxSendQueueSize = 1024 * 1024;
+
+// Fills the sender and metadata of a datagram received with recvmsg,
+// returns the GRO segment size or 0 when it was not coalesced
+static size_t readMetadata(SA::UdpSocket::Datagram &datagram, msghdr &header)
+{
+    size_t segmentSize = 0;
+
+    const sockaddr_in *address = static_cast<const sockaddr_in*>(header.msg_name);
+    datagram.host = ntohl(address->sin_addr.s_addr);
+    datagram.port = ntohs(address->sin_port);
+    datagram.destination = 0;
+    datagram.timestamp = 0;
+    datagram.truncated = (header.msg_flags & MSG_TRUNC) != 0;
+
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&header); cmsg; cmsg = CMSG_NXTHDR(&header, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+        {
+            timespec time;
+            memcpy(&time, CMSG_DATA(cmsg), sizeof(time));
+            datagram.timestamp = static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+        }
+        else if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO)
+        {
+            in_pktinfo info;
+            memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+            datagram.destination = ntohl(info.ipi_addr.s_addr);
+        }
+        else if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+        {
+            int size;
+            memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+            segmentSize = static_cast<size_t>(size);
+        }
+    }
+
+    return segmentSize;
+}
+
+// Appends the datagram to list, split into segments when it was coalesced
+static void appendSegments(std::vector<SA::UdpSocket::Datagram> &list, const SA::UdpSocket::Datagram &datagram, size_t segmentSize)
+{
+    if (segmentSize == 0 || segmentSize >= datagram.data.size())
+    {
+        list.push_back(datagram);
+        return;
+    }
+
+    for (size_t offset = 0; offset < datagram.data.size(); offset += segmentSize)
+    {
+        list.push_back(datagram);
+        list.back().data = datagram.data.subspan(offset, std::min(segmentSize, datagram.data.size() - offset));
+    }
+}
 
 namespace SA
 {
     struct UdpSocket::UdpSocketPrivate
     {
-        int mainLoopId = -1;
+        SA::EventLoop *loop = nullptr;
         int socketBind = -1;
         int socketSend = -1;
         bool isBinded = false;
         sockaddr_in addressBind;
 
-        std::vector<char> dataIn, dataTmp;
-        std::map<int, std::function<void (const std::vector<char>&)> > readHandlers;
+        std::vector<char> dataIn;
+        std::vector<char> controlIn;
+        sockaddr_in addressIn;
+        SA::HandlerList<void (std::span<const char>)> readHandlers;
+        SA::HandlerList<void (const Datagram &)> datagramHandlers;
+
+        bool reuseAddress = false;
+        int multicastTtl = 1;
+        bool multicastLoopback = true;
+        uint32_t multicastInterface = INADDR_ANY;
+
+        bool receiveTimestamps = false;
+        bool receiveDestination = false;
+        bool receiveOffload = false;
+        bool segmentOffload = true;
+        std::vector<Datagram> segments;
+
+        size_t batchSize = 0;
+        size_t batchDatagramSize = 0;
+        std::vector<char> batchData;
+        std::vector<mmsghdr> batchHeaders;
+        std::vector<iovec> batchVectors;
+        std::vector<sockaddr_in> batchAddresses;
+        std::vector<char> batchControl;
+        std::vector<Datagram> batch;
+        SA::HandlerList<void (std::span<const Datagram>)> batchHandlers;
+
+        // Handlers see views of the batch buffers, a new size set from one
+        // of them waits until the batch is dispatched
+        bool isBatchDispatching = false;
+        bool isBatchResizePending = false;
+        size_t pendingBatchSize = 0;
+        size_t pendingBatchDatagramSize = 0;
+
+        // Datagrams the bound socket could not take yet, sent in order once
+        // it is writable
+        struct QueuedDatagram
+        {
+            std::vector<char> data;
+            sockaddr_in address;
+        };
+
+        std::deque<QueuedDatagram> sendQueue;
+        size_t sendQueueSize = 0;
     };
 
     UdpSocket::UdpSocket():
         d(new UdpSocketPrivate)
     {
-        d->dataIn.resize(DefaultLen, 0);
-        d->dataTmp.reserve(DefaultLen);
-        d->socketSend = socket(AF_INET, SOCK_DGRAM, 0);
-
 #ifdef SACore
-        d->mainLoopId = SA::Application::instance().addMainLoopListener(std::bind(&UdpSocket::mainLoopHandler, this));
+        d->loop = SA::EventLoop::current();
 #endif
+
+        d->dataIn.resize(MaxDatagramSize);
+        d->controlIn.resize(ControlSize);
+        d->socketSend = socket(AF_INET, SOCK_DGRAM, 0);
     }
 
     SA::UdpSocket::~UdpSocket()
     {
-#ifdef SACore
-        SA::Application::instance().removeMainLoopListener(d->mainLoopId);
-#endif
         deleteSocket();
+
+        if (d->socketSend > -1)
+            ::close(d->socketSend);
+
         delete d;
     }
 
@@ -70,6 +180,14 @@ namespace SA
         int state = ::bind(d->socketBind, (struct sockaddr *)&d->addressBind, sizeof(d->addressBind));
         d->isBinded = (state > -1);
 
+#ifdef SACore
+        if (d->isBinded)
+            d->loop->addDescriptorListener(d->socketBind, [this](int events) {
+                if (events & SA::DescriptorWrite) flushSendQueue();
+                if (events & ~SA::DescriptorWrite) mainLoopHandler();
+            });
+#endif
+
         return d->isBinded;
     }
 
@@ -93,17 +211,103 @@ namespace SA
         deleteSocket();
     }
 
+    void UdpSocket::setReuseAddress(bool enable)
+    {
+        d->reuseAddress = enable;
+    }
+
+    bool UdpSocket::joinGroup(uint32_t group, uint32_t localInterface)
+    {
+        return changeMembership(IP_ADD_MEMBERSHIP, group, localInterface);
+    }
+
+    bool UdpSocket::joinGroup(const char* group, const char* localInterface)
+    {
+        return joinGroup(htonl(inet_addr(group)), localInterface ? htonl(inet_addr(localInterface)) : 0);
+    }
+
+    bool UdpSocket::joinGroup(const std::string &group, const std::string &localInterface)
+    {
+        return joinGroup(group.c_str(), localInterface.empty() ? nullptr : localInterface.c_str());
+    }
+
+    bool UdpSocket::leaveGroup(uint32_t group, uint32_t localInterface)
+    {
+        return changeMembership(IP_DROP_MEMBERSHIP, group, localInterface);
+    }
+
+    bool UdpSocket::leaveGroup(const char* group, const char* localInterface)
+    {
+        return leaveGroup(htonl(inet_addr(group)), localInterface ? htonl(inet_addr(localInterface)) : 0);
+    }
+
+    bool UdpSocket::leaveGroup(const std::string &group, const std::string &localInterface)
+    {
+        return leaveGroup(group.c_str(), localInterface.empty() ? nullptr : localInterface.c_str());
+    }
+
+    void UdpSocket::setMulticastTtl(int ttl)
+    {
+        d->multicastTtl = ttl;
+        applyMulticastOptions();
+    }
+
+    void UdpSocket::setMulticastLoopback(bool enable)
+    {
+        d->multicastLoopback = enable;
+        applyMulticastOptions();
+    }
+
+    void UdpSocket::setMulticastInterface(uint32_t localInterface)
+    {
+        d->multicastInterface = localInterface;
+        applyMulticastOptions();
+    }
+
+    void UdpSocket::setMulticastInterface(const char* localInterface)
+    {
+        setMulticastInterface(htonl(inet_addr(localInterface)));
+    }
+
+    void UdpSocket::setMulticastInterface(const std::string &localInterface)
+    {
+        setMulticastInterface(localInterface.c_str());
+    }
+
     bool UdpSocket::send(const std::vector<char> &data, uint32_t host, uint16_t port)
     {
         if (!d->socketSend) return false;
 
+        // Replies to a bound socket should come back to it, so it sends itself
+        int socket = d->isBinded ? d->socketBind : d->socketSend;
+
         struct sockaddr_in addr;
         addr.sin_family = AF_INET;
         addr.sin_port = htons(port);
         addr.sin_addr.s_addr = htonl(host);
 
-        int state = sendto(d->socketSend, data.data(), data.size(), MSG_CONFIRM, (const struct sockaddr *) &addr, sizeof(addr));
-        return (state > -1);
+        // The bound socket is non-blocking, a datagram it cannot take yet is
+        // queued, and so is everything behind it to keep the order
+        if (!d->isBinded || d->sendQueue.empty())
+        {
+            int state;
+            do state = sendto(socket, data.data(), data.size(), MSG_CONFIRM, (const struct sockaddr *) &addr, sizeof(addr));
+            while (state < 0 && errno == EINTR);
+
+            if (state > -1) return true;
+            if (!d->isBinded || (errno != EAGAIN && errno != EWOULDBLOCK)) return false;
+        }
+
+        if (d->sendQueueSize + data.size() > MaxSendQueueSize) return false;
+
+#ifdef SACore
+        if (d->sendQueue.empty())
+            d->loop->setDescriptorEvents(d->socketBind, SA::DescriptorRead | SA::DescriptorWrite);
+#endif
+
+        d->sendQueue.push_back({data, addr});
+        d->sendQueueSize += data.size();
+        return true;
     }
 
     bool UdpSocket::send(const std::vector<char> &data, const char *host, uint16_t port)
@@ -116,56 +320,434 @@ namespace SA
         return send(data, host.c_str(), port);
     }
 
-    int UdpSocket::addReadHandler(const std::function<void (const std::vector<char>&)> &func)
+    size_t UdpSocket::sendBatch(std::span<const Datagram> datagrams)
+    {
+        if (d->socketSend < 0) return 0;
+
+        int socket = d->isBinded ? d->socketBind : d->socketSend;
+
+        const size_t MaxMessages = 64;
+        mmsghdr headers[MaxMessages];
+        iovec vectors[MaxMessages];
+        sockaddr_in addresses[MaxMessages];
+
+        size_t sent = 0;
+        while (sent < datagrams.size())
+        {
+            size_t count = std::min(datagrams.size() - sent, MaxMessages);
+
+            for (size_t i=0; i<count; ++i)
+            {
+                const Datagram &datagram = datagrams[sent + i];
+
+                addresses[i] = {};
+                addresses[i].sin_family = AF_INET;
+                addresses[i].sin_port = htons(datagram.port);
+                addresses[i].sin_addr.s_addr = htonl(datagram.host);
+
+                vectors[i].iov_base = const_cast<char*>(datagram.data.data());
+                vectors[i].iov_len = datagram.data.size();
+
+                headers[i] = {};
+                headers[i].msg_hdr.msg_name = &addresses[i];
+                headers[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+                headers[i].msg_hdr.msg_iov = &vectors[i];
+                headers[i].msg_hdr.msg_iovlen = 1;
+            }
+
+            int result = ::sendmmsg(socket, headers, static_cast<unsigned int>(count), 0);
+            if (result < 0)
+            {
+                if (errno == EINTR) continue;
+                break;
+            }
+
+            sent += static_cast<size_t>(result);
+        }
+
+        return sent;
+    }
+
+    size_t UdpSocket::sendSegmented(std::span<const char> data, uint16_t segmentSize, uint32_t host, uint16_t port)
+    {
+        if (d->socketSend < 0 || segmentSize == 0) return 0;
+
+        int socket = d->isBinded ? d->socketBind : d->socketSend;
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(host);
+
+        // One GSO send carries at most MaxSegments segments in one IP datagram
+        size_t chunkSize = std::min(MaxSegments, MaxSegmentedSize / segmentSize) * segmentSize;
+        if (chunkSize == 0) return 0;
+
+        char control[CMSG_SPACE(sizeof(uint16_t))] = {};
+
+        size_t sent = 0;
+        while (sent < data.size() && d->segmentOffload)
+        {
+            size_t size = std::min(chunkSize, data.size() - sent);
+
+            iovec vector;
+            vector.iov_base = const_cast<char*>(data.data() + sent);
+            vector.iov_len = size;
+
+            msghdr header = {};
+            header.msg_name = &addr;
+            header.msg_namelen = sizeof(addr);
+            header.msg_iov = &vector;
+            header.msg_iovlen = 1;
+
+            if (size > segmentSize)
+            {
+                header.msg_control = control;
+                header.msg_controllen = sizeof(control);
+
+                cmsghdr *cmsg = CMSG_FIRSTHDR(&header);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+            }
+
+            ssize_t result = ::sendmsg(socket, &header, 0);
+            if (result < 0)
+            {
+                if (errno == EINTR) continue;
+
+                // Old kernel or a device without checksum offload
+                if (header.msg_control && (errno == EINVAL || errno == ENOPROTOOPT || errno == EIO))
+                {
+                    d->segmentOffload = false;
+                    break;
+                }
+
+                return sent;
+            }
+
+            sent += size;
+        }
+
+        // Without GSO the segments go out through sendmmsg
+        Datagram datagrams[MaxSegments];
+        while (sent < data.size())
+        {
+            size_t count = 0;
+            for (size_t offset = sent; offset < data.size() && count < MaxSegments; offset += segmentSize)
+            {
+                datagrams[count].data = data.subspan(offset, std::min<size_t>(segmentSize, data.size() - offset));
+                datagrams[count].host = host;
+                datagrams[count].port = port;
+                ++count;
+            }
+
+            size_t result = sendBatch(std::span<const Datagram>(datagrams, count));
+            for (size_t i=0; i<result; ++i)
+                sent += datagrams[i].data.size();
+
+            if (result < count) break;
+        }
+
+        return sent;
+    }
+
+    int UdpSocket::addReadHandler(const std::function<void (std::span<const char>)> &func)
     {
-        int id = static_cast<int>(d->readHandlers.size());
-        for (auto const& it : d->readHandlers) if (it.first != ++id) break;
-        d->readHandlers.insert({id, func});
-        return id;
+        return d->readHandlers.add(func);
     }
 
     void UdpSocket::removeReadHandler(int id)
     {
-        auto it = d->readHandlers.find(id);
-        if (it != d->readHandlers.end())
-            d->readHandlers.erase(it);
+        d->readHandlers.remove(id);
+    }
+
+    int UdpSocket::addDatagramReadHandler(const std::function<void (const Datagram &)> &func)
+    {
+        return d->datagramHandlers.add(func);
+    }
+
+    void UdpSocket::removeDatagramReadHandler(int id)
+    {
+        d->datagramHandlers.remove(id);
+    }
+
+    void UdpSocket::setReceiveTimestamps(bool enable)
+    {
+        d->receiveTimestamps = enable;
+        applyReceiveOptions();
+    }
+
+    void UdpSocket::setReceiveDestination(bool enable)
+    {
+        d->receiveDestination = enable;
+        applyReceiveOptions();
+    }
+
+    void UdpSocket::setReceiveOffload(bool enable)
+    {
+        d->receiveOffload = enable;
+        applyReceiveOptions();
+    }
+
+    void UdpSocket::setBatchSize(size_t count, size_t maxDatagramSize)
+    {
+        if (maxDatagramSize == 0) count = 0;
+
+        d->pendingBatchSize = count;
+        d->pendingBatchDatagramSize = maxDatagramSize;
+        d->isBatchResizePending = true;
+
+        if (!d->isBatchDispatching)
+            applyBatchSize();
+    }
+
+    void UdpSocket::applyBatchSize()
+    {
+        size_t count = d->pendingBatchSize;
+        size_t maxDatagramSize = d->pendingBatchDatagramSize;
+        d->isBatchResizePending = false;
+
+        d->batchSize = count;
+        d->batchDatagramSize = maxDatagramSize;
+        d->batchData.assign(count * maxDatagramSize, 0);
+        d->batchHeaders.assign(count, mmsghdr());
+        d->batchVectors.assign(count, iovec());
+        d->batchAddresses.assign(count, sockaddr_in());
+        d->batchControl.assign(count * ControlSize, 0);
+        d->batch.clear();
+        d->batch.reserve(count);
+
+        for (size_t i=0; i<count; ++i)
+        {
+            d->batchVectors[i].iov_base = d->batchData.data() + i * maxDatagramSize;
+            d->batchVectors[i].iov_len = maxDatagramSize;
+
+            msghdr &header = d->batchHeaders[i].msg_hdr;
+            header.msg_name = &d->batchAddresses[i];
+            header.msg_iov = &d->batchVectors[i];
+            header.msg_iovlen = 1;
+        }
+    }
+
+    int UdpSocket::addBatchReadHandler(const std::function<void (std::span<const Datagram>)> &func)
+    {
+        return d->batchHandlers.add(func);
+    }
+
+    void UdpSocket::removeBatchReadHandler(int id)
+    {
+        d->batchHandlers.remove(id);
     }
 
     void UdpSocket::mainLoopHandler()
     {
         if (!d->isBinded) return;
 
-        ssize_t bytesRead = recvfrom(d->socketBind, d->dataIn.data(),d->dataIn.size(), 0, (struct sockaddr*)NULL, NULL);
+        if (!d->sendQueue.empty())
+            flushSendQueue();
 
-        if (bytesRead > -1)
+        if (d->batchSize > 0)
         {
-            d->dataTmp.clear();
-            d->dataTmp.insert(d->dataTmp.begin(), d->dataIn.begin(), d->dataIn.begin() + bytesRead);
+            readBatch();
+            return;
+        }
+
+        iovec vector;
+        vector.iov_base = d->dataIn.data();
+        vector.iov_len = d->dataIn.size();
+
+        msghdr header = {};
+        header.msg_name = &d->addressIn;
+        header.msg_iov = &vector;
+        header.msg_iovlen = 1;
+
+        // Level-triggered, so a bounded batch keeps other descriptors fair
+        for (int i=0; i<MaxReadsPerEvent && d->isBinded; ++i)
+        {
+            header.msg_namelen = sizeof(d->addressIn);
+            header.msg_control = d->controlIn.data();
+            header.msg_controllen = d->controlIn.size();
+
+            ssize_t bytesRead = ::recvmsg(d->socketBind, &header, 0);
+            if (bytesRead < 0) break;
 
-            for (const auto &it: d->readHandlers)
-                it.second(d->dataTmp);
+            Datagram datagram;
+            datagram.data = std::span<const char>(d->dataIn.data(), std::min(static_cast<size_t>(bytesRead), d->dataIn.size()));
+            size_t segmentSize = readMetadata(datagram, header);
+
+            if (segmentSize == 0)
+            {
+                dispatch(datagram);
+                continue;
+            }
+
+            d->segments.clear();
+            appendSegments(d->segments, datagram, segmentSize);
+
+            for (const Datagram &segment : d->segments)
+                dispatch(segment);
+        }
+    }
+
+    void UdpSocket::readBatch()
+    {
+        for (int i=0; i<MaxBatchesPerEvent && d->isBinded; ++i)
+        {
+            for (size_t j=0; j<d->batchSize; ++j)
+            {
+                msghdr &header = d->batchHeaders[j].msg_hdr;
+                header.msg_namelen = sizeof(sockaddr_in);
+                header.msg_control = d->batchControl.data() + j * ControlSize;
+                header.msg_controllen = ControlSize;
+            }
+
+            int count = ::recvmmsg(d->socketBind, d->batchHeaders.data(), static_cast<unsigned int>(d->batchSize), 0, nullptr);
+            if (count <= 0) break;
+
+            d->batch.clear();
+            for (int j=0; j<count; ++j)
+            {
+                Datagram datagram;
+                size_t size = std::min(static_cast<size_t>(d->batchHeaders[j].msg_len), d->batchDatagramSize);
+                datagram.data = std::span<const char>(static_cast<const char*>(d->batchVectors[j].iov_base), size);
+                size_t segmentSize = readMetadata(datagram, d->batchHeaders[j].msg_hdr);
+                appendSegments(d->batch, datagram, segmentSize);
+            }
+
+            d->isBatchDispatching = true;
+
+            std::span<const Datagram> batch(d->batch);
+            d->batchHandlers(batch);
+
+            if (!d->datagramHandlers.isEmpty() || !d->readHandlers.isEmpty())
+                for (const Datagram &datagram : batch)
+                    dispatch(datagram);
+
+            d->isBatchDispatching = false;
+
+            if (d->isBatchResizePending)
+            {
+                applyBatchSize();
+                break;
+            }
+
+            // A short batch means the queue is empty
+            if (static_cast<size_t>(count) < d->batchSize) break;
         }
     }
 
+    void UdpSocket::dispatch(const Datagram &datagram)
+    {
+        d->datagramHandlers(datagram);
+        d->readHandlers(datagram.data);
+    }
+
     bool UdpSocket::createSocket()
     {
         d->isBinded = false;
         d->socketBind = socket(AF_INET, SOCK_DGRAM, 0);
 
-        struct timeval read_timeout;
-        read_timeout.tv_sec = 0;
-        read_timeout.tv_usec = 10;
-        setsockopt(d->socketBind, SOL_SOCKET, SO_RCVTIMEO, &read_timeout, sizeof(read_timeout));
+        if (d->socketBind > -1)
+        {
+            int flags = ::fcntl(d->socketBind, F_GETFL, 0);
+            ::fcntl(d->socketBind, F_SETFL, flags | O_NONBLOCK);
+
+            int reuse = d->reuseAddress ? 1 : 0;
+            ::setsockopt(d->socketBind, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+            applyReceiveOptions();
+            applyMulticastOptions();
+        }
 
         return (d->socketBind > -1);
     }
 
+    void UdpSocket::applyReceiveOptions()
+    {
+        if (d->socketBind < 0) return;
+
+        int timestamps = d->receiveTimestamps ? 1 : 0;
+        ::setsockopt(d->socketBind, SOL_SOCKET, SO_TIMESTAMPNS, &timestamps, sizeof(timestamps));
+
+        int destination = d->receiveDestination ? 1 : 0;
+        ::setsockopt(d->socketBind, IPPROTO_IP, IP_PKTINFO, &destination, sizeof(destination));
+
+        int offload = d->receiveOffload ? 1 : 0;
+        ::setsockopt(d->socketBind, SOL_UDP, UDP_GRO, &offload, sizeof(offload));
+    }
+
+    void UdpSocket::applyMulticastOptions()
+    {
+        // Both sockets send: the bound one once it exists, the other before
+        int sockets[] = {d->socketSend, d->socketBind};
+        for (int socket : sockets)
+        {
+            if (socket < 0) continue;
+
+            int ttl = static_cast<int>(d->multicastTtl);
+            ::setsockopt(socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+
+            int loopback = d->multicastLoopback ? 1 : 0;
+            ::setsockopt(socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loopback, sizeof(loopback));
+
+            in_addr localInterface;
+            localInterface.s_addr = htonl(d->multicastInterface);
+            ::setsockopt(socket, IPPROTO_IP, IP_MULTICAST_IF, &localInterface, sizeof(localInterface));
+        }
+    }
+
+    bool UdpSocket::changeMembership(int option, uint32_t group, uint32_t localInterface)
+    {
+        if (!d->isBinded) return false;
+
+        ip_mreq request;
+        request.imr_multiaddr.s_addr = htonl(group);
+        request.imr_interface.s_addr = htonl(localInterface);
+
+        int state = ::setsockopt(d->socketBind, IPPROTO_IP, option, &request, sizeof(request));
+        return state > -1;
+    }
+
+    void UdpSocket::flushSendQueue()
+    {
+        while (d->isBinded && !d->sendQueue.empty())
+        {
+            const UdpSocketPrivate::QueuedDatagram &datagram = d->sendQueue.front();
+            int state = sendto(d->socketBind, datagram.data.data(), datagram.data.size(), MSG_CONFIRM,
+                               (const struct sockaddr *) &datagram.address, sizeof(datagram.address));
+
+            if (state < 0)
+            {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            }
+
+            // Sent or refused, a datagram is not retried on other errors
+            d->sendQueueSize -= datagram.data.size();
+            d->sendQueue.pop_front();
+        }
+
+#ifdef SACore
+        if (d->isBinded)
+            d->loop->setDescriptorEvents(d->socketBind, SA::DescriptorRead);
+#endif
+    }
+
     void UdpSocket::deleteSocket()
     {
         d->isBinded = false;
+        d->sendQueue.clear();
+        d->sendQueueSize = 0;
 
         if (d->socketBind > -1)
+        {
+#ifdef SACore
+            d->loop->removeDescriptorListener(d->socketBind);
+#endif
             ::close(d->socketBind);
+        }
 
         d->socketBind = -1;
     }
@@ -1,24 +1,49 @@
 #ifdef WIN32
 
 #include <winsock2.h>
+#include <ws2tcpip.h>
 
 #include <memory>
 #include <vector>
 #include <string>
-#include <map>
+#include <deque>
+#include <algorithm>
 
 #include "udpsocket.h"
+#include "handlerlist.h"
 
 #ifdef SACore
-#include "application.h"
+#include "eventloop.h"
 #endif
 
-static const size_t DefaultLen = 1024;
+static const size_t MaxDatagramSize = 65536;
+static const int MaxReadsPerEvent = 64;
+static const size_t MaxSendQueueSize = 1024 * 1024;
+
+// Reads one datagram with its sender, false when nothing is left.
+// Too long datagrams fail with WSAEMSGSIZE but still fill the buffer.
+static bool receive(SOCKET socket, char *buffer, size_t size, SA::UdpSocket::Datagram &datagram)
+{
+    SOCKADDR_IN addr;
+    int addrLen = sizeof(addr);
+
+    int bytesRead = recvfrom(socket, buffer, static_cast<int>(size), 0, (SOCKADDR*) &addr, &addrLen);
+    datagram.truncated = (bytesRead == SOCKET_ERROR && WSAGetLastError() == WSAEMSGSIZE);
+    if (bytesRead == SOCKET_ERROR && !datagram.truncated) return false;
+
+    datagram.data = std::span<const char>(buffer, datagram.truncated ? size : static_cast<size_t>(bytesRead));
+    datagram.host = ntohl(addr.sin_addr.s_addr);
+    datagram.port = ntohs(addr.sin_port);
+    datagram.destination = 0;
+    datagram.timestamp = 0;
+    return true;
+}
 
 namespace SA
 {
     struct UdpSocket::UdpSocketPrivate
     {
+        SA::EventLoop *loop = nullptr;
         int mainLoopId = -1;
         SOCKET socketBind = INVALID_SOCKET;
         SOCKET socketSend = INVALID_SOCKET;
@@ -26,25 +51,62 @@ namespace SA
         bool isWinsockStarted = false;
         SOCKADDR_IN addressSrc;
 
-        std::vector<char> dataIn, dataTmp;
-        std::map<int, std::function<void (const std::vector<char>&)> > readHandlers;
+        std::vector<char> dataIn;
+        SA::HandlerList<void (std::span<const char>)> readHandlers;
+        SA::HandlerList<void (const Datagram &)> datagramHandlers;
+
+        bool reuseAddress = false;
+        int multicastTtl = 1;
+        bool multicastLoopback = true;
+        uint32_t multicastInterface = INADDR_ANY;
+
+        bool receiveTimestamps = false;
+        bool receiveDestination = false;
+        bool receiveOffload = false;
+
+        size_t batchSize = 0;
+        size_t batchDatagramSize = 0;
+        std::vector<char> batchData;
+        std::vector<Datagram> batch;
+        SA::HandlerList<void (std::span<const Datagram>)> batchHandlers;
+
+        // Handlers see views of the batch buffers, a new size set from one
+        // of them waits until the batch is dispatched
+        bool isBatchDispatching = false;
+        bool isBatchResizePending = false;
+        size_t pendingBatchSize = 0;
+        size_t pendingBatchDatagramSize = 0;
+
+        // Datagrams the bound socket could not take yet, sent in order from
+        // the polled main loop handler
+        struct QueuedDatagram
+        {
+            std::vector<char> data;
+            SOCKADDR_IN address;
+        };
+
+        std::deque<QueuedDatagram> sendQueue;
+        size_t sendQueueSize = 0;
     };
 
     UdpSocket::UdpSocket():
         d(new UdpSocketPrivate)
     {
+#ifdef SACore
+        d->loop = SA::EventLoop::current();
+#endif
+
         WSADATA wsa;
         long rc = WSAStartup(MAKEWORD(2, 0), &wsa);
         d->isWinsockStarted = (rc == 0);
 
         if (d->isWinsockStarted)
         {
-            d->dataIn.resize(DefaultLen, 0);
-            d->dataTmp.reserve(DefaultLen);
+            d->dataIn.resize(MaxDatagramSize);
             d->socketSend = socket(AF_INET, SOCK_DGRAM, 0);
 
 #ifdef SACore
-            d->mainLoopId = SA::Application::instance().addMainLoopListener(std::bind(&UdpSocket::mainLoopHandler, this));
+            d->mainLoopId = d->loop->addMainLoopListener(std::bind(&UdpSocket::mainLoopHandler, this));
 #endif
         }
     }
@@ -52,9 +114,13 @@ namespace SA
     SA::UdpSocket::~UdpSocket()
     {
 #ifdef SACore
-        SA::Application::instance().removeMainLoopListener(d->mainLoopId);
+        d->loop->removeMainLoopListener(d->mainLoopId);
 #endif
         deleteSocket();
+
+        if (d->socketSend != INVALID_SOCKET)
+            closesocket(d->socketSend);
+
         delete d;
     }
 
@@ -97,17 +163,95 @@ namespace SA
         deleteSocket();
     }
 
+    void UdpSocket::setReuseAddress(bool enable)
+    {
+        d->reuseAddress = enable;
+    }
+
+    bool UdpSocket::joinGroup(uint32_t group, uint32_t localInterface)
+    {
+        return changeMembership(IP_ADD_MEMBERSHIP, group, localInterface);
+    }
+
+    bool UdpSocket::joinGroup(const char* group, const char* localInterface)
+    {
+        return joinGroup(static_cast<uint32_t>(htonl(inet_addr(group))), localInterface ? static_cast<uint32_t>(htonl(inet_addr(localInterface))) : 0);
+    }
+
+    bool UdpSocket::joinGroup(const std::string &group, const std::string &localInterface)
+    {
+        return joinGroup(group.c_str(), localInterface.empty() ? nullptr : localInterface.c_str());
+    }
+
+    bool UdpSocket::leaveGroup(uint32_t group, uint32_t localInterface)
+    {
+        return changeMembership(IP_DROP_MEMBERSHIP, group, localInterface);
+    }
+
+    bool UdpSocket::leaveGroup(const char* group, const char* localInterface)
+    {
+        return leaveGroup(static_cast<uint32_t>(htonl(inet_addr(group))), localInterface ? static_cast<uint32_t>(htonl(inet_addr(localInterface))) : 0);
+    }
+
+    bool UdpSocket::leaveGroup(const std::string &group, const std::string &localInterface)
+    {
+        return leaveGroup(group.c_str(), localInterface.empty() ? nullptr : localInterface.c_str());
+    }
+
+    void UdpSocket::setMulticastTtl(int ttl)
+    {
+        d->multicastTtl = ttl;
+        applyMulticastOptions();
+    }
+
+    void UdpSocket::setMulticastLoopback(bool enable)
+    {
+        d->multicastLoopback = enable;
+        applyMulticastOptions();
+    }
+
+    void UdpSocket::setMulticastInterface(uint32_t localInterface)
+    {
+        d->multicastInterface = localInterface;
+        applyMulticastOptions();
+    }
+
+    void UdpSocket::setMulticastInterface(const char* localInterface)
+    {
+        setMulticastInterface(static_cast<uint32_t>(htonl(inet_addr(localInterface))));
+    }
+
+    void UdpSocket::setMulticastInterface(const std::string &localInterface)
+    {
+        setMulticastInterface(localInterface.c_str());
+    }
+
     bool UdpSocket::send(const std::vector<char> &data, uint32_t host, uint16_t port)
     {
         if (!d->socketSend) return false;
 
+        // Replies to a bound socket should come back to it, so it sends itself
+        SOCKET socket = d->isBinded ? d->socketBind : d->socketSend;
+
         SOCKADDR_IN addr;
         addr.sin_family = AF_INET;
         addr.sin_port = htons(port);
         addr.sin_addr.s_addr = htonl(host);
 
-        long state = sendto(d->socketSend, data.data(), data.size(), 0, (SOCKADDR*) &addr, sizeof(addr));
-        return (state != SOCKET_ERROR);
+        // The bound socket is non-blocking, a datagram it cannot take yet is
+        // queued, and so is everything behind it to keep the order
+        if (!d->isBinded || d->sendQueue.empty())
+        {
+            long state = sendto(socket, data.data(), data.size(), 0, (SOCKADDR*) &addr, sizeof(addr));
+            if (state != SOCKET_ERROR) return true;
+            if (!d->isBinded || WSAGetLastError() != WSAEWOULDBLOCK) return false;
+        }
+
+        if (d->sendQueueSize + data.size() > MaxSendQueueSize) return false;
+
+        d->sendQueue.push_back({data, addr});
+        d->sendQueueSize += data.size();
+        return true;
     }
 
     bool UdpSocket::send(const std::vector<char> &data, const char *host, uint16_t port)
@@ -120,37 +264,179 @@ namespace SA
         return send(data, host.c_str(), port);
     }
 
-    int UdpSocket::addReadHandler(const std::function<void (const std::vector<char>&)> &func)
+    size_t UdpSocket::sendBatch(std::span<const Datagram> datagrams)
+    {
+        if (d->socketSend == INVALID_SOCKET) return 0;
+
+        SOCKET socket = d->isBinded ? d->socketBind : d->socketSend;
+
+        // No sendmmsg here, one sendto per datagram
+        size_t sent = 0;
+        for (const Datagram &datagram : datagrams)
+        {
+            SOCKADDR_IN addr;
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(datagram.port);
+            addr.sin_addr.s_addr = htonl(datagram.host);
+
+            long state = sendto(socket, datagram.data.data(), static_cast<int>(datagram.data.size()), 0,
+                                (SOCKADDR*) &addr, sizeof(addr));
+            if (state == SOCKET_ERROR) break;
+            ++sent;
+        }
+
+        return sent;
+    }
+
+    size_t UdpSocket::sendSegmented(std::span<const char> data, uint16_t segmentSize, uint32_t host, uint16_t port)
     {
-        int id = static_cast<int>(d->readHandlers.size());
-        for (auto const& it : d->readHandlers) if (it.first != ++id) break;
-        d->readHandlers.insert({id, func});
-        return id;
+        if (d->socketSend == INVALID_SOCKET || segmentSize == 0) return 0;
+
+        // No UDP_SEGMENT on this path, one sendto per segment
+        size_t sent = 0;
+        while (sent < data.size())
+        {
+            Datagram datagram;
+            datagram.data = data.subspan(sent, std::min<size_t>(segmentSize, data.size() - sent));
+            datagram.host = host;
+            datagram.port = port;
+
+            if (sendBatch(std::span<const Datagram>(&datagram, 1)) == 0) break;
+            sent += datagram.data.size();
+        }
+
+        return sent;
+    }
+
+    int UdpSocket::addReadHandler(const std::function<void (std::span<const char>)> &func)
+    {
+        return d->readHandlers.add(func);
     }
 
     void UdpSocket::removeReadHandler(int id)
     {
-        auto it = d->readHandlers.find(id);
-        if (it != d->readHandlers.end())
-            d->readHandlers.erase(it);
+        d->readHandlers.remove(id);
+    }
+
+    int UdpSocket::addDatagramReadHandler(const std::function<void (const Datagram &)> &func)
+    {
+        return d->datagramHandlers.add(func);
+    }
+
+    void UdpSocket::removeDatagramReadHandler(int id)
+    {
+        d->datagramHandlers.remove(id);
+    }
+
+    void UdpSocket::setReceiveTimestamps(bool enable)
+    {
+        d->receiveTimestamps = enable;
+        applyReceiveOptions();
+    }
+
+    void UdpSocket::setReceiveDestination(bool enable)
+    {
+        d->receiveDestination = enable;
+        applyReceiveOptions();
+    }
+
+    void UdpSocket::setReceiveOffload(bool enable)
+    {
+        d->receiveOffload = enable;
+        applyReceiveOptions();
+    }
+
+    void UdpSocket::setBatchSize(size_t count, size_t maxDatagramSize)
+    {
+        if (maxDatagramSize == 0) count = 0;
+
+        d->pendingBatchSize = count;
+        d->pendingBatchDatagramSize = maxDatagramSize;
+        d->isBatchResizePending = true;
+
+        if (!d->isBatchDispatching)
+            applyBatchSize();
+    }
+
+    void UdpSocket::applyBatchSize()
+    {
+        size_t count = d->pendingBatchSize;
+        size_t maxDatagramSize = d->pendingBatchDatagramSize;
+        d->isBatchResizePending = false;
+
+        d->batchSize = count;
+        d->batchDatagramSize = maxDatagramSize;
+        d->batchData.assign(count * maxDatagramSize, 0);
+        d->batch.assign(count, Datagram());
+    }
+
+    int UdpSocket::addBatchReadHandler(const std::function<void (std::span<const Datagram>)> &func)
+    {
+        return d->batchHandlers.add(func);
+    }
+
+    void UdpSocket::removeBatchReadHandler(int id)
+    {
+        d->batchHandlers.remove(id);
     }
 
     void UdpSocket::mainLoopHandler()
     {
         if (!d->isBinded) return;
 
-        ssize_t bytesRead = recvfrom(d->socketBind, d->dataIn.data(),d->dataIn.size(), 0, (struct sockaddr*)NULL, NULL);
+        if (!d->sendQueue.empty())
+            flushSendQueue();
 
-        if (bytesRead > -1)
+        if (d->batchSize > 0)
         {
-            d->dataTmp.clear();
-            d->dataTmp.insert(d->dataTmp.begin(), d->dataIn.begin(), d->dataIn.begin() + bytesRead);
+            readBatch();
+            return;
+        }
+
+        // Polled every iteration, a bounded batch keeps the loop responsive
+        for (int i=0; i<MaxReadsPerEvent && d->isBinded; ++i)
+        {
+            Datagram datagram;
+            if (!receive(d->socketBind, d->dataIn.data(), d->dataIn.size(), datagram)) break;
 
-            for (const auto &it: d->readHandlers)
-                it.second(d->dataTmp);
+            dispatch(datagram);
         }
     }
 
+    void UdpSocket::readBatch()
+    {
+        // No recvmmsg here, fill the batch with recvfrom until it would block
+        size_t count = 0;
+        while (count < d->batchSize && d->isBinded)
+        {
+            char *buffer = d->batchData.data() + count * d->batchDatagramSize;
+            if (!receive(d->socketBind, buffer, d->batchDatagramSize, d->batch[count])) break;
+            ++count;
+        }
+
+        if (count == 0) return;
+
+        d->isBatchDispatching = true;
+
+        std::span<const Datagram> batch(d->batch.data(), count);
+        d->batchHandlers(batch);
+
+        if (!d->datagramHandlers.isEmpty() || !d->readHandlers.isEmpty())
+            for (const Datagram &datagram : batch)
+                dispatch(datagram);
+
+        d->isBatchDispatching = false;
+
+        if (d->isBatchResizePending)
+            applyBatchSize();
+    }
+
+    void UdpSocket::dispatch(const Datagram &datagram)
+    {
+        d->datagramHandlers(datagram);
+        d->readHandlers(datagram.data);
+    }
+
     bool UdpSocket::createSocket()
     {
         d->isBinded = false;
@@ -159,16 +445,79 @@ namespace SA
 
         if (isSocketCreated)
         {
-            int iVal = 10;
-            setsockopt(d->socketBind, SOL_SOCKET, SO_RCVTIMEO, (char *)&iVal, sizeof(iVal));
+            u_long mode = 1;
+            ::ioctlsocket(d->socketBind, FIONBIO, &mode);
+
+            BOOL reuse = d->reuseAddress ? TRUE : FALSE;
+            ::setsockopt(d->socketBind, SOL_SOCKET, SO_REUSEADDR, (const char*) &reuse, sizeof(reuse));
+
+            applyReceiveOptions();
+            applyMulticastOptions();
         }
 
         return isSocketCreated;
     }
 
+    void UdpSocket::applyReceiveOptions()
+    {
+        // Timestamps and IP_PKTINFO need WSARecvMsg, which recvfrom can't use,
+        // so both stay zero here. Receive offload is never turned on either,
+        // datagrams always arrive one by one.
+    }
+
+    void UdpSocket::applyMulticastOptions()
+    {
+        // Both sockets send: the bound one once it exists, the other before
+        SOCKET sockets[] = {d->socketSend, d->socketBind};
+        for (SOCKET socket : sockets)
+        {
+            if (socket == INVALID_SOCKET) continue;
+
+            DWORD ttl = static_cast<DWORD>(d->multicastTtl);
+            ::setsockopt(socket, IPPROTO_IP, IP_MULTICAST_TTL, (const char*) &ttl, sizeof(ttl));
+
+            DWORD loopback = d->multicastLoopback ? 1 : 0;
+            ::setsockopt(socket, IPPROTO_IP, IP_MULTICAST_LOOP, (const char*) &loopback, sizeof(loopback));
+
+            in_addr localInterface;
+            localInterface.s_addr = htonl(d->multicastInterface);
+            ::setsockopt(socket, IPPROTO_IP, IP_MULTICAST_IF, (const char*) &localInterface, sizeof(localInterface));
+        }
+    }
+
+    bool UdpSocket::changeMembership(int option, uint32_t group, uint32_t localInterface)
+    {
+        if (!d->isBinded) return false;
+
+        ip_mreq request;
+        request.imr_multiaddr.s_addr = htonl(group);
+        request.imr_interface.s_addr = htonl(localInterface);
+
+        int state = ::setsockopt(d->socketBind, IPPROTO_IP, option, (const char*) &request, sizeof(request));
+        return state != SOCKET_ERROR;
+    }
+
+    void UdpSocket::flushSendQueue()
+    {
+        while (d->isBinded && !d->sendQueue.empty())
+        {
+            const UdpSocketPrivate::QueuedDatagram &datagram = d->sendQueue.front();
+            long state = sendto(d->socketBind, datagram.data.data(), static_cast<int>(datagram.data.size()), 0,
+                                (const SOCKADDR*) &datagram.address, sizeof(datagram.address));
+
+            if (state == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK) return;
+
+            // Sent or refused, a datagram is not retried on other errors
+            d->sendQueueSize -= datagram.data.size();
+            d->sendQueue.pop_front();
+        }
+    }
+
     void UdpSocket::deleteSocket()
     {
         d->isBinded = false;
+        d->sendQueue.clear();
+        d->sendQueueSize = 0;
 
         if (d->socketBind != INVALID_SOCKET)
             closesocket(d->socketBind);
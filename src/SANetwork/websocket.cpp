@@ -0,0 +1,773 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+
+#ifdef __linux__
+#include <sys/random.h>
+#endif
+
+#include "websocket.h"
+#include "tcpsocket.h"
+#include "handlerlist.h"
+
+#ifdef SACore
+#include "eventloop.h"
+#endif
+
+static const size_t DefaultMaxMessageSize = 1024 * 1024;
+static const size_t MaxHandshakeSize = 16 * 1024;
+static const size_t MaxControlPayload = 125;
+static const size_t MaxFrameHeaderSize = 14;
+static const int CloseTimeout = 5000;
+
+static const uint8_t OpContinuation = 0x0;
+static const uint8_t OpText = 0x1;
+static const uint8_t OpBinary = 0x2;
+static const uint8_t OpClose = 0x8;
+static const uint8_t OpPing = 0x9;
+static const uint8_t OpPong = 0xA;
+
+static const uint16_t CloseNormal = 1000;
+static const uint16_t CloseProtocolError = 1002;
+static const uint16_t CloseNoStatus = 1005;
+static const uint16_t CloseAbnormal = 1006;
+static const uint16_t CloseInvalidData = 1007;
+static const uint16_t CloseTooBig = 1009;
+
+static const char WebSocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static uint32_t rotateLeft(uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+// Only for the handshake, SHA-1 is not used for anything secret here
+static std::array<uint8_t, 20> sha1(std::string_view data)
+{
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+    std::string message(data);
+    uint64_t bitLength = static_cast<uint64_t>(data.size()) * 8;
+    message.push_back(static_cast<char>(0x80));
+    while (message.size() % 64 != 56) message.push_back(0);
+    for (int i=7; i>=0; --i) message.push_back(static_cast<char>(bitLength >> (i * 8)));
+
+    for (size_t chunk=0; chunk<message.size(); chunk+=64)
+    {
+        uint32_t w[80];
+        for (int i=0; i<16; ++i)
+        {
+            const uint8_t *bytes = reinterpret_cast<const uint8_t*>(message.data() + chunk + i * 4);
+            w[i] = (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) |
+                   (static_cast<uint32_t>(bytes[2]) << 8) | static_cast<uint32_t>(bytes[3]);
+        }
+        for (int i=16; i<80; ++i)
+            w[i] = rotateLeft(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i=0; i<80; ++i)
+        {
+            uint32_t f, k;
+            if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+
+            uint32_t temp = rotateLeft(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = rotateLeft(b, 30); b = a; a = temp;
+        }
+
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+
+    std::array<uint8_t, 20> digest;
+    for (int i=0; i<20; ++i)
+        digest[i] = static_cast<uint8_t>(h[i / 4] >> (24 - (i % 4) * 8));
+    return digest;
+}
+
+static std::string base64(const uint8_t *data, size_t size)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    std::string out;
+    out.reserve((size + 2) / 3 * 4);
+
+    for (size_t i=0; i<size; i+=3)
+    {
+        uint32_t group = static_cast<uint32_t>(data[i]) << 16;
+        if (i + 1 < size) group |= static_cast<uint32_t>(data[i + 1]) << 8;
+        if (i + 2 < size) group |= data[i + 2];
+
+        out.push_back(alphabet[(group >> 18) & 0x3F]);
+        out.push_back(alphabet[(group >> 12) & 0x3F]);
+        out.push_back(i + 1 < size ? alphabet[(group >> 6) & 0x3F] : '=');
+        out.push_back(i + 2 < size ? alphabet[group & 0x3F] : '=');
+    }
+    return out;
+}
+
+// Masking keys and the handshake nonce must not be predictable (RFC 6455
+// 10.3), they come from the system, a batch of words per call
+static uint32_t randomWord()
+{
+    thread_local uint32_t words[64];
+    thread_local size_t next = std::size(words);
+
+    if (next == std::size(words))
+    {
+        size_t filled = 0;
+#ifdef __linux__
+        char *bytes = reinterpret_cast<char*>(words);
+        while (filled < sizeof(words))
+        {
+            ssize_t result = ::getrandom(bytes + filled, sizeof(words) - filled, 0);
+            if (result < 0 && errno == EINTR) continue;
+            if (result < 0) break;
+            filled += static_cast<size_t>(result);
+        }
+#endif
+        // Where getrandom() is missing or failed
+        if (filled < sizeof(words))
+        {
+            std::random_device device;
+            for (uint32_t &word : words) word = device();
+        }
+        next = 0;
+    }
+
+    return words[next++];
+}
+
+// XOR with the 4 byte key while copying, eight bytes at a time. The key
+// starts over with every frame, so payload offsets stay aligned to it.
+static void applyMask(char *out, const char *in, size_t size, const uint8_t *mask)
+{
+    uint32_t key32;
+    std::memcpy(&key32, mask, 4);
+    uint64_t key64 = (static_cast<uint64_t>(key32) << 32) | key32;
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, in + i, 8);
+        word ^= key64;
+        std::memcpy(out + i, &word, 8);
+    }
+
+    for (; i < size; ++i)
+        out[i] = static_cast<char>(in[i] ^ mask[i & 3]);
+}
+
+static bool isValidUtf8(std::span<const char> text)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t*>(text.data());
+    size_t size = text.size(), i = 0;
+
+    while (i < size)
+    {
+        // ASCII runs eight at a time
+        while (i + 8 <= size)
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, 8);
+            if (word & 0x8080808080808080ull) break;
+            i += 8;
+        }
+        if (i == size) break;
+
+        uint8_t byte = bytes[i];
+        if (byte < 0x80)
+        {
+            ++i;
+            continue;
+        }
+
+        size_t length = 0;
+        uint32_t codePoint = 0;
+        if ((byte & 0xE0) == 0xC0)      { length = 2; codePoint = byte & 0x1F; }
+        else if ((byte & 0xF0) == 0xE0) { length = 3; codePoint = byte & 0x0F; }
+        else if ((byte & 0xF8) == 0xF0) { length = 4; codePoint = byte & 0x07; }
+        else return false;
+
+        if (size - i < length) return false;
+
+        for (size_t j=1; j<length; ++j)
+        {
+            if ((bytes[i + j] & 0xC0) != 0x80) return false;
+            codePoint = (codePoint << 6) | (bytes[i + j] & 0x3F);
+        }
+
+        // Overlong forms, surrogates, beyond U+10FFFF
+        static const uint32_t minimum[] = {0, 0, 0x80, 0x800, 0x10000};
+        if (codePoint < minimum[length] || (codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF)
+            return false;
+
+        i += length;
+    }
+    return true;
+}
+
+static bool isValidCloseCode(uint16_t code)
+{
+    if (code >= 3000 && code <= 4999) return true;
+    return code >= 1000 && code <= 1014 && code != 1004 && code != CloseNoStatus && code != CloseAbnormal;
+}
+
+static bool equalsIgnoreCase(std::string_view left, std::string_view right)
+{
+    return std::equal(left.begin(), left.end(), right.begin(), right.end(), [](char a, char b) {
+        return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+    });
+}
+
+namespace SA
+{
+    struct WebSocket::WebSocketPrivate
+    {
+        SA::EventLoop *loop = nullptr;
+        int closeTimer = -1;
+
+        SA::WebSocket::State state = SA::WebSocket::Closed;
+        bool isClient = false;
+
+        // Clients own their socket, the server side belongs to HttpServer
+        std::unique_ptr<SA::TcpSocket> ownSocket;
+        SA::TcpSocket *socket = nullptr;
+        std::string handshakeKey;
+
+        // Unmasked payloads and fragmented messages, reused
+        std::vector<char> message;
+        SA::WebSocket::MessageType messageType = SA::WebSocket::Text;
+        bool isFragmented = false;
+        size_t maxMessageSize = DefaultMaxMessageSize;
+
+        SA::HandlerList<void ()> openHandlers;
+        SA::HandlerList<void (SA::WebSocket::MessageType, std::span<const char>)> messageHandlers;
+        SA::HandlerList<void (std::span<const char>)> pongHandlers;
+        SA::HandlerList<void (uint16_t)> closeHandlers;
+    };
+
+    WebSocket::WebSocket():
+        d(new WebSocketPrivate)
+    {
+#ifdef SACore
+        d->loop = SA::EventLoop::current();
+#endif
+    }
+
+    WebSocket::~WebSocket()
+    {
+        stopCloseTimer();
+        delete d;
+    }
+
+    bool WebSocket::connect(const std::string &host, uint16_t port, const std::string &path)
+    {
+        if (d->state != Closed) return false;
+
+        d->isClient = true;
+        d->isFragmented = false;
+        d->ownSocket = std::make_unique<SA::TcpSocket>();
+        d->socket = d->ownSocket.get();
+
+        d->socket->addReadHandler([this](std::span<const char> data) {
+            return d->state == Connecting ? processHandshake(data) : decode(data);
+        });
+        d->socket->addDisconnectHandler([this](int) { processDisconnected(); });
+        d->socket->addErrorHandler([this](int) { fail(CloseAbnormal); });
+
+        uint8_t nonce[16];
+        for (size_t i=0; i<sizeof(nonce); i+=4)
+        {
+            uint32_t word = randomWord();
+            std::memcpy(nonce + i, &word, 4);
+        }
+        d->handshakeKey = base64(nonce, sizeof(nonce));
+
+        // IPv6 literals are the only hosts with colons, they go in brackets
+        std::string authority = host.find(':') == std::string::npos ? host : "[" + host + "]";
+
+        std::string request = "GET " + path + " HTTP/1.1\r\n"
+                              "Host: " + authority + ":" + std::to_string(port) + "\r\n"
+                              "Upgrade: websocket\r\n"
+                              "Connection: Upgrade\r\n"
+                              "Sec-WebSocket-Key: " + d->handshakeKey + "\r\n"
+                              "Sec-WebSocket-Version: 13\r\n\r\n";
+
+        d->socket->addConnectHandler([this, request]() {
+            d->socket->send(std::vector<char>(request.begin(), request.end()));
+        });
+
+        d->state = Connecting;
+        if (d->socket->connectAsync(host, port)) return true;
+
+        d->state = Closed;
+        return false;
+    }
+
+    WebSocket::State WebSocket::state()
+    {
+        return d->state;
+    }
+
+    bool WebSocket::send(MessageType type, std::span<const char> payload)
+    {
+        if (d->state != Open || payload.size() > d->maxMessageSize) return false;
+        if (type == Text && !isValidUtf8(payload)) return false;
+
+        return sendFrame(type == Text ? OpText : OpBinary, payload);
+    }
+
+    bool WebSocket::sendText(std::string_view text)
+    {
+        return send(Text, std::span<const char>(text.data(), text.size()));
+    }
+
+    bool WebSocket::ping(std::span<const char> payload)
+    {
+        if (d->state != Open || payload.size() > MaxControlPayload) return false;
+        return sendFrame(OpPing, payload);
+    }
+
+    std::shared_ptr<const std::vector<char> > WebSocket::encode(MessageType type, std::span<const char> payload)
+    {
+        auto frame = std::make_shared<std::vector<char> >();
+        frame->reserve(MaxFrameHeaderSize + payload.size());
+
+        frame->push_back(static_cast<char>(0x80 | (type == Text ? OpText : OpBinary)));
+
+        uint64_t size = payload.size();
+        if (size < 126)
+        {
+            frame->push_back(static_cast<char>(size));
+        }
+        else if (size <= 0xFFFF)
+        {
+            frame->push_back(126);
+            frame->push_back(static_cast<char>(size >> 8));
+            frame->push_back(static_cast<char>(size));
+        }
+        else
+        {
+            frame->push_back(127);
+            for (int i=7; i>=0; --i)
+                frame->push_back(static_cast<char>(size >> (i * 8)));
+        }
+
+        frame->insert(frame->end(), payload.begin(), payload.end());
+        return frame;
+    }
+
+    bool WebSocket::send(const std::shared_ptr<const std::vector<char> > &frame)
+    {
+        if (d->state != Open || d->isClient || !frame) return false;
+        return d->socket->send(frame);
+    }
+
+    void WebSocket::close(uint16_t code, std::string_view reason)
+    {
+        if (d->state == Connecting)
+        {
+            fail(CloseAbnormal);
+            return;
+        }
+
+        if (d->state != Open) return;
+        if (!isValidCloseCode(code)) code = CloseNormal;
+
+        std::vector<char> payload = {static_cast<char>(code >> 8), static_cast<char>(code)};
+        payload.insert(payload.end(), reason.begin(), reason.begin() + std::min(reason.size(), MaxControlPayload - 2));
+
+        sendFrame(OpClose, payload);
+        d->state = Closing;
+
+#ifdef SACore
+        // A peer that never answers does not keep the connection forever
+        d->closeTimer = d->loop->singleShot(CloseTimeout, [this]() {
+            d->closeTimer = -1;
+            fail(CloseAbnormal);
+        });
+#endif
+    }
+
+    bool WebSocket::setMaxMessageSize(size_t size)
+    {
+        // An unfragmented message is one frame, it could never be read
+        if (size > SA::TcpSocket::MaxReadSize - MaxFrameHeaderSize) return false;
+
+        d->maxMessageSize = size;
+        return true;
+    }
+
+    int WebSocket::addOpenHandler(const std::function<void ()> &func)
+    {
+        return d->openHandlers.add(func);
+    }
+
+    void WebSocket::removeOpenHandler(int id)
+    {
+        d->openHandlers.remove(id);
+    }
+
+    int WebSocket::addMessageHandler(const std::function<void (SA::WebSocket::MessageType, std::span<const char>)> &func)
+    {
+        return d->messageHandlers.add(func);
+    }
+
+    void WebSocket::removeMessageHandler(int id)
+    {
+        d->messageHandlers.remove(id);
+    }
+
+    int WebSocket::addPongHandler(const std::function<void (std::span<const char>)> &func)
+    {
+        return d->pongHandlers.add(func);
+    }
+
+    void WebSocket::removePongHandler(int id)
+    {
+        d->pongHandlers.remove(id);
+    }
+
+    int WebSocket::addCloseHandler(const std::function<void (uint16_t)> &func)
+    {
+        return d->closeHandlers.add(func);
+    }
+
+    void WebSocket::removeCloseHandler(int id)
+    {
+        d->closeHandlers.remove(id);
+    }
+
+    std::string WebSocket::acceptKey(std::string_view key)
+    {
+        std::array<uint8_t, 20> digest = sha1(std::string(key) + WebSocketGuid);
+        return base64(digest.data(), digest.size());
+    }
+
+    void WebSocket::accept(SA::TcpSocket &socket)
+    {
+        d->isClient = false;
+        d->isFragmented = false;
+        d->socket = &socket;
+        d->state = Open;
+    }
+
+    size_t WebSocket::processHandshake(std::span<const char> data)
+    {
+        std::string_view view(data.data(), data.size());
+        size_t headEnd = view.find("\r\n\r\n");
+
+        if (headEnd == std::string_view::npos)
+        {
+            if (view.size() > MaxHandshakeSize) fail(CloseAbnormal);
+            return d->state == Closed ? data.size() : 0;
+        }
+
+        std::string_view head = view.substr(0, headEnd);
+        bool isAccepted = head.starts_with("HTTP/1.1 101");
+        bool hasAcceptKey = false;
+
+        while (isAccepted && !head.empty())
+        {
+            size_t lineEnd = head.find("\r\n");
+            std::string_view line = head.substr(0, lineEnd);
+            head.remove_prefix(lineEnd == std::string_view::npos ? head.size() : lineEnd + 2);
+
+            size_t colon = line.find(':');
+            if (colon == std::string_view::npos) continue;
+
+            std::string_view value = line.substr(colon + 1);
+            while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+            while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+
+            if (equalsIgnoreCase(line.substr(0, colon), "Sec-WebSocket-Accept"))
+                hasAcceptKey = value == acceptKey(d->handshakeKey);
+        }
+
+        if (!isAccepted || !hasAcceptKey)
+        {
+            fail(CloseAbnormal);
+            return data.size();
+        }
+
+        d->state = Open;
+        d->openHandlers();
+
+        // Frames may have come right after the response
+        size_t consumed = headEnd + 4;
+        if (d->state == Open && consumed < data.size())
+            consumed += decode(data.subspan(consumed));
+
+        return d->state == Closed ? data.size() : consumed;
+    }
+
+    size_t WebSocket::decode(std::span<const char> data)
+    {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data.data());
+        size_t consumed = 0;
+
+        while (d->state == Open || d->state == Closing)
+        {
+            size_t available = data.size() - consumed;
+            if (available < 2) break;
+
+            const uint8_t *header = bytes + consumed;
+            bool isFinal = header[0] & 0x80;
+            uint8_t opcode = header[0] & 0x0F;
+            bool isMasked = header[1] & 0x80;
+            uint64_t length = header[1] & 0x7F;
+            size_t headerSize = 2;
+
+            if (length == 126)
+            {
+                if (available < 4) break;
+                length = (static_cast<uint64_t>(header[2]) << 8) | header[3];
+                headerSize = 4;
+            }
+            else if (length == 127)
+            {
+                if (available < 10) break;
+                length = 0;
+                for (int i=0; i<8; ++i)
+                    length = (length << 8) | header[2 + i];
+                headerSize = 10;
+            }
+
+            // No extensions, clients mask and servers don't
+            if ((header[0] & 0x70) || isMasked == d->isClient)
+            {
+                fail(CloseProtocolError);
+                break;
+            }
+
+            if (opcode & 0x08)
+            {
+                if (!isFinal || length > MaxControlPayload || opcode > OpPong)
+                {
+                    fail(CloseProtocolError);
+                    break;
+                }
+            }
+            else if (opcode > OpBinary || (opcode == OpContinuation) != d->isFragmented)
+            {
+                fail(CloseProtocolError);
+                break;
+            }
+
+            // Known before the payload arrives, don't wait for it
+            size_t buffered = opcode == OpContinuation ? d->message.size() : 0;
+            if (length > d->maxMessageSize - std::min(buffered, d->maxMessageSize))
+            {
+                fail(CloseTooBig);
+                break;
+            }
+
+            const uint8_t *mask = isMasked ? header + headerSize : nullptr;
+            if (isMasked) headerSize += 4;
+
+            if (available - headerSize < length) break;
+
+            consumed += headerSize + static_cast<size_t>(length);
+            processFrame(isFinal, opcode, data.subspan(consumed - static_cast<size_t>(length), static_cast<size_t>(length)), mask);
+        }
+
+        return d->state == Closed ? data.size() : consumed;
+    }
+
+    void WebSocket::processFrame(bool isFinal, uint8_t opcode, std::span<const char> payload, const uint8_t *mask)
+    {
+        if (opcode & 0x08)
+        {
+            char control[MaxControlPayload];
+            if (mask)
+            {
+                applyMask(control, payload.data(), payload.size(), mask);
+                payload = std::span<const char>(control, payload.size());
+            }
+
+            if (opcode == OpPing)
+            {
+                if (d->state == Open) sendFrame(OpPong, payload);
+            }
+            else if (opcode == OpPong)
+            {
+                d->pongHandlers(payload);
+            }
+            else
+            {
+                processClose(payload);
+            }
+            return;
+        }
+
+        // Closing: data that was on the way is dropped
+        if (d->state != Open) return;
+
+        if (opcode != OpContinuation)
+        {
+            d->messageType = opcode == OpText ? Text : Binary;
+
+            // Whole messages in one frame: clients hand out the view
+            if (isFinal && !mask)
+            {
+                deliverMessage(d->messageType, payload);
+                return;
+            }
+
+            d->message.clear();
+        }
+
+        size_t offset = d->message.size();
+        d->message.resize(offset + payload.size());
+
+        if (mask) applyMask(d->message.data() + offset, payload.data(), payload.size(), mask);
+        else if (!payload.empty()) std::memcpy(d->message.data() + offset, payload.data(), payload.size());
+
+        d->isFragmented = !isFinal;
+        if (isFinal)
+            deliverMessage(d->messageType, d->message);
+    }
+
+    void WebSocket::processClose(std::span<const char> payload)
+    {
+        uint16_t code = CloseNoStatus;
+
+        if (payload.size() == 1)
+        {
+            fail(CloseProtocolError);
+            return;
+        }
+
+        if (payload.size() >= 2)
+        {
+            code = static_cast<uint16_t>((static_cast<uint8_t>(payload[0]) << 8) | static_cast<uint8_t>(payload[1]));
+
+            if (!isValidCloseCode(code))
+            {
+                fail(CloseProtocolError);
+                return;
+            }
+
+            if (!isValidUtf8(payload.subspan(2)))
+            {
+                fail(CloseInvalidData);
+                return;
+            }
+        }
+
+        // Answer with the same code, unless this was the answer
+        if (d->state == Open)
+        {
+            std::span<const char> echo = payload.subspan(0, std::min<size_t>(payload.size(), 2));
+            sendFrame(OpClose, echo);
+        }
+
+        stopCloseTimer();
+        d->state = Closed;
+        d->closeHandlers(code);
+
+        if (d->socket->isConnected())
+            d->socket->disconnect();
+    }
+
+    void WebSocket::deliverMessage(MessageType type, std::span<const char> message)
+    {
+        if (type == Text && !isValidUtf8(message))
+        {
+            fail(CloseInvalidData);
+            return;
+        }
+
+        d->messageHandlers(type, message);
+    }
+
+    bool WebSocket::sendFrame(uint8_t opcode, std::span<const char> payload)
+    {
+        std::vector<char> frame;
+        frame.reserve(MaxFrameHeaderSize + payload.size());
+
+        frame.push_back(static_cast<char>(0x80 | opcode));
+        char maskBit = d->isClient ? static_cast<char>(0x80) : 0;
+
+        uint64_t size = payload.size();
+        if (size < 126)
+        {
+            frame.push_back(static_cast<char>(maskBit | static_cast<char>(size)));
+        }
+        else if (size <= 0xFFFF)
+        {
+            frame.push_back(static_cast<char>(maskBit | 126));
+            frame.push_back(static_cast<char>(size >> 8));
+            frame.push_back(static_cast<char>(size));
+        }
+        else
+        {
+            frame.push_back(static_cast<char>(maskBit | 127));
+            for (int i=7; i>=0; --i)
+                frame.push_back(static_cast<char>(size >> (i * 8)));
+        }
+
+        if (d->isClient)
+        {
+            uint8_t mask[4];
+            uint32_t word = randomWord();
+            std::memcpy(mask, &word, 4);
+            frame.insert(frame.end(), mask, mask + 4);
+
+            size_t offset = frame.size();
+            frame.resize(offset + payload.size());
+            applyMask(frame.data() + offset, payload.data(), payload.size(), mask);
+        }
+        else
+        {
+            frame.insert(frame.end(), payload.begin(), payload.end());
+        }
+
+        return d->socket->send(std::move(frame));
+    }
+
+    void WebSocket::fail(uint16_t code)
+    {
+        if (d->state == Closed) return;
+
+        if (d->state == Open && code != CloseAbnormal)
+        {
+            char payload[2] = {static_cast<char>(code >> 8), static_cast<char>(code)};
+            sendFrame(OpClose, payload);
+        }
+
+        stopCloseTimer();
+        d->state = Closed;
+        d->closeHandlers(code);
+
+        if (d->socket && (d->socket->isConnected() || d->socket->isConnecting()))
+            d->socket->disconnect();
+    }
+
+    void WebSocket::processDisconnected()
+    {
+        if (d->state == Closed) return;
+
+        stopCloseTimer();
+        d->state = Closed;
+        d->closeHandlers(CloseAbnormal);
+    }
+
+    void WebSocket::stopCloseTimer()
+    {
+#ifdef SACore
+        if (d->closeTimer > -1)
+            d->loop->killTimer(d->closeTimer);
+#endif
+        d->closeTimer = -1;
+    }
+}
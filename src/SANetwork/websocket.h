@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <span>
+#include <memory>
+#include <cstdint>
+#include <functional>
+
+namespace SA
+{
+    class EventLoop;
+    class TcpSocket;
+    class HttpServer;
+
+    // RFC 6455 connection. Clients come from connect(), the server side from
+    // HttpServer::addWebSocketRoute(). Frames are decoded in the read buffer
+    // of the socket: messages of one frame reach clients without a copy, the
+    // server unmasks them into a buffer that is reused. Pings are answered,
+    // fragmented messages are put together.
+    class WebSocket
+    {
+    public:
+        enum MessageType
+        {
+            Text,
+            Binary
+        };
+
+        enum State
+        {
+            Connecting,
+            Open,
+            Closing,
+            Closed
+        };
+
+        WebSocket();
+        virtual ~WebSocket();
+
+        // Connects through the event loop (TcpSocket::connectAsync) and sends
+        // the upgrade request. Open handlers are called once the server
+        // accepts it, close handlers with 1006 if it fails.
+        bool connect(const std::string &host, uint16_t port, const std::string &path = "/");
+        State state();
+
+        bool send(MessageType type, std::span<const char> payload);
+        bool sendText(std::string_view text);
+        bool ping(std::span<const char> payload = {});
+
+        // Broadcast: a frame encoded once is sent to every connection from
+        // one shared buffer. Server side only, clients have to mask theirs.
+        static std::shared_ptr<const std::vector<char> > encode(MessageType type, std::span<const char> payload);
+        bool send(const std::shared_ptr<const std::vector<char> > &frame);
+
+        // Starts the closing handshake, the connection ends when the peer
+        // answers it, or with 1006 if it does not within 5 seconds
+        void close(uint16_t code = 1000, std::string_view reason = {});
+
+        // 1 MiB by default, larger messages close with 1009. False if a
+        // frame of that size would not fit into the read buffer of the socket
+        // (TcpSocket::MaxReadSize).
+        bool setMaxMessageSize(size_t size);
+
+        int addOpenHandler(const std::function<void ()> &func);
+        void removeOpenHandler(int id);
+
+        // The view is only valid during the call, text is valid UTF-8
+        int addMessageHandler(const std::function<void (SA::WebSocket::MessageType type, std::span<const char> message)> &func);
+        void removeMessageHandler(int id);
+
+        int addPongHandler(const std::function<void (std::span<const char> payload)> &func);
+        void removePongHandler(int id);
+
+        // Called once: with the peer's close code, 1005 if it sent none,
+        // 1006 if the connection was lost without a closing handshake
+        int addCloseHandler(const std::function<void (uint16_t code)> &func);
+        void removeCloseHandler(int id);
+
+        // Sec-WebSocket-Accept for a Sec-WebSocket-Key
+        static std::string acceptKey(std::string_view key);
+
+    private:
+        friend class HttpServer;
+
+        void accept(SA::TcpSocket &socket);
+        size_t decode(std::span<const char> data);
+        size_t processHandshake(std::span<const char> data);
+        void processFrame(bool isFinal, uint8_t opcode, std::span<const char> payload, const uint8_t *mask);
+        void processClose(std::span<const char> payload);
+        void deliverMessage(MessageType type, std::span<const char> message);
+        bool sendFrame(uint8_t opcode, std::span<const char> payload);
+        void fail(uint16_t code);
+        void processDisconnected();
+        void stopCloseTimer();
+
+        WebSocket(const SA::WebSocket &) = delete;
+        WebSocket(SA::WebSocket &&) = delete;
+        void operator = (const SA::WebSocket &) = delete;
+        void operator = (SA::WebSocket &&) = delete;
+
+        struct WebSocketPrivate;
+        WebSocketPrivate * const d;
+
+    }; // class WebSocket
+} // namespace SA
@@ -18,7 +18,8 @@ TcpServerTest::TcpServerTest(SA::Widget *parent) : SA::Widget(parent),
     using namespace std::placeholders;
     m_btnStart.addPressHandler(std::bind(&TcpServerTest::btnStartPressed, this, _1));
     m_btnSend.addPressHandler(std::bind(&TcpServerTest::btnSendPressed, this, _1));
-    m_tcpServer.addConnectHandler(std::bind(&TcpServerTest::onSocketConnected, this, _1, _2, _3));
+    m_tcpServer.addConnectionHandler(std::bind(&TcpServerTest::onSocketConnected, this, _1, _2));
+    m_tcpServer.addDisconnectionHandler(std::bind(&TcpServerTest::onSocketDisconnected, this, _1));
 
     loadSettings();
     std::cout << __PRETTY_FUNCTION__ << std::endl;
@@ -26,42 +27,20 @@ TcpServerTest::TcpServerTest(SA::Widget *parent) : SA::Widget(parent),
 
 TcpServerTest::~TcpServerTest()
 {
-    m_sockets.clear();
     saveSettings();
     std::cout << __PRETTY_FUNCTION__ << std::endl;
 }
 
-void TcpServerTest::onSocketConnected(int sockDscr, uint32_t host, uint16_t port)
+void TcpServerTest::onSocketConnected(int id, SA::TcpSocket &socket)
 {
-    if (m_disconnectedSocket.get() && m_disconnectedSocket->descriptor() != sockDscr)
-        m_disconnectedSocket.reset();
+    socket.addReadHandler(std::bind(&TcpServerTest::dataReaded, this, std::placeholders::_1));
 
-    auto socket = std::make_shared<SA::TcpSocket>();
-    m_sockets.push_back(socket);
-
-    socket->setDescriptor(sockDscr);
-    socket->addReadHandler(std::bind(&TcpServerTest::dataReaded, this, std::placeholders::_1));
-    socket->addDisconnectHandler(std::bind(&TcpServerTest::onSocketDisconnected, this, std::placeholders::_1));
-
-    m_textEditRead.append("=== New socket connected: " + std::to_string(port) + " === " + std::to_string(m_sockets.size()));
+    m_textEditRead.append("=== New socket connected: " + std::to_string(id) + " === " + std::to_string(m_tcpServer.connectionCount()));
 }
 
-void TcpServerTest::onSocketDisconnected(int sockDscr)
+void TcpServerTest::onSocketDisconnected(int id)
 {
-    auto it = m_sockets.end();
-
-    for (it = m_sockets.begin(); it < m_sockets.end(); ++it) {
-        SA::TcpSocket &socket = *(*it);
-        if (socket.descriptor() == sockDscr) {
-            m_disconnectedSocket = *it;
-            break;
-        }
-    }
-
-    if (it != m_sockets.end())
-        m_sockets.erase(it);
-
-    m_textEditRead.append("=== One socket disconnected === " + std::to_string(m_sockets.size()));
+    m_textEditRead.append("=== Socket disconnected: " + std::to_string(id) + " === " + std::to_string(m_tcpServer.connectionCount()));
 }
 
 void TcpServerTest::btnStartPressed(bool state)
@@ -90,9 +69,8 @@ void TcpServerTest::btnStartPressed(bool state)
         m_tcpServer.close();
         if (!m_tcpServer.isListen())
         {
-            m_sockets.clear();
             m_btnStart.setText("Start");
-            m_textEditRead.append("=== Server stopped === " + std::to_string(m_sockets.size()));
+            m_textEditRead.append("=== Server stopped === " + std::to_string(m_tcpServer.connectionCount()));
         }
     }
 }
@@ -104,15 +82,16 @@ void TcpServerTest::btnSendPressed(bool state)
     const std::string &strData = m_textEditSend.text();
     std::vector<char> data(strData.begin(), strData.end());
 
-    for (auto &socket: m_sockets) {
-        socket->send(data);
-    }
+    m_tcpServer.forEachConnection([&data](int, SA::TcpSocket &socket) {
+        socket.send(data);
+    });
 }
 
-void TcpServerTest::dataReaded(const std::vector<char> &data)
+size_t TcpServerTest::dataReaded(std::span<const char> data)
 {
     std::string strData(data.begin(), data.end());
     m_textEditRead.append(strData);
+    return data.size();
 }
 
 void TcpServerTest::resizeEvent(const SA::Size &size)
@@ -27,14 +27,11 @@ private:
     SA::TcpServer m_tcpServer;
     int disconnectHandlerId;
 
-    std::vector<std::shared_ptr<SA::TcpSocket> > m_sockets;
-    std::shared_ptr<SA::TcpSocket> m_disconnectedSocket;
-
-    void onSocketConnected(int sockDscr, uint32_t host, uint16_t port);
-    void onSocketDisconnected(int sockDscr);
+    void onSocketConnected(int id, SA::TcpSocket &socket);
+    void onSocketDisconnected(int id);
     void btnStartPressed(bool state);
     void btnSendPressed(bool state);
-    void dataReaded(const std::vector<char> &data);
+    size_t dataReaded(std::span<const char> data);
     void resizeEvent(const SA::Size &size);
     void loadSettings();
     void saveSettings();
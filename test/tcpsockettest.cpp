@@ -2,6 +2,8 @@
 #include <fstream>
 #include <string>
 #include <functional>
+#include <algorithm>
+#include <cstring>
 #include "tcpsockettest.h"
 
 TcpSocketTest::TcpSocketTest(SA::Widget *parent) : SA::Widget(parent),
@@ -19,11 +21,22 @@ TcpSocketTest::TcpSocketTest(SA::Widget *parent) : SA::Widget(parent),
     using namespace std::placeholders;
     m_btnConnect.addPressHandler(std::bind(&TcpSocketTest::btnConnectPressed, this, _1));
     m_btnSend.addPressHandler(std::bind(&TcpSocketTest::btnSendPressed, this, _1));
-    m_tcpSocket.addReadHandler(std::bind(&TcpSocketTest::dataReaded, this, _1));
+    m_lineCodec.setDelimiter("\n");
+    m_lineCodec.addFrameHandler(std::bind(&TcpSocketTest::lineReaded, this, _1));
+    m_lineCodec.attach(m_tcpSocket);
     m_tcpSocket.addDisconnectHandler([this](int){
         m_btnConnect.setText("Connect");
         m_textEditRead.append("=== Disconnected from server ===");
     });
+    m_tcpSocket.addConnectHandler([this]{
+        m_lineCodec.reset();
+        m_btnConnect.setText("Disconnect");
+        m_textEditRead.append("=== Connected to server ===");
+    });
+    m_tcpSocket.addErrorHandler([this](int error){
+        m_btnConnect.setText("Connect");
+        m_textEditRead.append("=== Connection failed: " + std::string(std::strerror(error)) + " ===");
+    });
 
     loadSettings();
     std::cout << __PRETTY_FUNCTION__ << std::endl;
@@ -39,7 +52,7 @@ void TcpSocketTest::btnConnectPressed(bool state)
 {
     if (!state) return;
 
-    if (!m_tcpSocket.isConnected())
+    if (!m_tcpSocket.isConnected() && !m_tcpSocket.isConnecting())
     {
         std::string host = m_lineEditHost.text();
         uint16_t port = 0;
@@ -52,19 +65,20 @@ void TcpSocketTest::btnConnectPressed(bool state)
         }
 
 
-        if (m_tcpSocket.connect(host, port))
+        if (m_tcpSocket.connectAsync(host, port))
         {
-            m_btnConnect.setText("Disconnect");
-            m_textEditRead.append("=== Connected to server ===");
+            m_btnConnect.setText("Cancel");
+            m_textEditRead.append("=== Connecting to " + host + " ===");
         }
     }
     else
     {
+        bool isConnecting = m_tcpSocket.isConnecting();
         m_tcpSocket.disconnect();
         if (!m_tcpSocket.isConnected())
         {
             m_btnConnect.setText("Connect");
-            m_textEditRead.append("=== Disconnected from server ===");
+            m_textEditRead.append(isConnecting ? "=== Connecting canceled ===" : "=== Disconnected from server ===");
         }
     }
 }
@@ -74,15 +88,25 @@ void TcpSocketTest::btnSendPressed(bool state)
     if (!state) return;
 
     const std::string &strData = m_textEditSend.text();
-    std::vector<char> data(strData.begin(), strData.end());
+    if (strData.empty()) return;
+
+    std::vector<char> data;
+
+    // One line per frame, so the text is split at its line breaks
+    size_t begin = 0;
+    while (begin <= strData.size())
+    {
+        size_t end = std::min(strData.find('\n', begin), strData.size());
+        m_lineCodec.encode(std::span<const char>(strData.data() + begin, end - begin), data);
+        begin = end + 1;
+    }
 
     m_tcpSocket.send(data);
 }
 
-void TcpSocketTest::dataReaded(const std::vector<char> &data)
+void TcpSocketTest::lineReaded(std::span<const char> line)
 {
-    std::string strData(data.begin(), data.end());
-    m_textEditRead.append(strData);
+    m_textEditRead.append(std::string(line.begin(), line.end()));
 }
 
 void TcpSocketTest::resizeEvent(const SA::Size &size)
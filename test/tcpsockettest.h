@@ -7,6 +7,7 @@
 #include "lineedit.h"
 #include "label.h"
 #include "tcpsocket.h"
+#include "framecodec.h"
 
 class TcpSocketTest : public SA::Widget
 {
@@ -25,10 +26,11 @@ private:
     SA::Button m_btnConnect;
     SA::Button m_btnSend;
     SA::TcpSocket m_tcpSocket;
+    SA::FrameCodec m_lineCodec;
 
     void btnConnectPressed(bool state);
     void btnSendPressed(bool state);
-    void dataReaded(const std::vector<char> &data);
+    void lineReaded(std::span<const char> line);
     void resizeEvent(const SA::Size &size);
     void loadSettings();
     void saveSettings();
@@ -80,7 +80,7 @@ void UdpSocketTest::btnSendPressed(bool state)
     m_udpSocket.send(data, host, port);
 }
 
-void UdpSocketTest::dataReaded(const std::vector<char> &data)
+void UdpSocketTest::dataReaded(std::span<const char> data)
 {
     std::string strData(data.begin(), data.end());
     m_textEditRead.append(strData);
@@ -31,7 +31,7 @@ private:
 
     void btnBindPressed(bool state);
     void btnSendPressed(bool state);
-    void dataReaded(const std::vector<char> &data);
+    void dataReaded(std::span<const char> data);
     void resizeEvent(const SA::Size &size);
     void loadSettings();
     void saveSettings();